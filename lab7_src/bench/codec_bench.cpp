@@ -0,0 +1,258 @@
+// 帧编解码微基准 (Google Benchmark)：编码、解码与解码后按类型分发，以每秒包数 (frames_per_second) 衡量
+//   - encode：append_frame 写入复用的缓冲 (v1 / v2 带校验和)，以及应答进入 OutputQueue 后批量写出
+//   - decode：连续解出缓冲中的 1000 个包 (v1 / v2 带校验和)
+//   - dispatch：字节流追加进 RecvBuffer 后由 drain_frames 取出、按类型分发 (服务器处理循环的框架部分)
+//   - broadcast：FrameVariants 为混用 v1 / v2 的接收者各序列化一次
+//   - http：HttpParser 解析流水线上的 GET 请求
+// 回归检查：--save-baseline FILE 记录每项的 frames_per_second，--baseline FILE 对比，
+// 任何一项低于基线 (1 - tolerance%) 时退出码为 1
+// 用法：./codec_bench [--baseline FILE [--tolerance PCT]] [--save-baseline FILE] [Google Benchmark 参数...]
+#include <benchmark/benchmark.h>
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include "../frame_codec.h"
+#include "../output_queue.h"
+#include "../http_codec.h"
+
+namespace {
+
+const WireFormat V1;
+const WireFormat V2_CHECKSUM(PROTOCOL_VERSION, FLAG_REQUEST_ID | FLAG_CONTINUATION | FLAG_CHECKSUM);
+const int FRAMES_PER_BUFFER = 1000;
+
+void set_frame_rate(benchmark::State& state, int64_t frames_per_iteration, size_t bytes_per_iteration) {
+    state.counters["frames_per_second"] =
+        benchmark::Counter((double)frames_per_iteration, benchmark::Counter::kIsIterationInvariantRate);
+    state.SetBytesProcessed((int64_t)state.iterations() * (int64_t)bytes_per_iteration);
+}
+
+const WireFormat& wire_of(const benchmark::State& state) { return state.range(1) ? V2_CHECKSUM : V1; }
+
+// === 编码 ===
+void BM_Encode(benchmark::State& state) {
+    std::string body(state.range(0), 'x');
+    const WireFormat& wire = wire_of(state);
+    std::string out;
+    uint32_t request_id = 0;
+    for (auto _ : state) {
+        out.clear();
+        append_frame(out, IND_RECV_MSG, body, wire, ++request_id);
+        benchmark::DoNotOptimize(out.data());
+    }
+    set_frame_rate(state, 1, out.size());
+}
+BENCHMARK(BM_Encode)->ArgNames({"body", "v2"})->ArgsProduct({{16, 256, 4096}, {0, 1}});
+
+// 应答写入发送队列后一次 writev 写出 (写到 /dev/null)：槽位与包体容量复用，稳定后没有堆分配
+void BM_OutputQueueFlush(benchmark::State& state) {
+    std::string body(state.range(0), 'x');
+    const WireFormat& wire = wire_of(state);
+    OutputQueue queue;
+    int fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    uint32_t request_id = 0;
+    for (auto _ : state) {
+        for (int i = 0; i < 64; ++i) queue.push_frame(RES_OK, body, wire, ++request_id);
+        if (queue.flush(fd) != FLUSH_DONE) state.SkipWithError("flush failed");
+    }
+    close(fd);
+    set_frame_rate(state, 64, 64 * (body.size() + (state.range(1) ? HEADER_V2_SIZE : HEADER_SIZE)));
+}
+BENCHMARK(BM_OutputQueueFlush)->ArgNames({"body", "v2"})->ArgsProduct({{16, 256}, {0, 1}});
+
+// 广播：一条消息分别按 v1 与 v2 序列化 (每种格式一次)，接收者共享
+void BM_BroadcastVariants(benchmark::State& state) {
+    std::string message(state.range(0), 'x');
+    for (auto _ : state) {
+        FrameVariants fwd(IND_RECV_MSG);
+        fwd.body() = "12|";
+        fwd.body() += message;
+        benchmark::DoNotOptimize(fwd.get(V1).get());
+        benchmark::DoNotOptimize(fwd.get(V2_CHECKSUM).get());
+    }
+    set_frame_rate(state, 2, 2 * message.size());
+}
+BENCHMARK(BM_BroadcastVariants)->ArgName("body")->Arg(16)->Arg(1024);
+
+// === 解码 ===
+std::string make_stream(size_t body_size, const WireFormat& wire) {
+    std::string stream, body(body_size, 'x');
+    for (int i = 0; i < FRAMES_PER_BUFFER; ++i) append_frame(stream, REQ_SEND_MSG, body, wire, i + 1);
+    return stream;
+}
+
+void BM_Decode(benchmark::State& state) {
+    std::string stream = make_stream(state.range(0), wire_of(state));
+    Frame frame;
+    for (auto _ : state) {
+        size_t pos = 0;
+        while (pos < stream.size() && decode_frame(stream.data() + pos, stream.size() - pos, frame) == DECODE_FRAME) {
+            benchmark::DoNotOptimize(frame.body);
+            pos += frame.size();
+        }
+        if (pos != stream.size()) state.SkipWithError("decode stopped early");
+    }
+    set_frame_rate(state, FRAMES_PER_BUFFER, stream.size());
+}
+BENCHMARK(BM_Decode)->ArgNames({"body", "v2"})->ArgsProduct({{16, 256, 4096}, {0, 1}});
+
+// === 解码 + 分发 ===
+// 典型的混合负载：时间、名字、列表、发消息、心跳，按到达的 recv 大小分段追加
+void BM_DrainDispatch(benchmark::State& state) {
+    const WireFormat& wire = wire_of(state);
+    static const uint32_t types[] = {REQ_TIME, REQ_SEND_MSG, REQ_LIST, REQ_SEND_MSG, REQ_PING, REQ_NAME};
+    std::string stream;
+    for (int i = 0; i < FRAMES_PER_BUFFER; ++i) {
+        uint32_t type = types[i % 6];
+        append_frame(stream, type, type == REQ_SEND_MSG ? "1048594:hello, how are you" : "", wire, i + 1);
+    }
+    size_t chunk = state.range(0);
+    RecvBuffer in;
+    Frame frame;
+    uint64_t counts[16] = {0};
+    for (auto _ : state) {
+        for (size_t pos = 0; pos < stream.size(); pos += chunk) {
+            in.append(stream.data() + pos, std::min(chunk, stream.size() - pos));
+            drain_frames(in, frame, 1024 * 1024, [&](const Frame& f, DecodeStatus status) {
+                switch (f.header.type) {
+                    case REQ_TIME:
+                    case REQ_NAME:
+                    case REQ_LIST:
+                    case REQ_PING:
+                        ++counts[f.header.type];
+                        break;
+                    case REQ_SEND_MSG:
+                        counts[REQ_SEND_MSG] += memchr(f.body, ':', f.header.length) != nullptr;
+                        break;
+                    default:
+                        ++counts[0];
+                }
+                return status == DECODE_FRAME;
+            });
+        }
+        benchmark::DoNotOptimize(counts);
+    }
+    if (!in.empty()) state.SkipWithError("partial frame left in buffer");
+    set_frame_rate(state, FRAMES_PER_BUFFER, stream.size());
+}
+BENCHMARK(BM_DrainDispatch)->ArgNames({"recv", "v2"})->ArgsProduct({{1500, 65536}, {0, 1}});
+
+// === HTTP ===
+void BM_HttpParseGet(benchmark::State& state) {
+    std::string request = "GET /index.html HTTP/1.1\r\nHost: 127.0.0.1:2996\r\nUser-Agent: bench\r\nAccept: */*\r\n\r\n";
+    std::string stream;
+    for (int i = 0; i < 100; ++i) stream += request;
+    RecvBuffer in;
+    HttpParser parser(1024 * 1024);
+    for (auto _ : state) {
+        in.append(stream.data(), stream.size());
+        while (parser.parse(in) == HTTP_REQUEST) {
+            benchmark::DoNotOptimize(parser.request().target.data());
+            parser.reset();
+        }
+    }
+    set_frame_rate(state, 100, stream.size());
+}
+BENCHMARK(BM_HttpParseGet);
+
+// === 基线对比 ===
+// 控制台输出之外收集每项的 frames_per_second；重复多次 (--benchmark_repetitions) 时取中位数
+class RateCollector : public benchmark::ConsoleReporter {
+public:
+    std::map<std::string, double> rates;
+
+    // 输出到终端时才用颜色 (make bench 的输出常被重定向到文件)
+    RateCollector() : ConsoleReporter(isatty(STDOUT_FILENO) ? OO_ColorTabular : OO_Tabular) {}
+
+    void ReportRuns(const std::vector<Run>& runs) override {
+        for (const Run& run : runs) {
+            auto it = run.counters.find("frames_per_second");
+            if (run.error_occurred || it == run.counters.end()) continue;
+            if (run.run_type == Run::RT_Aggregate && run.aggregate_name == "median") {
+                rates[run.run_name.str()] = it->second.value;
+                medians_.insert(run.run_name.str());
+            } else if (run.run_type == Run::RT_Iteration && !medians_.count(run.run_name.str())) {
+                rates[run.run_name.str()] = it->second.value;
+            }
+        }
+        ConsoleReporter::ReportRuns(runs);
+    }
+
+private:
+    std::set<std::string> medians_;
+};
+
+bool load_baseline(const std::string& path, std::map<std::string, double>& baseline) {
+    std::ifstream in(path);
+    std::string name;
+    double rate;
+    while (in >> name >> rate) baseline[name] = rate;
+    return !baseline.empty();
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    // 1. 取出本程序的参数，其余交给 Google Benchmark
+    std::string baseline_path, save_path;
+    double tolerance = 15;
+    std::vector<char*> args;
+    for (int i = 0; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--baseline" && i + 1 < argc) {
+            baseline_path = argv[++i];
+        } else if (arg == "--save-baseline" && i + 1 < argc) {
+            save_path = argv[++i];
+        } else if (arg == "--tolerance" && i + 1 < argc) {
+            tolerance = atof(argv[++i]);
+        } else {
+            args.push_back(argv[i]);
+        }
+    }
+    int bench_argc = (int)args.size();
+    benchmark::Initialize(&bench_argc, args.data());
+    if (benchmark::ReportUnrecognizedArguments(bench_argc, args.data())) return 1;
+
+    RateCollector reporter;
+    benchmark::RunSpecifiedBenchmarks(&reporter);
+    benchmark::Shutdown();
+
+    // 2. 保存基线
+    if (!save_path.empty()) {
+        std::ofstream out(save_path);
+        out << std::setprecision(10);
+        for (const auto& item : reporter.rates) out << item.first << ' ' << item.second << '\n';
+        std::cout << "Saved " << reporter.rates.size() << " baseline rate(s) to " << save_path << std::endl;
+    }
+
+    // 3. 与基线对比
+    if (baseline_path.empty()) return 0;
+    std::map<std::string, double> baseline;
+    if (!load_baseline(baseline_path, baseline)) {
+        std::cerr << "Cannot read baseline " << baseline_path << std::endl;
+        return 1;
+    }
+    int regressions = 0;
+    std::cout << std::fixed << std::setprecision(1);
+    for (const auto& item : reporter.rates) {
+        auto it = baseline.find(item.first);
+        if (it == baseline.end() || it->second <= 0) continue;
+        double change = (item.second / it->second - 1) * 100;
+        if (change < -tolerance) {
+            std::cout << "REGRESSION " << item.first << ": " << item.second << " frames/s vs baseline " << it->second
+                      << " (" << change << "%)\n";
+            ++regressions;
+        }
+    }
+    std::cout << (regressions ? "FAILED: " : "OK: ") << regressions << " of " << reporter.rates.size()
+              << " benchmark(s) more than " << tolerance << "% below " << baseline_path << std::endl;
+    return regressions ? 1 : 0;
+}
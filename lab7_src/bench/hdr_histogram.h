@@ -0,0 +1,77 @@
+#ifndef HDR_HISTOGRAM_H
+#define HDR_HISTOGRAM_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+
+// === 延迟直方图 (HDR Histogram 的简化实现) ===
+// 值域按 2 的幂分段，每段再等分为 128 个桶：任意值的相对误差不超过 1/128 (< 0.8%)，
+// 从 1 ns 到数小时都能以固定内存 (约 7500 个计数器) 记录，记录一次 O(1)。
+// 小于 256 的值精确记录。各线程各自记录，结束后 merge 汇总。
+class HdrHistogram {
+public:
+    static constexpr int SUB_BITS = 8;                         // 每段 2^(SUB_BITS-1) = 128 个桶
+    static constexpr uint64_t HALF = 1ull << (SUB_BITS - 1);
+    static constexpr size_t BUCKETS = (64 - SUB_BITS + 2) * HALF;
+
+    HdrHistogram() : counts_(BUCKETS, 0), total_(0), sum_(0), min_(UINT64_MAX), max_(0) {}
+
+    void record(uint64_t value) {
+        ++counts_[index_of(value)];
+        ++total_;
+        sum_ += value;
+        min_ = std::min(min_, value);
+        max_ = std::max(max_, value);
+    }
+
+    void merge(const HdrHistogram& other) {
+        for (size_t i = 0; i < BUCKETS; ++i) counts_[i] += other.counts_[i];
+        total_ += other.total_;
+        sum_ += other.sum_;
+        min_ = std::min(min_, other.min_);
+        max_ = std::max(max_, other.max_);
+    }
+
+    uint64_t count() const { return total_; }
+    uint64_t min() const { return total_ ? min_ : 0; }
+    uint64_t max() const { return max_; }
+    double mean() const { return total_ ? (double)sum_ / total_ : 0.0; }
+
+    // 第 q 分位 (0 < q <= 1) 的值：返回所在桶的中点，最大值所在的桶返回精确的最大值
+    uint64_t percentile(double q) const {
+        if (total_ == 0) return 0;
+        uint64_t rank = (uint64_t)(q * total_ + 0.5);
+        rank = std::max<uint64_t>(1, std::min(rank, total_));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < BUCKETS; ++i) {
+            seen += counts_[i];
+            if (seen >= rank) return std::min(max_, midpoint_of(i));
+        }
+        return max_;
+    }
+
+private:
+    // [0, 2*HALF) 精确；之后每段的 HALF 个桶宽度为 2^shift
+    static size_t index_of(uint64_t value) {
+        if (value < 2 * HALF) return (size_t)value;
+        int shift = 63 - __builtin_clzll(value) - (SUB_BITS - 1);
+        return (size_t)(shift + 1) * HALF + (size_t)((value >> shift) - HALF);
+    }
+
+    static uint64_t midpoint_of(size_t index) {
+        if (index < 2 * HALF) return index;
+        int shift = (int)(index / HALF) - 1;
+        uint64_t low = (index % HALF + HALF) << shift;
+        return low + ((1ull << shift) >> 1);
+    }
+
+    std::vector<uint64_t> counts_;
+    uint64_t total_;
+    uint64_t sum_;
+    uint64_t min_;
+    uint64_t max_;
+};
+
+#endif // HDR_HISTOGRAM_H
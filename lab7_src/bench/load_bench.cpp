@@ -0,0 +1,437 @@
+// 负载生成器：少量线程驱动大量连接，按比例混合发送 REQ_TIME / REQ_LIST / REQ_SEND_MSG，
+// 统计吞吐量与延迟分布 (HDR 直方图的 p50 / p99 / p99.9)
+// 闭环 (默认)：每个连接保持 --depth 个在途请求，收到应答立即发下一个
+// 开环 (--rate N)：按固定的总速率发送，与应答快慢无关；延迟从计划发送时刻算起，
+//                  服务器变慢时排队的时间也计入延迟 (避免 coordinated omission)
+// 用法：./load_bench [--host IP] [--port N] [--threads N] [--conns N] [--duration 秒] [--warmup 秒]
+//                    [--mix TIME:LIST:SEND] [--rate 请求数/秒] [--depth N] [--payload 字节]
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "../protocol.h"
+#include "../frame_codec.h"
+#include "../ring_queue.h"
+#include "hdr_histogram.h"
+
+typedef std::chrono::steady_clock Clock;
+
+// 请求种类 (统计时分别记录)
+enum RequestKind { KIND_TIME, KIND_LIST, KIND_SEND, KIND_COUNT };
+const char* const KIND_NAMES[KIND_COUNT] = {"time", "list", "send"};
+const uint32_t KIND_TYPES[KIND_COUNT] = {REQ_TIME, REQ_LIST, REQ_SEND_MSG};
+
+// 启动参数
+struct BenchConfig {
+    std::string host = "127.0.0.1";
+    int port = 2996;
+    int threads = 4;
+    int conns = 1000;          // 总连接数
+    double duration = 10.0;    // 计量时长 (秒)
+    double warmup = 1.0;       // 预热时长 (秒)，期间的请求不计入统计
+    int mix[KIND_COUNT] = {80, 10, 10};
+    double rate = 0;           // 开环模式的总请求速率，0 表示闭环
+    int depth = 1;             // 闭环模式下每个连接的在途请求数
+    size_t payload = 64;       // REQ_SEND_MSG 的消息长度
+};
+
+BenchConfig config;
+
+// 已发出、等待应答的请求 (服务器按请求顺序应答，队首即下一个应答对应的请求)
+struct Pending {
+    RequestKind kind;
+    Clock::time_point start;  // 开环模式下为计划发送时刻
+};
+
+struct BenchConn {
+    int fd = -1;
+    bool alive = true;
+    RecvBuffer rbuf;
+    std::string wbuf;          // 尚未写出的请求
+    size_t woff = 0;
+    RingQueue<Pending> pending;
+};
+
+// 每个线程的统计结果
+struct ThreadStats {
+    HdrHistogram latency[KIND_COUNT];
+    uint64_t completed = 0;   // 计量窗口内完成的请求数
+    uint64_t errors = 0;      // RES_ERROR 应答数 (例如目标邮箱已满)
+    uint64_t delivered = 0;   // 收到的转发消息数 (IND_RECV_MSG)
+    uint64_t dropped = 0;     // 中途断开的连接数
+};
+
+// 连接服务器并读掉欢迎消息 (阻塞)
+int connect_server() {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(config.port);
+    if (inet_pton(AF_INET, config.host.c_str(), &addr.sin_addr) != 1 ||
+        connect(fd, (sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    int opt = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+    return fd;
+}
+
+// 阻塞读取一个完整的包 (仅用于建立连接阶段)
+bool read_frame(int fd, RecvBuffer& buf, uint32_t& type, std::string& body) {
+    Frame frame;
+    DecodeStatus status;
+    while ((status = decode_frame(buf, frame)) == DECODE_NEED_MORE) {
+        if (buf.read_from(fd) <= 0) return false;
+    }
+    if (status != DECODE_FRAME) return false;
+    type = frame.header.type;
+    body.assign(frame.body, frame.header.length);
+    buf.consume(frame.size());
+    return true;
+}
+
+// 用一条 REQ_LIST 查出所有压测连接在服务器上的 ID (按本地端口匹配)，作为 REQ_SEND_MSG 的目标
+std::vector<int> lookup_ids(std::vector<BenchConn>& conns) {
+    std::vector<int> ports;
+    for (BenchConn& conn : conns) {
+        sockaddr_in addr;
+        socklen_t len = sizeof(addr);
+        getsockname(conn.fd, (sockaddr*)&addr, &len);
+        ports.push_back(ntohs(addr.sin_port));
+    }
+    std::sort(ports.begin(), ports.end());
+
+    std::string request;
+    append_frame(request, REQ_LIST, "");
+    if (send(conns[0].fd, request.data(), request.size(), 0) != (ssize_t)request.size()) return {};
+    uint32_t type;
+    std::string list;
+    if (!read_frame(conns[0].fd, conns[0].rbuf, type, list) || type != RES_LIST) return {};
+
+    // 每行 "ID\tIP:Port"，第一行为表头
+    std::vector<int> ids;
+    size_t pos = list.find('\n');
+    while (pos != std::string::npos && pos + 1 < list.size()) {
+        size_t end = list.find('\n', pos + 1);
+        std::string line = list.substr(pos + 1, end == std::string::npos ? std::string::npos : end - pos - 1);
+        size_t tab = line.find('\t');
+        size_t colon = line.rfind(':');
+        if (tab != std::string::npos && colon != std::string::npos) {
+            int port = atoi(line.c_str() + colon + 1);
+            if (std::binary_search(ports.begin(), ports.end(), port)) ids.push_back(atoi(line.c_str()));
+        }
+        pos = end;
+    }
+    return ids;
+}
+
+class Worker {
+public:
+    Worker(std::vector<BenchConn>& conns, size_t first, size_t last, const std::vector<int>& ids, unsigned seed)
+        : conns_(conns), first_(first), last_(last), ids_(ids), rng_(seed),
+          kind_dist_(std::begin(config.mix), std::end(config.mix)), next_conn_(first) {
+        payload_.assign(config.payload, 'x');
+    }
+
+    void run(Clock::time_point measure_start, Clock::time_point end) {
+        measure_start_ = measure_start;
+        std::vector<pollfd> fds(last_ - first_);
+        for (size_t i = first_; i < last_; ++i) {
+            fds[i - first_].fd = conns_[i].fd;
+            fds[i - first_].events = POLLIN;
+        }
+
+        // 开环：每个线程承担总速率的 1/threads
+        bool open_loop = config.rate > 0;
+        auto interval = std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double>(open_loop ? config.threads / config.rate : 0));
+        Clock::time_point next_send = Clock::now();
+
+        if (!open_loop) {
+            for (size_t i = first_; i < last_; ++i) {
+                for (int d = 0; d < config.depth; ++d) send_request(conns_[i], Clock::now());
+            }
+        }
+
+        while (true) {
+            Clock::time_point now = Clock::now();
+            if (now >= end) break;
+
+            // 1. 开环：补发所有已到计划时刻的请求
+            int timeout_ms = (int)std::chrono::duration_cast<std::chrono::milliseconds>(end - now).count() + 1;
+            if (open_loop) {
+                while (next_send <= now) {
+                    BenchConn* conn = pick_conn();
+                    if (!conn) break;
+                    send_request(*conn, next_send);
+                    next_send += interval;
+                }
+                auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(next_send - now).count();
+                timeout_ms = std::min<int>(timeout_ms, (int)std::max<long long>(0, wait));
+            }
+
+            // 2. 等待应答；有未写完的请求时同时等待可写
+            for (size_t i = first_; i < last_; ++i) {
+                BenchConn& conn = conns_[i];
+                fds[i - first_].fd = conn.alive ? conn.fd : -1;
+                fds[i - first_].events = POLLIN | (conn.woff < conn.wbuf.size() ? POLLOUT : 0);
+            }
+            if (poll(fds.data(), fds.size(), timeout_ms) < 0) {
+                if (errno == EINTR) continue;
+                perror("poll");
+                break;
+            }
+
+            // 3. 处理应答：闭环模式下每完成一个请求就补发一个
+            for (size_t i = first_; i < last_; ++i) {
+                BenchConn& conn = conns_[i];
+                short revents = fds[i - first_].revents;
+                if (!conn.alive || revents == 0) continue;
+                if (revents & POLLOUT) flush(conn);
+                if (revents & (POLLIN | POLLHUP | POLLERR)) {
+                    ssize_t n = conn.rbuf.read_from(conn.fd, 16 * 1024);
+                    if (n <= 0 && !(n < 0 && (errno == EAGAIN || errno == EINTR))) {
+                        drop(conn);
+                        continue;
+                    }
+                    int done = handle_replies(conn);
+                    if (!open_loop) {
+                        for (int k = 0; k < done && conn.alive; ++k) send_request(conn, Clock::now());
+                    }
+                }
+            }
+        }
+    }
+
+    ThreadStats stats;
+
+private:
+    // 开环模式下轮流选择连接
+    BenchConn* pick_conn() {
+        for (size_t n = last_ - first_; n > 0; --n) {
+            BenchConn& conn = conns_[next_conn_];
+            next_conn_ = next_conn_ + 1 < last_ ? next_conn_ + 1 : first_;
+            if (conn.alive) return &conn;
+        }
+        return nullptr;
+    }
+
+    void send_request(BenchConn& conn, Clock::time_point start) {
+        RequestKind kind = (RequestKind)kind_dist_(rng_);
+        body_.clear();
+        if (kind == KIND_SEND) {
+            body_ += std::to_string(ids_[rng_() % ids_.size()]);
+            body_ += ':';
+            body_ += payload_;
+        }
+        append_frame(conn.wbuf, KIND_TYPES[kind], body_);
+        Pending& pending = conn.pending.push_back();
+        pending.kind = kind;
+        pending.start = start;
+        flush(conn);
+    }
+
+    void flush(BenchConn& conn) {
+        while (conn.woff < conn.wbuf.size()) {
+            ssize_t n = send(conn.fd, conn.wbuf.data() + conn.woff, conn.wbuf.size() - conn.woff, MSG_NOSIGNAL);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                if (errno != EAGAIN && errno != EWOULDBLOCK) drop(conn);
+                return;
+            }
+            conn.woff += n;
+        }
+        conn.wbuf.clear();
+        conn.woff = 0;
+    }
+
+    // 解析读缓冲中的所有应答，返回完成的请求数
+    int handle_replies(BenchConn& conn) {
+        Frame frame;
+        int done = 0;
+        Clock::time_point now = Clock::now();
+        while (decode_frame(conn.rbuf, frame) == DECODE_FRAME) {
+            uint32_t type = frame.header.type;
+            conn.rbuf.consume(frame.size());
+            if (type == IND_RECV_MSG) {
+                ++stats.delivered;
+                continue;
+            }
+            if (type == IND_SHUTDOWN) continue;  // 服务器关闭通知，不对应任何请求
+            if (conn.pending.empty()) continue;  // 多余的应答 (不应出现)
+            Pending& pending = conn.pending.front();
+            if (pending.start >= measure_start_) {
+                uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(now - pending.start).count();
+                stats.latency[pending.kind].record(ns);
+                ++stats.completed;
+                if (type == RES_ERROR) ++stats.errors;
+            }
+            conn.pending.pop_front();
+            ++done;
+        }
+        return done;
+    }
+
+    void drop(BenchConn& conn) {
+        if (!conn.alive) return;
+        conn.alive = false;
+        ++stats.dropped;
+    }
+
+    std::vector<BenchConn>& conns_;
+    size_t first_, last_;
+    const std::vector<int>& ids_;
+    std::mt19937 rng_;
+    std::discrete_distribution<int> kind_dist_;
+    size_t next_conn_;
+    std::string payload_;
+    std::string body_;
+    Clock::time_point measure_start_;
+};
+
+void parse_args(int argc, char* argv[]) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--host" && i + 1 < argc) {
+            config.host = argv[++i];
+        } else if (arg == "--port" && i + 1 < argc) {
+            config.port = atoi(argv[++i]);
+        } else if (arg == "--threads" && i + 1 < argc) {
+            config.threads = std::max(1, atoi(argv[++i]));
+        } else if (arg == "--conns" && i + 1 < argc) {
+            config.conns = std::max(1, atoi(argv[++i]));
+        } else if (arg == "--duration" && i + 1 < argc) {
+            config.duration = std::max(0.1, atof(argv[++i]));
+        } else if (arg == "--warmup" && i + 1 < argc) {
+            config.warmup = std::max(0.0, atof(argv[++i]));
+        } else if (arg == "--rate" && i + 1 < argc) {
+            config.rate = std::max(0.0, atof(argv[++i]));
+        } else if (arg == "--depth" && i + 1 < argc) {
+            config.depth = std::max(1, atoi(argv[++i]));
+        } else if (arg == "--payload" && i + 1 < argc) {
+            config.payload = (size_t)std::max(0, atoi(argv[++i]));
+        } else if (arg == "--mix" && i + 1 < argc) {
+            // "TIME:LIST:SEND" 三个非负权重
+            if (sscanf(argv[++i], "%d:%d:%d", &config.mix[KIND_TIME], &config.mix[KIND_LIST], &config.mix[KIND_SEND]) != 3 ||
+                config.mix[0] < 0 || config.mix[1] < 0 || config.mix[2] < 0 ||
+                config.mix[0] + config.mix[1] + config.mix[2] == 0) {
+                std::cerr << "[Error] --mix expects TIME:LIST:SEND weights, e.g. 80:10:10" << std::endl;
+                exit(EXIT_FAILURE);
+            }
+        } else {
+            std::cerr << "Usage: " << argv[0]
+                      << " [--host IP] [--port N] [--threads N] [--conns N] [--duration SECONDS] [--warmup SECONDS]\n"
+                      << "       [--mix TIME:LIST:SEND] [--rate REQ_PER_SEC] [--depth N] [--payload BYTES]" << std::endl;
+            exit(EXIT_FAILURE);
+        }
+    }
+    config.threads = std::min(config.threads, config.conns);
+}
+
+// 连接数可能超过默认的文件描述符上限，先提升到硬上限
+void raise_fd_limit() {
+    rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+void print_row(const char* name, const HdrHistogram& h) {
+    std::cout << std::left << std::setw(8) << name << std::right << std::setw(12) << h.count() << std::fixed
+              << std::setprecision(1);
+    const double qs[] = {0.5, 0.9, 0.99, 0.999};
+    for (double q : qs) std::cout << std::setw(11) << h.percentile(q) / 1e3;
+    std::cout << std::setw(11) << h.max() / 1e3 << std::setw(11) << h.mean() / 1e3 << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    parse_args(argc, argv);
+    raise_fd_limit();
+
+    // 1. 建立所有连接 (阻塞)，读掉欢迎消息后切换为非阻塞
+    std::vector<BenchConn> conns(config.conns);
+    for (BenchConn& conn : conns) {
+        conn.fd = connect_server();
+        uint32_t type;
+        std::string body;
+        if (conn.fd < 0 || !read_frame(conn.fd, conn.rbuf, type, body)) {
+            std::cerr << "[Error] Failed to connect to " << config.host << ":" << config.port << " ("
+                      << strerror(errno) << ")" << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    std::vector<int> ids = lookup_ids(conns);
+    if (ids.empty()) {
+        std::cerr << "[Error] Failed to look up client IDs with REQ_LIST." << std::endl;
+        return EXIT_FAILURE;
+    }
+    for (BenchConn& conn : conns) fcntl(conn.fd, F_SETFL, fcntl(conn.fd, F_GETFL, 0) | O_NONBLOCK);
+
+    // 2. 连接平均分给各线程，预热后开始计量
+    std::cout << "connections=" << config.conns << " threads=" << config.threads << " mix(time:list:send)="
+              << config.mix[0] << ":" << config.mix[1] << ":" << config.mix[2] << " payload=" << config.payload << "B "
+              << (config.rate > 0 ? "open-loop rate=" + std::to_string((long long)config.rate) + "/s"
+                                  : "closed-loop depth=" + std::to_string(config.depth))
+              << std::endl;
+    Clock::time_point measure_start = Clock::now() + std::chrono::duration_cast<Clock::duration>(
+                                                         std::chrono::duration<double>(config.warmup));
+    Clock::time_point end = measure_start + std::chrono::duration_cast<Clock::duration>(
+                                                std::chrono::duration<double>(config.duration));
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < config.threads; ++t) {
+        size_t first = conns.size() * t / config.threads;
+        size_t last = conns.size() * (t + 1) / config.threads;
+        workers.emplace_back(new Worker(conns, first, last, ids, t + 1));
+        threads.emplace_back(&Worker::run, workers.back().get(), measure_start, end);
+    }
+    for (auto& t : threads) t.join();
+    for (BenchConn& conn : conns) close(conn.fd);
+
+    // 3. 汇总
+    ThreadStats total;
+    for (auto& w : workers) {
+        for (int k = 0; k < KIND_COUNT; ++k) total.latency[k].merge(w->stats.latency[k]);
+        total.completed += w->stats.completed;
+        total.errors += w->stats.errors;
+        total.delivered += w->stats.delivered;
+        total.dropped += w->stats.dropped;
+    }
+    HdrHistogram all;
+    for (int k = 0; k < KIND_COUNT; ++k) all.merge(total.latency[k]);
+
+    std::cout << "throughput: " << std::fixed << std::setprecision(0) << total.completed / config.duration
+              << " req/s (" << total.completed << " requests in " << std::setprecision(1) << config.duration
+              << "s, " << total.errors << " errors, " << total.delivered << " messages delivered, "
+              << total.dropped << " connections dropped)" << std::endl;
+    std::cout << std::left << std::setw(8) << "latency" << std::right << std::setw(12) << "count"
+              << std::setw(11) << "p50(us)" << std::setw(11) << "p90(us)" << std::setw(11) << "p99(us)"
+              << std::setw(11) << "p99.9(us)" << std::setw(11) << "max(us)" << std::setw(11) << "mean(us)"
+              << std::endl;
+    print_row("all", all);
+    for (int k = 0; k < KIND_COUNT; ++k) {
+        if (config.mix[k] > 0) print_row(KIND_NAMES[k], total.latency[k]);
+    }
+    return total.dropped == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,110 @@
+// 离线消息日志写入吞吐量基准
+// 多个线程并发 append (模拟多个连接同时给离线用户发消息)，再按用户取出重放；
+// --durable 时每条消息都等到覆盖它的组提交完成 (wait_durable)，衡量组提交把多少次写入合并成一次 msync。
+// 用法：./log_bench [--dir DIR] [--threads N] [--messages N] [--size BYTES] [--users N] [--segment MB] [--durable]
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include "../message_log.h"
+
+struct BenchConfig {
+    std::string dir = "log_bench.data";
+    int threads = 4;
+    int messages = 200000;  // 每个线程
+    size_t size = 128;      // 消息 Body 字节数
+    int users = 1000;       // 接收者数量
+    size_t segment = 64;    // 分段大小 (MB)
+    bool durable = false;
+};
+
+BenchConfig config;
+
+void parse_args(int argc, char* argv[]) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--dir" && i + 1 < argc) {
+            config.dir = argv[++i];
+        } else if (arg == "--threads" && i + 1 < argc) {
+            config.threads = std::max(1, atoi(argv[++i]));
+        } else if (arg == "--messages" && i + 1 < argc) {
+            config.messages = std::max(1, atoi(argv[++i]));
+        } else if (arg == "--size" && i + 1 < argc) {
+            config.size = (size_t)std::max(0, atoi(argv[++i]));
+        } else if (arg == "--users" && i + 1 < argc) {
+            config.users = std::max(1, atoi(argv[++i]));
+        } else if (arg == "--segment" && i + 1 < argc) {
+            config.segment = (size_t)std::max(1, atoi(argv[++i]));
+        } else if (arg == "--durable") {
+            config.durable = true;
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [--dir DIR] [--threads N] [--messages N] [--size BYTES]"
+                      << " [--users N] [--segment MB] [--durable]" << std::endl;
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+double seconds_since(std::chrono::steady_clock::time_point begin) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+}
+
+int main(int argc, char* argv[]) {
+    parse_args(argc, argv);
+    MessageLog log;
+    std::string error;
+    if (!log.open(config.dir, config.segment * 1024 * 1024, error)) {
+        std::cerr << error << std::endl;
+        return 1;
+    }
+    size_t recovered = log.pending();
+
+    // 1. 并发追加
+    std::atomic<uint64_t> failed(0);
+    std::vector<std::thread> workers;
+    std::string body(config.size, 'x');
+    auto begin = std::chrono::steady_clock::now();
+    for (int t = 0; t < config.threads; ++t) {
+        workers.emplace_back([&, t]() {
+            for (int i = 0; i < config.messages; ++i) {
+                uint32_t user = (uint32_t)((t * config.messages + i) % config.users) + 1;
+                uint64_t seq = log.append(user, (uint32_t)t, 0, body);
+                if (seq == 0) {
+                    ++failed;
+                } else if (config.durable) {
+                    log.wait_durable(seq);
+                }
+            }
+        });
+    }
+    for (auto& w : workers) w.join();
+    double append_secs = seconds_since(begin);
+    uint64_t total = (uint64_t)config.threads * config.messages - failed;
+    uint64_t syncs = log.syncs();
+
+    // 2. 按用户重放 (与服务器一致，每批 256 条)
+    begin = std::chrono::steady_clock::now();
+    std::vector<MessageLog::Message> batch;
+    uint64_t replayed = 0;
+    for (int u = 1; u <= config.users; ++u) {
+        while (log.take_pending((uint32_t)u, batch, 256) > 0) {
+            replayed += batch.size();
+            batch.clear();
+        }
+    }
+    double replay_secs = seconds_since(begin);
+    log.close();
+
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "threads=" << config.threads << " size=" << config.size << " durable=" << (config.durable ? "yes" : "no")
+              << " recovered=" << recovered << " failed=" << failed << "\n";
+    std::cout << "append:  " << total / append_secs << " msg/s, "
+              << total * (sizeof(LogRecordHeader) + config.size) / append_secs / (1024 * 1024) << " MB/s\n";
+    std::cout << "syncs:   " << syncs << " (" << (syncs ? (double)total / syncs : 0.0) << " messages per sync)\n";
+    std::cout << "replay:  " << replayed / replay_secs << " msg/s" << std::endl;
+    return failed == 0 ? 0 : 1;
+}
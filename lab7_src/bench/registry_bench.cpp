@@ -0,0 +1,90 @@
+// 在线客户端表查找吞吐量微基准
+// 对比：全局 std::map + 单把互斥锁 (原实现) vs 分片的 ClientRegistry
+// 用法：./registry_bench [客户端数量] [每轮秒数]
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <cstdlib>
+#include "../client_registry.h"
+
+// 原实现：全局 map + 单把锁
+class GlobalMapRegistry {
+public:
+    void add(int id, const std::shared_ptr<Connection>& conn) {
+        std::lock_guard<std::mutex> lock(mtx_);
+        map_[id] = conn;
+    }
+    std::shared_ptr<Connection> find(int id) const {
+        std::lock_guard<std::mutex> lock(mtx_);
+        auto it = map_.find(id);
+        return it == map_.end() ? nullptr : it->second;
+    }
+private:
+    mutable std::mutex mtx_;
+    std::map<int, std::shared_ptr<Connection>> map_;
+};
+
+// 用 threads 个线程并发查找 seconds 秒，返回每秒查找次数
+template <typename Registry>
+double run_lookups(const Registry& registry, int clients, int threads, double seconds) {
+    std::atomic<bool> start(false), stop(false);
+    std::atomic<uint64_t> total(0);
+    std::vector<std::thread> workers;
+
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t]() {
+            std::mt19937 rng(t + 1);
+            std::uniform_int_distribution<int> dist(0, clients - 1);
+            uint64_t count = 0, hits = 0;
+            while (!start) std::this_thread::yield();
+            while (!stop) {
+                for (int i = 0; i < 1024; ++i) {
+                    if (registry.find(dist(rng))) ++hits;
+                }
+                count += 1024;
+            }
+            total += count;
+            if (hits == 0) std::cerr << "unexpected: no hits" << std::endl;
+        });
+    }
+
+    auto begin = std::chrono::steady_clock::now();
+    start = true;
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    stop = true;
+    for (auto& w : workers) w.join();
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    return total / elapsed;
+}
+
+int main(int argc, char* argv[]) {
+    int clients = argc > 1 ? atoi(argv[1]) : 10000;
+    double seconds = argc > 2 ? atof(argv[2]) : 1.0;
+    int max_threads = std::max(4u, std::thread::hardware_concurrency());
+
+    GlobalMapRegistry global_map;
+    ClientRegistry sharded;
+    for (int id = 0; id < clients; ++id) {
+        std::shared_ptr<Connection> conn = std::make_shared<Connection>(id, "127.0.0.1:" + std::to_string(id), false);
+        global_map.add(id, conn);
+        sharded.add(id, conn);
+    }
+
+    std::cout << "clients=" << clients << ", " << seconds << "s per run" << std::endl;
+    std::cout << std::left << std::setw(10) << "threads"
+              << std::setw(22) << "map+mutex (Mops/s)"
+              << std::setw(22) << "sharded (Mops/s)" << std::endl;
+    for (int threads = 1; threads <= max_threads; threads *= 2) {
+        double a = run_lookups(global_map, clients, threads, seconds) / 1e6;
+        double b = run_lookups(sharded, clients, threads, seconds) / 1e6;
+        std::cout << std::left << std::setw(10) << threads << std::fixed << std::setprecision(2)
+                  << std::setw(22) << a << std::setw(22) << b << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,304 @@
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <new>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <charconv>
+
+// === 缓冲池 ===
+// 热路径上的包缓冲 (共享转发包、批量响应、列表等临时字符串) 用完后不还给堆，
+// 而是连同已分配的容量放回当前线程的空闲链表，下次直接复用；
+// 稳态下收发消息不再产生堆分配。缓冲可以在一个线程取出、在另一个线程归还。
+
+// 分配计数：ALLOC_HEAP 由 server.cpp 中替换的全局 operator new 累加
+enum AllocCounter {
+    ALLOC_HEAP,       // 全局 operator new 调用次数
+    ALLOC_POOL_HIT,   // 从缓冲池取到现成的缓冲
+    ALLOC_POOL_MISS,  // 缓冲池为空，向堆申请
+    ALLOC_REQUESTS,   // 处理的请求包数 (用于计算每个请求的平均分配次数)
+    ALLOC_COUNTERS
+};
+
+// 每次分配、每次取缓冲都要计数，所有线程累加同一个原子变量会让那条缓存行在核之间来回争用。
+// 计数按线程分片：线程第一次计数时轮流领取一个分片 (独占一条缓存行)，之后只写自己的分片，读取时加总。
+// 不能像 metrics.h 那样为每个线程 new 一个计数块 (operator new 中再分配会递归)；
+// 线程数超过分片数时几个线程共用一个分片，因此仍用 fetch_add，但通常只有一个写者，没有争用。
+class AllocStats {
+public:
+    static constexpr unsigned SHARDS = 64;
+
+    void add(AllocCounter counter) { shards_[shard()].values[counter].fetch_add(1, std::memory_order_relaxed); }
+
+    uint64_t total(AllocCounter counter) const {
+        uint64_t sum = 0;
+        for (const Shard& shard : shards_) sum += shard.values[counter].load(std::memory_order_relaxed);
+        return sum;
+    }
+
+private:
+    struct alignas(64) Shard {
+        std::atomic<uint64_t> values[ALLOC_COUNTERS];
+    };
+
+    unsigned shard() {
+        static thread_local unsigned index = 0;  // 分片编号 + 1，0 表示尚未领取 (常量初始化，访问时没有初始化检查)
+        if (index == 0) index = next_.fetch_add(1, std::memory_order_relaxed) % SHARDS + 1;
+        return index - 1;
+    }
+
+    Shard shards_[SHARDS] = {};
+    std::atomic<unsigned> next_{0};
+};
+
+inline AllocStats alloc_stats;
+
+inline void count_stat(AllocCounter counter) {
+    alloc_stats.add(counter);
+}
+
+// 线程退出时线程本地的池先于其他对象析构，之后归还的缓冲直接释放
+inline thread_local bool pools_destroyed = false;
+
+// 线程本地空闲链表 + 全局中转站
+// 转发的包在发送者线程取出、在接收者线程归还，空闲对象会单向堆积到接收者一侧；
+// 本线程的空闲对象攒满后把一批交给中转站，本线程空了再从中转站取一批，中转站的锁按批摊销。
+template <typename T>
+class FreeListCache {
+public:
+    static constexpr size_t LOCAL_MAX = 256;   // 每个线程最多缓存的空闲对象数
+    static constexpr size_t TRANSFER = 64;     // 与中转站之间一次搬运的个数
+    static constexpr size_t DEPOT_MAX = 4096;  // 中转站容量，超出的对象直接释放
+
+    typedef void (*Destroy)(T*);
+
+    struct Depot {
+        std::mutex mtx;
+        std::vector<T*> items;
+        Depot() { items.reserve(DEPOT_MAX); }
+    };
+
+    FreeListCache(Depot& depot, Destroy destroy) : depot_(depot), destroy_(destroy) { local_.reserve(LOCAL_MAX); }
+
+    // 线程退出：空闲对象交给中转站 (线程模式下处理线程随连接频繁创建销毁)
+    ~FreeListCache() {
+        pools_destroyed = true;
+        give_back(local_.size());
+    }
+
+    FreeListCache(const FreeListCache&) = delete;
+    FreeListCache& operator=(const FreeListCache&) = delete;
+
+    // 取出一个空闲对象，没有时返回 nullptr
+    T* pop() {
+        if (local_.empty()) refill();
+        if (local_.empty()) return nullptr;
+        T* item = local_.back();
+        local_.pop_back();
+        return item;
+    }
+
+    void push(T* item) {
+        if (local_.size() >= LOCAL_MAX) give_back(TRANSFER);
+        local_.push_back(item);
+    }
+
+private:
+    void refill() {
+        std::lock_guard<std::mutex> lock(depot_.mtx);
+        size_t n = std::min(TRANSFER, depot_.items.size());
+        local_.insert(local_.end(), depot_.items.end() - n, depot_.items.end());
+        depot_.items.resize(depot_.items.size() - n);
+    }
+
+    void give_back(size_t n) {
+        std::lock_guard<std::mutex> lock(depot_.mtx);
+        for (; n > 0 && !local_.empty(); --n) {
+            T* item = local_.back();
+            local_.pop_back();
+            if (depot_.items.size() < DEPOT_MAX) {
+                depot_.items.push_back(item);
+            } else {
+                destroy_(item);
+            }
+        }
+    }
+
+    Depot& depot_;
+    Destroy destroy_;
+    std::vector<T*> local_;
+};
+
+// 字符串缓冲池
+class BufferPool {
+public:
+    static constexpr size_t MAX_CAPACITY = 64 * 1024;  // 容量更大的缓冲不缓存，避免大包长期占用内存
+
+    // 取出一个空缓冲 (保留上次使用时的容量)
+    static std::string* acquire() {
+        std::string* buf = pools_destroyed ? nullptr : cache().pop();
+        if (buf) {
+            count_stat(ALLOC_POOL_HIT);
+            return buf;
+        }
+        count_stat(ALLOC_POOL_MISS);
+        return new std::string();
+    }
+
+    static void release(std::string* buf) {
+        if (pools_destroyed || buf->capacity() > MAX_CAPACITY) {
+            delete buf;
+            return;
+        }
+        buf->clear();
+        cache().push(buf);
+    }
+
+private:
+    typedef FreeListCache<std::string> Cache;
+
+    static void destroy(std::string* buf) { delete buf; }
+
+    static Cache& cache() {
+        static Cache::Depot* depot = new Cache::Depot(); // 不析构：其他线程退出时可能仍在归还
+        thread_local Cache local(*depot, destroy);
+        return local;
+    }
+};
+
+// RAII 包装：作用域结束时把缓冲还给池
+class PooledBuffer {
+public:
+    PooledBuffer() : buf_(BufferPool::acquire()) {}
+    ~PooledBuffer() { BufferPool::release(buf_); }
+
+    PooledBuffer(const PooledBuffer&) = delete;
+    PooledBuffer& operator=(const PooledBuffer&) = delete;
+
+    std::string& operator*() { return *buf_; }
+    std::string* operator->() { return buf_; }
+    std::string* get() { return buf_; }
+
+private:
+    std::string* buf_;
+};
+
+// 小块内存池：固定大小的块，用于 shared_ptr 控制块等小对象
+class SlabPool {
+public:
+    static constexpr size_t BLOCK_SIZE = 64;  // 能放下控制块的块大小，更大的请求直接走堆
+
+    static void* allocate(size_t n) {
+        if (n > BLOCK_SIZE) return ::operator new(n);
+        Block* block = pools_destroyed ? nullptr : cache().pop();
+        if (block) {
+            count_stat(ALLOC_POOL_HIT);
+            return block;
+        }
+        count_stat(ALLOC_POOL_MISS);
+        return ::operator new(BLOCK_SIZE);
+    }
+
+    static void deallocate(void* p, size_t n) {
+        if (n > BLOCK_SIZE || pools_destroyed) {
+            ::operator delete(p);
+            return;
+        }
+        cache().push(static_cast<Block*>(p));
+    }
+
+private:
+    struct Block {
+        char data[BLOCK_SIZE];
+    };
+    typedef FreeListCache<Block> Cache;
+
+    static void destroy(Block* block) { ::operator delete(block); }
+
+    static Cache& cache() {
+        static Cache::Depot* depot = new Cache::Depot();
+        thread_local Cache local(*depot, destroy);
+        return local;
+    }
+};
+
+// 从 SlabPool 分配的标准分配器
+template <typename T>
+struct SlabAllocator {
+    typedef T value_type;
+
+    SlabAllocator() {}
+    template <typename U>
+    SlabAllocator(const SlabAllocator<U>&) {}
+
+    T* allocate(size_t n) { return static_cast<T*>(SlabPool::allocate(n * sizeof(T))); }
+    void deallocate(T* p, size_t n) { SlabPool::deallocate(p, n * sizeof(T)); }
+
+    template <typename U>
+    bool operator==(const SlabAllocator<U>&) const { return true; }
+    template <typename U>
+    bool operator!=(const SlabAllocator<U>&) const { return false; }
+};
+
+// 把整数追加到 out 末尾 (不经过 std::to_string 的临时字符串)
+inline void append_int(std::string& out, long long value) {
+    char buf[24];
+    std::to_chars_result res = std::to_chars(buf, buf + sizeof(buf), value);
+    out.append(buf, res.ptr - buf);
+}
+
+// 比较两个秘密值 (令牌、共享密钥)：逐字节比较全部内容，耗时与不相同的位置无关
+inline bool same_secret(std::string_view expected, std::string_view given) {
+    if (expected.size() != given.size()) return false;
+    unsigned char diff = 0;
+    for (size_t i = 0; i < given.size(); ++i) diff |= (unsigned char)(expected[i] ^ given[i]);
+    return diff == 0;
+}
+
+// 把 text 整体解析为整数 (允许前导空格)，格式错误或有多余字符时返回 false
+
+template <typename Int>
+inline bool parse_int(std::string_view text, Int& value) {
+    while (!text.empty() && text.front() == ' ') text.remove_prefix(1);
+    const char* end = text.data() + text.size();
+    std::from_chars_result res = std::from_chars(text.data(), end, value);
+    return res.ec == std::errc() && res.ptr == end;
+}
+
+// 在 "key1=value1;key2=value2" 形式的选项串中查找 key，并把值解析为整数
+template <typename Int>
+inline bool find_option(std::string_view options, std::string_view key, Int& value) {
+    size_t pos = 0;
+    while (pos < options.size()) {
+        size_t end = std::min(options.find(';', pos), options.size());
+        std::string_view item = options.substr(pos, end - pos);
+        size_t eq = item.find('=');
+        if (eq != std::string_view::npos && item.substr(0, eq) == key) return parse_int(item.substr(eq + 1), value);
+        pos = end + 1;
+    }
+    return false;
+}
+
+// 同上，取原始文本 (指向 options 内部，不拷贝)
+inline bool find_option(std::string_view options, std::string_view key, std::string_view& value) {
+    size_t pos = 0;
+    while (pos < options.size()) {
+        size_t end = std::min(options.find(';', pos), options.size());
+        std::string_view item = options.substr(pos, end - pos);
+        size_t eq = item.find('=');
+        if (eq != std::string_view::npos && item.substr(0, eq) == key) {
+            value = item.substr(eq + 1);
+            return true;
+        }
+        pos = end + 1;
+    }
+    return false;
+}
+
+#endif // BUFFER_POOL_H
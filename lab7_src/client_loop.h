@@ -0,0 +1,591 @@
+#ifndef CLIENT_LOOP_H
+#define CLIENT_LOOP_H
+
+// === 客户端库 ===
+// 一个 ClientLoop 线程用 poll 驱动任意多个 ClientConnection，请求可以在任意线程发起：
+//   - 回调：request(type, body, callback)，应答到达时在事件循环线程上调用 callback
+//   - future：call(type, body) 返回 std::future<Reply>
+//   - 批量：cork() / uncork() 之间的请求合并为一次写；batch() 把多个请求打包成一个 REQ_BATCH，一次往返
+// connect() 同步完成握手 (欢迎消息 + REQ_CONNECT 协商)，之后线路格式不再变化：
+// 协商到 FLAG_REQUEST_ID 时应答按请求 ID 匹配，否则按发送顺序匹配 (服务器对同一连接按请求顺序应答)。
+// 服务器转发的消息 (IND_RECV_MSG) 按发送者重组分片后交给 on_message，发送者放弃的分片消息 (IND_MSG_ABORT) 丢弃；
+// 服务器关闭通知 (IND_SHUTDOWN) 交给 on_shutdown。
+// 连接超过 ping_interval_ms 没有发出请求时事件循环自动发送 REQ_PING，避免被服务器的空闲超时断开。
+
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <string>
+#include <string_view>
+#include <memory>
+#include <future>
+#include <thread>
+#include <utility>
+#include <functional>
+#include <unordered_map>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "protocol.h"
+#include "frame_codec.h"
+#include "ring_queue.h"
+#include "timer_wheel.h"  // monotonic_ms
+
+// 一个应答 (连接断开时以 RES_ERROR "Disconnected." 结束所有未完成的请求)
+struct Reply {
+    uint32_t type = RES_ERROR;
+    std::string body;
+
+    bool ok() const { return type != RES_ERROR; }
+};
+
+typedef std::function<void(Reply&)> ReplyCallback;
+typedef std::function<void(std::vector<Reply>&)> BatchCallback;
+typedef std::function<void(int, const std::string&)> MessageCallback;  // (发送者 ID, 消息)
+typedef std::function<void()> CloseCallback;
+typedef std::function<void(int)> ShutdownCallback;  // (建议的重连等待毫秒数)
+
+struct ClientOptions {
+    // 请求的 v2 标志：请求 ID + 分片 + Body 校验和；0 表示保持 v1
+    uint8_t flags = FLAG_REQUEST_ID | FLAG_CONTINUATION | FLAG_CHECKSUM;
+    int handshake_timeout_ms = 5000;
+    int ping_interval_ms = 30000;  // 心跳间隔 (应小于服务器的 --idle-timeout)，0 表示不发送
+    std::string user;  // 注册的用户名：重连后 ID 不变，离线期间的消息在上线时重放；为空表示匿名 (以 fd 为 ID)
+    std::string token;  // 该用户名首次注册时服务器发放的令牌 (ClientConnection::token)，首次注册时留空
+    MessageCallback on_message;  // 在事件循环线程上调用 (握手期间到达的消息在 connect 的调用线程上调用)
+    CloseCallback on_close;      // 连接断开 (服务器关闭或调用了 close)，在事件循环线程上调用
+    ShutdownCallback on_shutdown;  // 服务器即将关闭，应在给定的毫秒数后重连 (与 on_message 在同一线程上调用)
+};
+
+class ClientLoop;
+
+class ClientConnection {
+public:
+    // 接收包的长度上限：服务器转发的分片远小于该值，超过说明包头已损坏
+    static constexpr uint32_t MAX_RECV_FRAME = 16 * 1024 * 1024;
+
+    ClientConnection(int fd, const ClientOptions& options)
+        : fd_(fd), options_(options), closed_(false), closing_(false), corked_(false), woff_(0), next_id_(1),
+          last_send_ms_(monotonic_ms()) {}
+
+    ~ClientConnection() {
+        if (fd_ >= 0) ::close(fd_);
+    }
+
+    ClientConnection(const ClientConnection&) = delete;
+    ClientConnection& operator=(const ClientConnection&) = delete;
+
+    bool connected() const { return !closed_ && !closing_; }
+    WireFormat wire() const { return wire_; }
+    // 服务器分配的用户 ID (ClientOptions::user 非空时)，0 表示匿名
+    uint32_t user_id() const { return user_id_; }
+    // 首次注册时服务器发放的令牌 (之后登录须放进 ClientOptions::token)，否则为空
+    const std::string& token() const { return token_; }
+    const std::string& welcome() const { return welcome_; }
+
+    // 发起一个请求：返回 true 时 callback 一定会被调用一次；连接已断开时返回 false，callback 不会被调用
+    bool request(uint32_t type, std::string_view body, ReplyCallback callback) {
+        std::lock_guard<std::mutex> lock(mtx_);
+        if (closed_ || closing_) return false;
+        enqueue(type, body, add_pending(std::move(callback)));
+        if (!corked_) flush_locked();  // 写出错时事件循环随后读到 EOF，以 "Disconnected." 结束该请求
+        return true;
+    }
+
+    std::future<Reply> call(uint32_t type, std::string_view body = std::string_view()) {
+        std::shared_ptr<std::promise<Reply>> promise = std::make_shared<std::promise<Reply>>();
+        std::future<Reply> future = promise->get_future();
+        if (!request(type, body, [promise](Reply& reply) { promise->set_value(std::move(reply)); })) {
+            Reply reply;
+            reply.body = "Disconnected.";
+            promise->set_value(std::move(reply));
+        }
+        return future;
+    }
+
+    // 点对点消息：协商了分片时，超过 FRAGMENT_SIZE 的消息拆成多个分片，
+    // 除最后一个外都带 FLAG_CONTINUATION；所有分片共用一个请求 ID，整条消息只有一个应答
+    bool send_message(int target_id, std::string_view msg, ReplyCallback callback) {
+        return send_message(std::to_string(target_id), msg, std::move(callback));
+    }
+
+    // 同上，目标为 ID 的文本形式或 "@用户名" (目标离线时由服务器存储，上线后重放)
+    bool send_message(std::string_view target, std::string_view msg, ReplyCallback callback) {
+        std::lock_guard<std::mutex> lock(mtx_);
+        if (closed_ || closing_) return false;
+        std::string prefix = std::string(target) + ":";
+        uint32_t id = add_pending(std::move(callback));
+        if (!(wire_.flags & FLAG_CONTINUATION) || msg.size() <= FRAGMENT_SIZE) {
+            enqueue(REQ_SEND_MSG, prefix + std::string(msg), id);
+        } else {
+            for (size_t pos = 0; pos < msg.size(); pos += FRAGMENT_SIZE) {
+                std::string chunk = (pos == 0 ? prefix : std::string()) + std::string(msg.substr(pos, FRAGMENT_SIZE));
+                bool more = pos + FRAGMENT_SIZE < msg.size();
+                enqueue(REQ_SEND_MSG, chunk, id, more ? FLAG_CONTINUATION : 0);
+            }
+        }
+        if (!corked_) flush_locked();
+        return true;
+    }
+
+    // 多个请求打包成一个 REQ_BATCH：callback 收到与请求一一对应的应答
+    // (服务器拒绝整个批次时只有一个 RES_ERROR)
+    bool batch(const std::vector<std::pair<uint32_t, std::string>>& requests, BatchCallback callback) {
+        std::string body;
+        for (const auto& req : requests) append_frame(body, req.first, req.second, wire_);
+        return request(REQ_BATCH, body, [callback](Reply& reply) {
+            std::vector<Reply> replies;
+            if (reply.type == RES_BATCH) {
+                size_t pos = 0;
+                Frame sub;
+                while (pos < reply.body.size() &&
+                       decode_frame(reply.body.data() + pos, reply.body.size() - pos, sub) == DECODE_FRAME) {
+                    replies.emplace_back();
+                    replies.back().type = sub.header.type;
+                    replies.back().body.assign(sub.body, sub.header.length);
+                    pos += sub.size();
+                }
+            } else {
+                replies.push_back(std::move(reply));
+            }
+            callback(replies);
+        });
+    }
+
+    // 开始合并：之后的请求只入队不发送
+    void cork() {
+        std::lock_guard<std::mutex> lock(mtx_);
+        corked_ = true;
+    }
+
+    // 结束合并：本批请求一次写出
+    bool uncork() {
+        std::lock_guard<std::mutex> lock(mtx_);
+        corked_ = false;
+        return !closed_ && flush_locked();
+    }
+
+    // 发送 REQ_EXIT，写出后关闭写方向；服务器断开后事件循环结束未完成的请求并调用 on_close
+    void close() {
+        std::lock_guard<std::mutex> lock(mtx_);
+        if (closed_ || closing_) return;
+        closing_ = true;
+        corked_ = false;
+        enqueue(REQ_EXIT, std::string_view(), 0);
+        flush_locked();
+    }
+
+private:
+    friend class ClientLoop;
+
+    // 登记一个等待应答的请求，返回其请求 ID (调用方持有 mtx_)
+    uint32_t add_pending(ReplyCallback callback) {
+        uint32_t id = next_id_++;
+        if (next_id_ == 0) next_id_ = 1;  // 0 表示没有请求 ID
+        if (wire_.flags & FLAG_REQUEST_ID) {
+            by_id_[id] = std::move(callback);
+        } else {
+            in_order_.push_back() = std::move(callback);
+        }
+        return id;
+    }
+
+    void enqueue(uint32_t type, std::string_view body, uint32_t id, uint8_t extra_flags = 0) {
+        append_frame(wbuf_, type, body, wire_, id, extra_flags);
+        last_send_ms_ = monotonic_ms();
+    }
+
+    // 到了心跳时刻就发送 REQ_PING (应答直接丢弃)；返回距下一次心跳的毫秒数，-1 表示不发送心跳 (事件循环线程)
+    int heartbeat(uint64_t now) {
+        if (options_.ping_interval_ms <= 0) return -1;
+        std::lock_guard<std::mutex> lock(mtx_);
+        if (closed_ || closing_) return -1;
+        uint64_t due = last_send_ms_ + options_.ping_interval_ms;
+        if (due > now) return (int)(due - now);
+        enqueue(REQ_PING, std::string_view(), add_pending(nullptr));
+        if (!corked_) flush_locked();
+        return options_.ping_interval_ms;
+    }
+
+    // 非阻塞地尽量写出；写不完的部分由事件循环等待可写后继续 (调用方持有 mtx_)
+    bool flush_locked() {
+        while (woff_ < wbuf_.size()) {
+            ssize_t n = send(fd_, wbuf_.data() + woff_, wbuf_.size() - woff_, SEND_FLAGS);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    if (wakeup_) wakeup_();  // 让事件循环关注可写
+                    return true;
+                }
+                return false;  // 出错：事件循环随后读到 EOF / 错误并清理
+            }
+            woff_ += n;
+        }
+        wbuf_.clear();
+        woff_ = 0;
+        if (closing_) shutdown(fd_, SHUT_WR);  // REQ_EXIT 已写出
+        return true;
+    }
+
+    bool want_write() {
+        std::lock_guard<std::mutex> lock(mtx_);
+        return woff_ < wbuf_.size();
+    }
+
+    void on_writable() {
+        std::lock_guard<std::mutex> lock(mtx_);
+        if (!closed_) flush_locked();
+    }
+
+    // 取出已到达的应答与消息并回调 (事件循环线程)；返回 false 表示连接已断开
+    bool on_readable() {
+        ssize_t n = rbuf_.read_from(fd_, 16 * 1024);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) return true;
+        return process_input() && n > 0;
+    }
+
+    // 解析读缓冲中所有完整的包 (握手时多读到的数据在加入事件循环后立即处理)
+    bool process_input() {
+        Frame frame;
+        DecodeStatus status = drain_frames(rbuf_, frame, MAX_RECV_FRAME, [this](const Frame& f, DecodeStatus s) {
+            Reply reply;
+            reply.type = f.header.type;
+            reply.body.assign(f.body, f.header.length);
+            if (s == DECODE_BAD_CHECKSUM) {
+                reply.type = RES_ERROR;
+                reply.body = "Checksum mismatch.";
+            }
+            dispatch(reply, f.request_id, (f.flags & FLAG_CONTINUATION) != 0);
+            return true;
+        });
+        return status == DECODE_NEED_MORE;  // 魔数错误或包过大：无法继续解析
+    }
+
+    void dispatch(Reply& reply, uint32_t id, bool more) {
+        // 1. 转发消息："SrcID|Message"，分片按发送者拼接
+        if (reply.type == IND_RECV_MSG && reply.ok()) {
+            size_t delim = reply.body.find('|');
+            if (delim == std::string::npos) return;
+            int src = atoi(reply.body.c_str());
+            if (more || partial_.count(src)) {
+                partial_[src].append(reply.body, delim + 1, std::string::npos);
+                if (more) return;
+                std::string msg = std::move(partial_[src]);
+                partial_.erase(src);
+                if (options_.on_message) options_.on_message(src, msg);
+            } else if (options_.on_message) {
+                options_.on_message(src, reply.body.substr(delim + 1));
+            }
+            return;
+        }
+        // 发送者放弃了分片消息："SrcID"，丢弃已收到的部分
+        if (reply.type == IND_MSG_ABORT) {
+            partial_.erase(atoi(reply.body.c_str()));
+            return;
+        }
+
+        // 2. 服务器关闭通知："drain_ms=N;retry_after_ms=M"，不对应任何请求
+        if (reply.type == IND_SHUTDOWN) {
+            size_t pos = reply.body.find("retry_after_ms=");
+            int retry_ms = pos == std::string::npos ? 0 : atoi(reply.body.c_str() + pos + 15);
+            if (options_.on_shutdown) options_.on_shutdown(retry_ms);
+            return;
+        }
+
+        // 3. 应答：找到对应的请求
+        ReplyCallback callback;
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            if (wire_.flags & FLAG_REQUEST_ID) {
+                auto it = by_id_.find(id);
+                if (it == by_id_.end()) return;
+                callback = std::move(it->second);
+                by_id_.erase(it);
+            } else {
+                if (in_order_.empty()) return;
+                callback = std::move(in_order_.front());
+                in_order_.front() = nullptr;
+                in_order_.pop_front();
+            }
+        }
+        if (callback) callback(reply);
+    }
+
+    // 连接断开：结束所有未完成的请求 (事件循环线程)
+    void finish() {
+        std::vector<ReplyCallback> pending;
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            closed_ = true;
+            ::close(fd_);
+            fd_ = -1;
+            for (auto& item : by_id_) pending.push_back(std::move(item.second));
+            by_id_.clear();
+            while (!in_order_.empty()) {
+                pending.push_back(std::move(in_order_.front()));
+                in_order_.front() = nullptr;
+                in_order_.pop_front();
+            }
+        }
+        for (ReplyCallback& callback : pending) {
+            Reply reply;
+            reply.body = "Disconnected.";
+            if (callback) callback(reply);
+        }
+        if (options_.on_close) options_.on_close();
+    }
+
+#ifdef MSG_NOSIGNAL
+    static constexpr int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+    static constexpr int SEND_FLAGS = 0;  // macOS：连接上设置了 SO_NOSIGPIPE
+#endif
+
+    int fd_;
+    ClientOptions options_;
+    WireFormat wire_;
+    uint32_t user_id_ = 0;
+    std::string token_;
+    std::string welcome_;
+    std::function<void()> wakeup_;  // 唤醒事件循环 (加入事件循环时设置)
+
+    // 由 mtx_ 保护：发送缓冲与等待应答的请求，任意线程都会访问
+    std::mutex mtx_;
+    std::atomic<bool> closed_;
+    std::atomic<bool> closing_;
+    bool corked_;
+    std::string wbuf_;
+    size_t woff_;
+    uint32_t next_id_;
+    uint64_t last_send_ms_;  // 最近一次发出请求的时刻 (单调时钟毫秒)
+    std::unordered_map<uint32_t, ReplyCallback> by_id_;  // 协商了请求 ID
+    RingQueue<ReplyCallback> in_order_;                   // 未协商请求 ID：按发送顺序
+
+    // 仅事件循环线程访问
+    RecvBuffer rbuf_;
+    std::map<int, std::string> partial_;  // 尚未收齐的分片消息 <发送者 ID, 已收到的内容>
+};
+
+class ClientLoop {
+public:
+    ClientLoop() : running_(true) {
+        if (pipe(wake_pipe_) < 0) {
+            perror("pipe");
+            wake_pipe_[0] = wake_pipe_[1] = -1;
+        } else {
+            fcntl(wake_pipe_[0], F_SETFL, O_NONBLOCK);
+            fcntl(wake_pipe_[1], F_SETFL, O_NONBLOCK);
+        }
+        thread_ = std::thread(&ClientLoop::run, this);
+    }
+
+    // 停止事件循环：未完成的请求以 "Disconnected." 结束
+    ~ClientLoop() {
+        running_ = false;
+        wake();
+        thread_.join();
+        for (auto& conn : conns_) conn->finish();
+        for (auto& conn : added_) conn->finish();
+        if (wake_pipe_[0] >= 0) ::close(wake_pipe_[0]);
+        if (wake_pipe_[1] >= 0) ::close(wake_pipe_[1]);
+    }
+
+    ClientLoop(const ClientLoop&) = delete;
+    ClientLoop& operator=(const ClientLoop&) = delete;
+
+    // 连接服务器并同步完成握手，成功后交给事件循环；失败时返回 nullptr 并填写 error
+    std::shared_ptr<ClientConnection> connect(const std::string& host, int port, const ClientOptions& options = ClientOptions(),
+                                              std::string* error = nullptr) {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0) return fail(error, "socket: " + std::string(strerror(errno)));
+        std::shared_ptr<ClientConnection> conn = std::make_shared<ClientConnection>(fd, options);
+
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        if (inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1) return fail(error, "Invalid address " + host);
+        if (::connect(fd, (sockaddr*)&addr, sizeof(addr)) < 0) return fail(error, "connect: " + std::string(strerror(errno)));
+
+        // 每个请求已合并为一次写，关闭 Nagle 避免与延迟 ACK 叠加
+        int opt = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+#ifdef SO_NOSIGPIPE
+        setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &opt, sizeof(opt));
+#endif
+        timeval tv;
+        tv.tv_sec = options.handshake_timeout_ms / 1000;
+        tv.tv_usec = (options.handshake_timeout_ms % 1000) * 1000;
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        std::string reason;
+        if (!handshake(*conn, options, reason)) return fail(error, reason);
+
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+        conn->wakeup_ = [this]() { wake(); };
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            added_.push_back(conn);
+        }
+        wake();
+        return conn;
+    }
+
+private:
+    static std::shared_ptr<ClientConnection> fail(std::string* error, const std::string& reason) {
+        if (error) *error = reason;
+        return nullptr;
+    }
+
+    // 阻塞读取一个完整的包
+    static bool read_frame(ClientConnection& conn, uint32_t& type, std::string& body, std::string& reason) {
+        Frame frame;
+        DecodeStatus status;
+        while ((status = decode_frame(conn.rbuf_, frame, ClientConnection::MAX_RECV_FRAME)) == DECODE_NEED_MORE) {
+            ssize_t n = conn.rbuf_.read_from(conn.fd_);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) {
+                reason = n == 0 ? "Server closed the connection." : "Handshake: " + std::string(strerror(errno));
+                return false;
+            }
+        }
+        if (status != DECODE_FRAME) {
+            reason = "Handshake: invalid frame from server.";
+            return false;
+        }
+        type = frame.header.type;
+        body.assign(frame.body, frame.header.length);
+        conn.rbuf_.consume(frame.size());
+        return true;
+    }
+
+    // 读欢迎消息，再用 REQ_CONNECT 协商 v2 并注册用户名 (旧服务器不认识 REQ_CONNECT，回复错误后继续使用 v1；
+    // 注册了用户名时错误应答视为握手失败)
+    static bool handshake(ClientConnection& conn, const ClientOptions& options, std::string& reason) {
+        uint32_t type;
+        std::string body;
+        if (!read_frame(conn, type, body, reason)) return false;
+        conn.welcome_ = body;
+        if (options.flags == 0 && options.user.empty()) return true;
+
+        std::string request;
+        std::string connect = "version=2;flags=" + std::to_string(options.flags);
+        if (!options.user.empty()) connect += ";user=" + options.user;
+        if (!options.user.empty() && !options.token.empty()) connect += ";token=" + options.token;
+        append_frame(request, REQ_CONNECT, connect);
+        if (send(conn.fd_, request.data(), request.size(), ClientConnection::SEND_FLAGS) != (ssize_t)request.size()) {
+            reason = "Handshake: " + std::string(strerror(errno));
+            return false;
+        }
+        while (read_frame(conn, type, body, reason)) {
+            if (type == IND_RECV_MSG || type == IND_SHUTDOWN) {
+                Reply msg;
+                msg.type = type;
+                msg.body = body;
+                conn.dispatch(msg, 0, false);  // 协商完成前使用 v1，转发的消息不会分片
+                continue;
+            }
+            // 应答 "version=N;flags=M[;id=UserID[;token=HEX]]"
+            if (type == RES_OK && body.compare(0, 8, "version=") == 0) {
+                int version = atoi(body.c_str() + 8);
+                size_t flags_pos = body.find("flags=");
+                int flags = flags_pos == std::string::npos ? 0 : atoi(body.c_str() + flags_pos + 6);
+                size_t id_pos = body.find(";id=");
+                if (id_pos != std::string::npos) conn.user_id_ = (uint32_t)strtoul(body.c_str() + id_pos + 4, nullptr, 10);
+                size_t token_pos = body.find(";token=");
+                if (token_pos != std::string::npos) conn.token_ = body.substr(token_pos + 7, body.find(';', token_pos + 7) - token_pos - 7);
+                conn.wire_ = WireFormat((uint8_t)version, (uint8_t)flags);
+            } else if (!options.user.empty()) {
+                reason = "Handshake: " + body;
+                return false;
+            }
+            return true;
+        }
+        return false;
+    }
+
+    void wake() {
+        char byte = 1;
+        ssize_t ret = write(wake_pipe_[1], &byte, 1);
+        (void)ret;
+    }
+
+    void run() {
+        std::vector<pollfd> fds;
+        while (running_) {
+            // 1. 收下新连接，处理握手时已读入的数据
+            {
+                std::lock_guard<std::mutex> lock(mtx_);
+                adding_.swap(added_);
+            }
+            for (auto& conn : adding_) {
+                if (conn->process_input()) {
+                    conns_.push_back(std::move(conn));
+                } else {
+                    conn->finish();
+                }
+            }
+            adding_.clear();
+
+            // 2. 发送到期的心跳，等待可读 / 可写，最多等到下一次心跳
+            int timeout = -1;
+            uint64_t now = monotonic_ms();
+            for (auto& conn : conns_) {
+                int wait = conn->heartbeat(now);
+                if (wait >= 0 && (timeout < 0 || wait < timeout)) timeout = wait;
+            }
+            fds.resize(conns_.size() + 1);
+            fds[0].fd = wake_pipe_[0];
+            fds[0].events = POLLIN;
+            for (size_t i = 0; i < conns_.size(); ++i) {
+                fds[i + 1].fd = conns_[i]->fd_;
+                fds[i + 1].events = POLLIN | (conns_[i]->want_write() ? POLLOUT : 0);
+            }
+            if (poll(fds.data(), fds.size(), timeout) < 0) {
+                if (errno == EINTR) continue;
+                perror("poll");
+                break;
+            }
+            if (fds[0].revents & POLLIN) {
+                char buf[256];
+                while (read(wake_pipe_[0], buf, sizeof(buf)) > 0) {}
+            }
+
+            // 3. 处理事件，移除已断开的连接
+            size_t kept = 0;
+            for (size_t i = 0; i < conns_.size(); ++i) {
+                std::shared_ptr<ClientConnection>& conn = conns_[i];
+                short revents = fds[i + 1].revents;
+                bool alive = true;
+                if (revents & POLLOUT) conn->on_writable();
+                if (revents & (POLLIN | POLLHUP | POLLERR)) alive = conn->on_readable();
+                if (alive) {
+                    if (kept != i) conns_[kept] = std::move(conn);
+                    ++kept;
+                } else {
+                    conn->finish();
+                }
+            }
+            conns_.resize(kept);
+        }
+    }
+
+    int wake_pipe_[2];
+    std::atomic<bool> running_;
+    std::thread thread_;
+    std::mutex mtx_;
+    std::vector<std::shared_ptr<ClientConnection>> added_;  // 等待加入事件循环的连接 (mtx_ 保护)
+    std::vector<std::shared_ptr<ClientConnection>> adding_;
+    std::vector<std::shared_ptr<ClientConnection>> conns_;  // 仅事件循环线程访问
+};
+
+#endif // CLIENT_LOOP_H
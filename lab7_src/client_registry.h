@@ -0,0 +1,268 @@
+#ifndef CLIENT_REGISTRY_H
+#define CLIENT_REGISTRY_H
+
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <unordered_map>
+#include "connection.h"
+#include "buffer_pool.h"
+
+// === 在线客户端表 ===
+// 按客户端 ID 分片的哈希表，每个分片一把锁，不同分片上的查找互不阻塞。
+// 查找返回连接的 shared_ptr 拷贝：锁只保护表本身，socket I/O 一律在锁外进行，
+// 一个慢接收者不会拖住其他客户端的查找。
+//
+// REQ_LIST 的在线列表作为带版本号的不可变快照发布：行按 ID 排序分成若干页，
+// 连接 / 断开时写者复制受影响的一页 (copy-on-write)，与其余页的指针一起组成新快照并原子替换；
+// 读者无锁取得当前快照，直接从各页拷贝所需的行，从不重建。
+
+// 在线列表的一页 (发布后不可变)：按 ID 排序的若干行 "ID\tAddress\n"
+struct ListPage {
+    std::vector<int> ids;
+    std::vector<size_t> rows;  // 每行在 text 中的起始偏移
+    std::string text;
+
+    size_t size() const { return ids.size(); }
+    // 第 begin 行到第 end 行 (不含) 的文本
+    std::string_view slice(size_t begin, size_t end) const {
+        size_t from = begin < rows.size() ? rows[begin] : text.size();
+        size_t to = end < rows.size() ? rows[end] : text.size();
+        return std::string_view(text).substr(from, to - from);
+    }
+
+    // 插入 (或替换) 一行
+    void insert(int id, const std::string& row) {
+        size_t pos = std::lower_bound(ids.begin(), ids.end(), id) - ids.begin();
+        if (pos < ids.size() && ids[pos] == id) erase_at(pos);
+        size_t offset = pos < rows.size() ? rows[pos] : text.size();
+        text.insert(offset, row);
+        for (size_t i = pos; i < rows.size(); ++i) rows[i] += row.size();
+        ids.insert(ids.begin() + pos, id);
+        rows.insert(rows.begin() + pos, offset);
+    }
+
+    // 删除一行，不存在时返回 false
+    bool erase(int id) {
+        size_t pos = std::lower_bound(ids.begin(), ids.end(), id) - ids.begin();
+        if (pos == ids.size() || ids[pos] != id) return false;
+        erase_at(pos);
+        return true;
+    }
+
+    // 第 begin 行到第 end 行 (不含) 组成的新页 (拆分过大的页)
+    std::shared_ptr<ListPage> part(size_t begin, size_t end) const {
+        std::shared_ptr<ListPage> page = std::make_shared<ListPage>();
+        page->ids.assign(ids.begin() + begin, ids.begin() + end);
+        page->text = slice(begin, end);
+        for (size_t i = begin; i < end; ++i) page->rows.push_back(rows[i] - rows[begin]);
+        return page;
+    }
+
+private:
+    void erase_at(size_t pos) {
+        size_t from = rows[pos];
+        size_t len = (pos + 1 < rows.size() ? rows[pos + 1] : text.size()) - from;
+        text.erase(from, len);
+        for (size_t i = pos + 1; i < rows.size(); ++i) rows[i] -= len;
+        ids.erase(ids.begin() + pos);
+        rows.erase(rows.begin() + pos);
+    }
+};
+
+// 在线列表快照 (不可变)：各页的指针 + 每页第一行的行号；未变的页在新旧快照之间共享
+struct ListSnapshot {
+    uint64_t version = 0;
+    std::vector<std::shared_ptr<const ListPage>> pages;
+    std::vector<size_t> first_row;
+    size_t rows = 0;
+    size_t bytes = 0;  // 全部行的文本长度
+
+    size_t row_count() const { return rows; }
+
+    // 把第 begin 行到第 end 行 (不含) 的文本追加到 out
+    void append_rows(std::string& out, size_t begin, size_t end) const {
+        end = std::min(end, rows);
+        if (begin >= end) return;
+        size_t page = std::upper_bound(first_row.begin(), first_row.end(), begin) - first_row.begin() - 1;
+        for (; begin < end; ++page) {
+            size_t to = std::min(end - first_row[page], pages[page]->size());
+            out.append(pages[page]->slice(begin - first_row[page], to));
+            begin = first_row[page] + to;
+        }
+    }
+};
+
+class ClientRegistry {
+public:
+    typedef std::shared_ptr<Connection> ConnPtr;
+    typedef std::vector<std::pair<int, ConnPtr>> Snapshot;
+
+    // shard_count 会向上取整为 2 的幂
+    explicit ClientRegistry(size_t shard_count = 16) {
+        size_t n = 1;
+        while (n < shard_count) n <<= 1;
+        mask_ = n - 1;
+        shards_.reset(new Shard[n]);
+        list_cache_ = std::make_shared<const ListSnapshot>();
+    }
+
+    ClientRegistry(const ClientRegistry&) = delete;
+    ClientRegistry& operator=(const ClientRegistry&) = delete;
+
+    // 变更日志保留的条数，更早的增量请求改发全表
+    static constexpr size_t LIST_LOG_CAPACITY = 1024;
+    // 每页的行数：超过两倍时拆成两页，删空时移除
+    static constexpr size_t LIST_PAGE_ROWS = 64;
+
+    void add(int id, const ConnPtr& conn) {
+        {
+            Shard& shard = shard_of(id);
+            std::lock_guard<std::mutex> lock(shard.mtx);
+            shard.map[id] = conn;
+        }
+        record_change(id, true, conn->addr);
+    }
+
+    // 仅当 id 对应的仍是 expected 时才移除 (fd 可能已被新连接复用)
+    bool remove(int id, const Connection* expected) {
+        {
+            Shard& shard = shard_of(id);
+            std::lock_guard<std::mutex> lock(shard.mtx);
+            auto it = shard.map.find(id);
+            if (it == shard.map.end() || it->second.get() != expected) return false;
+            shard.map.erase(it);
+        }
+        record_change(id, false, std::string());
+        return true;
+    }
+
+    ConnPtr find(int id) const {
+        Shard& shard = shard_of(id);
+        std::lock_guard<std::mutex> lock(shard.mtx);
+        auto it = shard.map.find(id);
+        return it == shard.map.end() ? nullptr : it->second;
+    }
+
+    // 按 ID 排序的全表快照 (逐个分片加锁拷贝)
+    Snapshot snapshot() const {
+        Snapshot result;
+        for (size_t i = 0; i <= mask_; ++i) {
+            std::lock_guard<std::mutex> lock(shards_[i].mtx);
+            result.insert(result.end(), shards_[i].map.begin(), shards_[i].map.end());
+        }
+        std::sort(result.begin(), result.end(),
+                  [](const std::pair<int, ConnPtr>& a, const std::pair<int, ConnPtr>& b) { return a.first < b.first; });
+        return result;
+    }
+
+    // 当前的在线列表快照 (无锁)
+    std::shared_ptr<const ListSnapshot> list_snapshot() const { return std::atomic_load(&list_cache_); }
+
+    // 把 since 版本之后的变更追加到 out ("+ID\tAddress\n" 或 "-ID\n")，version 返回当前版本
+    // 变更日志已不能覆盖 since 时返回 false，调用方应改发全表
+    bool changes_since(uint64_t since, std::string& out, uint64_t& version) const {
+        std::lock_guard<std::mutex> lock(list_mtx_);
+        version = list_cache_->version;
+        if (since > version) return false;
+        if (since < version && (log_.empty() || log_.front().version > since + 1)) return false;
+        for (const Change& change : log_) {
+            if (change.version <= since) continue;
+            if (change.added) {
+                out += '+';
+                out += change.row;
+            } else {
+                out += '-';
+                append_int(out, change.id);
+                out += '\n';
+            }
+        }
+        return true;
+    }
+
+private:
+    // 分片之间填充一个缓存行，避免不同分片的锁互相伪共享
+    struct Shard {
+        mutable std::mutex mtx;
+        std::unordered_map<int, ConnPtr> map;
+        char padding[64];
+    };
+
+    Shard& shard_of(int id) const { return shards_[(size_t)id & mask_]; }
+
+    // 在线列表的一次变更
+    struct Change {
+        uint64_t version;
+        bool added;
+        int id;
+        std::string row;  // 加入时的 "ID\tAddress\n"
+    };
+
+    // 更新在线列表：复制受影响的一页并修改，与其余页组成新快照后发布
+    void record_change(int id, bool added, const std::string& addr) {
+        std::string row;
+        if (added) {
+            append_int(row, id);
+            row += '\t';
+            row += addr;
+            row += '\n';
+        }
+        std::lock_guard<std::mutex> lock(list_mtx_);
+        const ListSnapshot& current = *list_cache_;
+        std::shared_ptr<ListSnapshot> next = std::make_shared<ListSnapshot>();
+        next->version = current.version + 1;
+        next->pages = current.pages;
+
+        // 1. 行所在的页：最后一个 ID 不小于 id 的第一页，都小于时为最后一页
+        size_t index = 0;
+        while (index + 1 < next->pages.size() && next->pages[index]->ids.back() < id) ++index;
+        if (added && next->pages.empty()) next->pages.push_back(std::make_shared<const ListPage>());
+
+        // 2. 复制该页后修改；过大时拆成两页，删空时移除
+        if (!next->pages.empty()) {
+            std::shared_ptr<ListPage> page = std::make_shared<ListPage>(*next->pages[index]);
+            if (added) {
+                page->insert(id, row);
+            } else {
+                page->erase(id);
+            }
+            if (page->size() > 2 * LIST_PAGE_ROWS) {
+                size_t half = page->size() / 2;
+                next->pages[index] = page->part(0, half);
+                next->pages.insert(next->pages.begin() + index + 1, page->part(half, page->size()));
+            } else if (page->size() == 0) {
+                next->pages.erase(next->pages.begin() + index);
+            } else {
+                next->pages[index] = page;
+            }
+        }
+
+        // 3. 行号与长度 (每页一次加法)
+        next->first_row.reserve(next->pages.size());
+        for (const auto& page : next->pages) {
+            next->first_row.push_back(next->rows);
+            next->rows += page->size();
+            next->bytes += page->text.size();
+        }
+
+        if (log_.size() >= LIST_LOG_CAPACITY) log_.pop_front();
+        log_.push_back(Change{next->version, added, id, row});
+        std::atomic_store(&list_cache_, std::shared_ptr<const ListSnapshot>(next));
+    }
+
+    size_t mask_;
+    std::unique_ptr<Shard[]> shards_;
+
+    // 在线列表：快照的替换与变更日志只在连接 / 断开时进行 (list_mtx_ 保护)
+    mutable std::mutex list_mtx_;
+    std::deque<Change> log_;                          // 最近的变更，按版本递增
+    std::shared_ptr<const ListSnapshot> list_cache_;  // 读者通过 std::atomic_load 访问
+};
+
+#endif // CLIENT_REGISTRY_H
@@ -0,0 +1,428 @@
+#ifndef CLUSTER_H
+#define CLUSTER_H
+
+#include <map>
+#include <set>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <unordered_map>
+#include <condition_variable>
+#include <cerrno>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <unistd.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "protocol.h"
+#include "buffer_pool.h"  // same_secret
+#include "frame_codec.h"
+#include "connection.h"
+#include "timer_wheel.h"  // monotonic_ms
+#include "logger.h"
+
+// === 集群：多个服务器实例之间转发消息 ===
+// 每个节点有一个编号 (1..MAX_NODE)，启动时列出其他节点的协议端口 (静态成员表)。
+//   - 节点之间的连接是单向的：每个节点为每个对端维护一条出向连接，只用于发送；对端的出向连接
+//     作为普通客户端连接到达本节点的协议端口，以 PEER_HELLO 表明身份后只用于接收
+//   - PEER_HELLO 带有所有节点共用的密钥，且连接的源地址须是该节点 --peer 主机名解析出的地址之一，
+//     否则在改动任何集群状态之前拒绝
+//   - 节点间的包使用 protocol.h 的 v1 包头；发送线程把排队期间积累的所有包一次写出 (批量)，
+//     断开后按退避间隔重连，重连后先同步用户目录与本节点在线用户的位置
+//   - 断开时没有写完的一批与之后排队的包中，转发的消息 (PEER_FORWARD) 保留到重连后重发 (写出一部分的那批
+//     整体重发，对端可能收到重复的消息)；目录与位置更新丢弃，由重连后的同步取代
+//   - 匿名客户端的 ID 中带有节点编号 ((节点 << NODE_SHIFT) | fd)，不需要查表即可定位；
+//     注册了用户名的客户端按位置表 (用户 ID -> 节点) 定位，位置表由各节点广播的上线 / 下线更新维护
+
+const int NODE_SHIFT = 20;                      // 匿名客户端 ID 中 fd 所占的位数
+const int NODE_FD_MASK = (1 << NODE_SHIFT) - 1;
+const int MAX_NODE = 255;                       // ID 保持在 USER_ID_BASE 以下
+
+// 出向连接在断开 / 队列积压超过该值时拒绝新的包 (发送者收到错误)
+const size_t PEER_QUEUE_LIMIT = 64 * 1024 * 1024;
+// 节点间的包比客户端请求多出的前缀长度上限 (目标与发送者 ID)，接收方的包长上限按此放宽
+const uint32_t PEER_FRAME_SLACK = 64;
+
+// 一条出向连接：独立线程阻塞地连接与发送，其他线程只把包追加到发送缓冲
+class PeerLink {
+public:
+    // 连接建立 (已发送 PEER_HELLO) 后在发送线程上调用，用于追加同步的包
+    typedef std::function<void(PeerLink&)> ConnectCallback;
+
+    PeerLink(int node, const std::string& host, int port, int self, const std::string& secret)
+        : node_(node), host_(host), port_(port), self_(self), secret_(secret), fd_(-1), up_(false), running_(false) {}
+
+    ~PeerLink() { stop(); }
+
+    PeerLink(const PeerLink&) = delete;
+    PeerLink& operator=(const PeerLink&) = delete;
+
+    int node() const { return node_; }
+    bool up() const { return up_; }
+
+    void start(ConnectCallback on_connect) {
+        on_connect_ = std::move(on_connect);
+        running_ = true;
+        thread_ = std::thread(&PeerLink::run, this);
+    }
+
+    // 停止发送线程：已在发送缓冲中的包尽量写完
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            if (!running_) return;
+            running_ = false;
+        }
+        cv_.notify_all();
+        thread_.join();
+    }
+
+    // 追加一个包 (任意线程调用)；连接未建立或积压过多时返回 false。
+    // while_down 为 true 时连接断开期间也排队，重连后发出 (用于对端已收到部分内容、必须送达的包)
+    bool send(uint32_t type, std::string_view body, bool while_down = false) {
+        std::lock_guard<std::mutex> lock(mtx_);
+        if ((!up_ && !while_down) || pending_.size() > PEER_QUEUE_LIMIT) return false;
+        bool was_empty = pending_.empty();
+        append_frame(pending_, type, body);
+        if (was_empty) cv_.notify_one();
+        return true;
+    }
+
+    // 排队未写出的字节数
+    size_t queued() {
+        std::lock_guard<std::mutex> lock(mtx_);
+        return pending_.size();
+    }
+
+private:
+    static constexpr int PING_INTERVAL_MS = 10000;  // 空闲时发送 REQ_PING，避免被对端的空闲超时断开
+    static constexpr int CHECK_INTERVAL_MS = 1000;  // 空闲时检查对端是否已关闭 (重启的节点尽快重连)
+    static constexpr int MAX_BACKOFF_MS = 2000;
+
+    // 1. 连接对端协议端口，读掉欢迎消息，发送 PEER_HELLO
+    bool connect_peer() {
+        addrinfo hints = {};
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo* res = nullptr;
+        if (getaddrinfo(host_.c_str(), std::to_string(port_).c_str(), &hints, &res) != 0 || !res) return false;
+        int fd = socket(res->ai_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        bool ok = fd >= 0 && ::connect(fd, res->ai_addr, res->ai_addrlen) == 0;
+        freeaddrinfo(res);
+        if (ok) {
+            set_nodelay(fd);
+            timeval tv = {5, 0};  // 握手与写都不应无限阻塞，对端停止读取时按断开处理
+            setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+            setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+            char header[sizeof(PacketHeader)];
+            PacketHeader welcome;
+            ok = recv(fd, header, sizeof(header), MSG_WAITALL) == (ssize_t)sizeof(header);
+            if (ok) {
+                memcpy(&welcome, header, sizeof(welcome));
+                welcome.network_to_host();
+                std::string body(std::min<uint32_t>(welcome.length, 4096), '\0');
+                ok = welcome.magic == MAGIC_LAB7 && welcome.type == RES_OK && welcome.length == body.size() &&
+                     recv(fd, &body[0], body.size(), MSG_WAITALL) == (ssize_t)body.size();
+            }
+            std::string hello;
+            append_frame(hello, PEER_HELLO, "node=" + std::to_string(self_) + ";secret=" + secret_);
+            ok = ok && write_all(fd, hello);
+        }
+        if (!ok) {
+            if (fd >= 0) close(fd);
+            return false;
+        }
+        fd_ = fd;
+        return true;
+    }
+
+    bool write_all(int fd, const std::string& data) {
+        size_t off = 0;
+        while (off < data.size()) {
+            ssize_t n = ::send(fd, data.data() + off, data.size() - off, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            off += n;
+        }
+        return true;
+    }
+
+    // 对端只会回复心跳应答 (或拒绝时的错误)，读掉丢弃；读到 EOF 说明对端已关闭
+    bool drain_input() {
+        char buf[4096];
+        while (true) {
+            ssize_t n = recv(fd_, buf, sizeof(buf), MSG_DONTWAIT);
+            if (n > 0) continue;
+            if (n == 0) return false;
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+        }
+    }
+
+    // 断开 (调用方持有 mtx_)：writing_ 与 pending_ 中转发的消息按原顺序留在 pending_，重连后重发；
+    // 其余的包 (目录与位置更新、心跳) 丢弃；返回保留的包数
+    size_t disconnect() {
+        up_ = false;
+        writing_ += pending_;
+        pending_.clear();
+        size_t off = 0, kept = 0;
+        while (off + sizeof(PacketHeader) <= writing_.size()) {
+            PacketHeader header;
+            memcpy(&header, writing_.data() + off, sizeof(header));
+            header.network_to_host();
+            size_t size = sizeof(header) + header.length;
+            if (header.type == PEER_FORWARD) {
+                pending_.append(writing_, off, size);
+                ++kept;
+            }
+            off += size;
+        }
+        writing_.clear();
+        if (fd_ >= 0) close(fd_);
+        fd_ = -1;
+        return kept;
+    }
+
+    void run() {
+        int backoff = 100;
+        std::unique_lock<std::mutex> lock(mtx_);
+        while (running_) {
+            // 2. 未连接：按退避间隔重试
+            if (fd_ < 0) {
+                lock.unlock();
+                bool ok = connect_peer();
+                lock.lock();
+                if (!ok) {
+                    cv_.wait_for(lock, std::chrono::milliseconds(backoff), [this]() { return !running_; });
+                    backoff = std::min(backoff * 2, MAX_BACKOFF_MS);
+                    continue;
+                }
+                backoff = 100;
+                up_ = true;
+                last_send_ms_ = monotonic_ms();
+                lock.unlock();
+                log_info("Cluster link to node ", node_, " (", host_, ":", port_, ") is up.");
+                if (on_connect_) on_connect_(*this);
+                lock.lock();
+            }
+
+            // 3. 等待新的包；空闲时检查对端是否已关闭，到心跳时刻发送 REQ_PING
+            cv_.wait_for(lock, std::chrono::milliseconds(CHECK_INTERVAL_MS),
+                         [this]() { return !pending_.empty() || !running_; });
+            if (!running_) break;
+            if (pending_.empty() && monotonic_ms() - last_send_ms_ >= (uint64_t)PING_INTERVAL_MS) {
+                append_frame(pending_, REQ_PING, "");
+            }
+
+            // 4. 把积累的包一次写出
+            writing_.swap(pending_);
+            lock.unlock();
+            bool alive = drain_input();
+            bool ok = alive && write_all(fd_, writing_);
+            lock.lock();
+            if (!ok) {
+                const char* reason = alive ? strerror(errno) : "closed by peer";
+                size_t kept = disconnect();
+                log_warn("Cluster link to node ", node_, " lost (", reason, "), ", kept, " forwarded message(s) kept for resending.");
+                continue;
+            }
+            if (!writing_.empty()) last_send_ms_ = monotonic_ms();
+            writing_.clear();
+            if (writing_.capacity() > PEER_QUEUE_LIMIT) std::string().swap(writing_);
+        }
+
+        // 5. 停止：已排队的包尽量写完
+        if (fd_ >= 0 && !pending_.empty()) write_all(fd_, pending_);
+        pending_.clear();
+        lock.unlock();
+        if (fd_ >= 0) close(fd_);
+        fd_ = -1;
+        up_ = false;
+    }
+
+    int node_;
+    std::string host_;
+    int port_;
+    int self_;
+    std::string secret_;
+    int fd_;  // 仅发送线程访问
+    std::atomic<bool> up_;
+    bool running_;
+    ConnectCallback on_connect_;
+    std::thread thread_;
+    std::mutex mtx_;
+    std::condition_variable cv_;
+    std::string pending_;  // 待写出的包 (在 mtx_ 下追加)
+    std::string writing_;  // 正在写出的一批 (仅发送线程访问)
+    uint64_t last_send_ms_ = 0;
+};
+
+// 集群状态：节点编号、出向连接、入向连接与用户位置表
+class Cluster {
+public:
+    Cluster() : self_(0) {}
+
+    bool enabled() const { return self_ != 0; }
+    int self() const { return self_; }
+    void set_self(int node) { self_ = node; }
+
+    // 所有节点共用的密钥 (在 add_peer 之前设置)；不能含 ';' 与空白，以便放进 PEER_HELLO 的选项串
+    static bool valid_secret(std::string_view secret) {
+        if (secret.empty()) return false;
+        for (char c : secret) {
+            if (c == ';' || isspace((unsigned char)c) || !isprint((unsigned char)c)) return false;
+        }
+        return true;
+    }
+
+    void set_secret(const std::string& secret) { secret_ = secret; }
+
+    // 登记对端并解析其主机名，得到允许的源地址 (启动前调用)；解析失败时填写 error
+    bool add_peer(int node, const std::string& host, int port, std::string& error) {
+        addrinfo hints = {};
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo* res = nullptr;
+        int ret = getaddrinfo(host.c_str(), nullptr, &hints, &res);
+        if (ret != 0) {
+            error = "resolve " + host + ": " + gai_strerror(ret);
+            return false;
+        }
+        for (addrinfo* ai = res; ai; ai = ai->ai_next) {
+            char ip[INET_ADDRSTRLEN];
+            inet_ntop(AF_INET, &((sockaddr_in*)ai->ai_addr)->sin_addr, ip, sizeof(ip));
+            addresses_[node].insert(ip);
+        }
+        freeaddrinfo(res);
+        links_[node].reset(new PeerLink(node, host, port, self_, secret_));
+        return true;
+    }
+
+    bool is_peer(int node) const { return links_.count(node) > 0; }
+
+    // PEER_HELLO 的身份检查：node 是已登记的对端，ip 是它的地址之一，密钥相同
+    bool authenticate(int node, std::string_view ip, std::string_view secret) const {
+        auto it = addresses_.find(node);
+        return it != addresses_.end() && it->second.count(std::string(ip)) > 0 && same_secret(secret_, secret);
+    }
+
+    void start(PeerLink::ConnectCallback on_connect) {
+        for (auto& link : links_) link.second->start(on_connect);
+    }
+
+    void stop() {
+        for (auto& link : links_) link.second->stop();
+    }
+
+    // 发往某个节点，节点未知、未连接 (while_down 见 PeerLink::send) 或积压过多时返回 false
+    bool send(int node, uint32_t type, std::string_view body, bool while_down = false) {
+        auto it = links_.find(node);
+        return it != links_.end() && it->second->send(type, body, while_down);
+    }
+
+    // 发往所有已连接的节点，返回发出的节点数
+    size_t send_all(uint32_t type, std::string_view body) {
+        size_t sent = 0;
+        for (auto& link : links_) {
+            if (link.second->send(type, body)) ++sent;
+        }
+        return sent;
+    }
+
+    const std::map<int, std::unique_ptr<PeerLink>>& links() const { return links_; }
+
+    // 匿名客户端 ID 与所在节点 / 本地 fd 之间的换算 (未启用集群时 ID 就是 fd)
+    int client_key(int fd) const { return (self_ << NODE_SHIFT) | fd; }
+    int node_of(int id) const { return id >> NODE_SHIFT; }
+    int local_fd(int id) const { return id & NODE_FD_MASK; }
+
+    // 入向连接：对端的出向连接以 PEER_HELLO 登记；同一节点重连时替换旧连接
+    void add_inbound(int node, const std::shared_ptr<Connection>& conn) {
+        std::lock_guard<std::mutex> lock(mtx_);
+        inbound_[node] = conn;
+    }
+
+    bool remove_inbound(int node, const Connection* expected) {
+        std::lock_guard<std::mutex> lock(mtx_);
+        auto it = inbound_.find(node);
+        if (it == inbound_.end() || it->second.get() != expected) return false;
+        inbound_.erase(it);
+        return true;
+    }
+
+    std::vector<std::shared_ptr<Connection>> inbound() {
+        std::vector<std::shared_ptr<Connection>> result;
+        std::lock_guard<std::mutex> lock(mtx_);
+        for (const auto& item : inbound_) result.push_back(item.second);
+        return result;
+    }
+
+    // 位置表：在其他节点上在线的用户
+    void set_location(uint32_t user, int node) {
+        std::lock_guard<std::mutex> lock(mtx_);
+        locations_[user] = node;
+    }
+
+    // 只在仍登记在 node 上时删除 (用户可能已在另一个节点上线，两个节点的更新先后到达)
+    void clear_location(uint32_t user, int node) {
+        std::lock_guard<std::mutex> lock(mtx_);
+        auto it = locations_.find(user);
+        if (it != locations_.end() && it->second == node) locations_.erase(it);
+    }
+
+    // 用户所在的节点，不在其他节点上在线时返回 0
+    int location(uint32_t user) {
+        std::lock_guard<std::mutex> lock(mtx_);
+        auto it = locations_.find(user);
+        return it == locations_.end() ? 0 : it->second;
+    }
+
+    // 同一用户换了 ID (用户目录合并冲突) 时迁移位置
+    void rename_location(uint32_t from, uint32_t to) {
+        std::lock_guard<std::mutex> lock(mtx_);
+        auto it = locations_.find(from);
+        if (it == locations_.end()) return;
+        locations_[to] = it->second;
+        locations_.erase(from);
+    }
+
+    // 节点的入向连接断开：该节点上的用户都视为离线
+    size_t drop_node(int node) {
+        std::lock_guard<std::mutex> lock(mtx_);
+        size_t dropped = 0;
+        for (auto it = locations_.begin(); it != locations_.end();) {
+            if (it->second == node) {
+                it = locations_.erase(it);
+                ++dropped;
+            } else {
+                ++it;
+            }
+        }
+        return dropped;
+    }
+
+    size_t remote_users() {
+        std::lock_guard<std::mutex> lock(mtx_);
+        return locations_.size();
+    }
+
+private:
+    int self_;
+    std::string secret_;
+    std::map<int, std::unique_ptr<PeerLink>> links_;  // 启动后不再修改
+    std::map<int, std::set<std::string>> addresses_;  // 节点 -> 允许的源 IP (启动后不再修改)
+    std::mutex mtx_;
+    std::map<int, std::shared_ptr<Connection>> inbound_;
+    std::unordered_map<uint32_t, int> locations_;
+};
+
+#endif // CLUSTER_H
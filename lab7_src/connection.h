@@ -0,0 +1,224 @@
+#ifndef CONNECTION_H
+#define CONNECTION_H
+
+#include <string>
+#include <string_view>
+#include <memory>
+#include <mutex>
+#include <functional>
+#include <atomic>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "protocol.h"
+#include "frame_codec.h"
+#include "output_queue.h"
+#include "mailbox.h"
+#include "http_codec.h"
+#include "metrics.h"
+#include "timer_wheel.h"
+#include "rate_limit.h"
+
+// 发送队列积压超过该值时暂停从邮箱取消息，让邮箱的容量上限生效
+const size_t OUTPUT_HIGH_WATERMARK = 256 * 1024;
+// 每次从邮箱取出的消息数
+const size_t MAIL_BATCH = 64;
+
+// === 连接对象：线程模式与 Reactor 模式共用 ===
+// 线程模式下 socket 为阻塞的，flush 会一直写到缓冲区清空；
+// Reactor 模式下 socket 为非阻塞的，写不完的数据留在发送队列中，等待 EPOLLOUT 再继续。
+struct Connection {
+    int fd;
+    std::string addr;          // "IP:Port"
+    bool nonblocking;
+    bool async_send;           // 发送由事件循环异步提交 (io_uring)，flush 只入队不写 socket
+
+    // 读缓冲：仅由拥有该连接的线程访问，无需加锁
+    RecvBuffer rbuf;
+
+    // 发送队列：其他连接转发消息时也会写入，必须持有 out_mtx
+    std::mutex out_mtx;
+    OutputQueue out;
+    bool corked;               // 正在批量处理请求：应答只入队，批次结束时统一 flush
+    std::atomic<bool> closed;  // 已关闭：fd 可能已被复用，禁止再写 (在 out_mtx 下置位)
+    bool close_after_flush;    // 写完后关闭 (HTTP 应答)
+    size_t staged;             // 已从发送队列取走、尚未发出的字节数 (io_uring 暂存区，在 out_mtx 下修改)
+    std::atomic<bool> notice_sent;  // 已投递服务器关闭通知
+
+    // 线路格式：REQ_CONNECT 协商后由拥有者线程修改，转发者在其他线程读取
+    std::atomic<uint16_t> wire_bits;
+
+    WireFormat wire() const {
+        uint16_t bits = wire_bits.load(std::memory_order_relaxed);
+        return WireFormat(bits >> 8, bits & 0xFF);
+    }
+    void set_wire(const WireFormat& wire) {
+        wire_bits.store((uint16_t)((wire.version << 8) | wire.flags), std::memory_order_relaxed);
+    }
+
+    // 转发邮箱：其他连接只入队，由拥有者线程取出发送
+    Mailbox mailbox;
+    std::function<void()> notify_mail;  // 邮箱由空变为非空时调用，唤醒拥有者线程
+
+    // 正在转发的分片消息 (REQ_SEND_MSG + FLAG_CONTINUATION)：仅由拥有者线程访问
+    bool streaming;                        // 已收到首个分片，尚未收到最后一个
+    bool stream_failed;                    // 已向发送者报告错误，丢弃剩余分片
+    std::weak_ptr<Connection> stream_target;
+    uint32_t stream_user;                  // 目标离线、分片正写入消息日志时为目标的用户 ID，否则为 0
+    int stream_node;                       // 目标在其他节点上时为该节点编号 (集群)，否则为 0
+    uint32_t stream_remote;                // 同上，目标的 ID
+
+    // 集群节点间的入向连接：对端节点编号 (收到 PEER_HELLO 后设置，仅由拥有者线程访问)，0 表示普通客户端
+    int peer_node;
+
+    // 稳定身份：REQ_CONNECT 中注册的用户 ID (见 user_directory.h)，0 表示匿名 (以 fd 为 ID)；仅由拥有者线程修改
+    uint32_t user_id;
+
+    // 嗅探到 HTTP 后切换为 HTTP 连接，请求由 HttpParser 增量解析：仅由拥有者线程访问
+    std::unique_ptr<HttpParser> http;
+
+    // 超时管理：仅由拥有者线程访问
+    uint64_t last_read_ms;      // 最近一次收到数据的时刻 (单调时钟毫秒)
+    uint64_t partial_since_ms;  // 读缓冲中开始残留不完整请求的时刻，0 表示没有
+    TimerNode timer;            // 事件循环时间轮中的节点 (owner 指向本连接)
+
+    // 按请求类型限流 (下标同 metric_type_name)：仅由拥有者线程访问
+    TokenBucket buckets[METRIC_MSG_TYPES];
+
+    // 保护 fd 的有效性：close 与其他线程的 shutdown 互斥 (不能用 out_mtx，拥有者可能正阻塞在写上)
+    std::mutex fd_mtx;
+
+    Connection(int sock, const std::string& address, bool nb, size_t mailbox_capacity = 1024)
+        : fd(sock), addr(address), nonblocking(nb), async_send(false), corked(false), closed(false), close_after_flush(false),
+          staged(0), notice_sent(false), wire_bits(1 << 8), mailbox(mailbox_capacity), streaming(false), stream_failed(false),
+          stream_user(0), stream_node(0), stream_remote(0), peer_node(0), user_id(0), last_read_ms(monotonic_ms()), partial_since_ms(0) {
+        timer.owner = this;
+    }
+};
+
+// 收到校验和错误的包时更新分片状态：REQ_SEND_MSG 的分片，或正在接收分片消息时到达的包，
+// 都按该消息的一个分片处理——整条消息失败，之后的分片丢弃到最后一个为止 (与转发出错相同)。
+// 返回是否需要向发送者报告错误：一条消息只报告一次
+inline bool corrupt_fragment(Connection& conn, uint32_t type, uint8_t flags) {
+    if (type != REQ_SEND_MSG && !conn.streaming) return true;
+    bool reported = conn.streaming && conn.stream_failed;
+    conn.streaming = (flags & FLAG_CONTINUATION) != 0;
+    conn.stream_failed = conn.streaming;
+    return !reported;
+}
+
+// 设置 socket 为非阻塞
+inline bool set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags < 0) return false;
+    return fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+// 关闭 Nagle 算法：应答已在发送队列中合并，不需要内核再攒包
+inline void set_nodelay(int fd) {
+    int opt = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+}
+
+// 尽量写出发送队列 (调用方必须持有 out_mtx)
+// 返回 false 表示连接出错；非阻塞 socket 遇到 EAGAIN 时返回 true，剩余数据保留
+inline bool flush_locked(Connection& conn) {
+    if (conn.closed) return false;
+    if (conn.async_send) return true;
+    return conn.out.flush(conn.fd) != FLUSH_ERROR;
+}
+
+// 辅助函数：发送协议包 (加入连接的发送队列；未处于批处理中则立即发送)
+// 包头按连接协商的线路格式生成，request_id 非 0 时回显给 v2 客户端
+inline bool send_packet(Connection& conn, uint32_t type, std::string_view body, uint32_t request_id = 0) {
+    std::lock_guard<std::mutex> lock(conn.out_mtx);
+    if (conn.closed) return false;
+    conn.out.push_frame(type, body, conn.wire(), request_id);
+    return conn.corked || flush_locked(conn);
+}
+
+// 开始批处理：之后的应答只入队不发送
+inline void cork(Connection& conn) {
+    std::lock_guard<std::mutex> lock(conn.out_mtx);
+    conn.corked = true;
+}
+
+// 结束批处理：把本批次积累的所有应答合并发出
+inline bool uncork(Connection& conn) {
+    std::lock_guard<std::mutex> lock(conn.out_mtx);
+    conn.corked = false;
+    return flush_locked(conn);
+}
+
+// 从其他线程断开连接：只 shutdown 不 close，由拥有者线程读到 EOF 后完成清理
+inline void kick_connection(Connection& conn) {
+    std::lock_guard<std::mutex> lock(conn.fd_mtx);
+    if (!conn.closed) shutdown(conn.fd, SHUT_RDWR);
+}
+
+// 投递结果 (与 metrics.h 中 forward 的前四个下标一一对应)
+enum MailResult {
+    MAIL_OK,           // 已入队
+    MAIL_REJECTED,     // 邮箱已满，发送者应稍后重试
+    MAIL_DROPPED,      // 邮箱已满，消息被丢弃
+    MAIL_DISCONNECTED  // 邮箱已满，接收者已被断开
+};
+
+// 向目标连接的邮箱投递一条消息 (任意线程调用，不做 socket 写操作)
+inline MailResult post_mail(Connection& target, const SharedFrame& frame, OverflowPolicy policy) {
+    bool was_empty = false;
+    MailResult result = MAIL_OK;
+    if (!target.mailbox.push(Mail(frame), was_empty)) {
+        result = MAIL_REJECTED;
+        if (policy == OVERFLOW_DROP) result = MAIL_DROPPED;
+        if (policy == OVERFLOW_DISCONNECT) {
+            kick_connection(target);
+            result = MAIL_DISCONNECTED;
+        }
+    } else if (was_empty && target.notify_mail) {
+        target.notify_mail();
+    }
+    thread_metrics().forward[result].add();
+    return result;
+}
+
+// 投递服务器关闭通知：不受邮箱容量限制，排在已入队的转发消息之后；每个连接只投递一次
+inline void post_notice(Connection& target, const SharedFrame& frame) {
+    if (target.notice_sent.exchange(true)) return;
+    bool was_empty = false;
+    target.mailbox.push(Mail(frame), was_empty, true);
+    if (was_empty && target.notify_mail) target.notify_mail();
+}
+
+// 邮箱、发送队列 (以及 io_uring 暂存区) 都已清空 (任意线程调用)
+// 邮箱在 out_mtx 下移入发送队列，同一把锁下检查三者不会漏掉正在搬运的消息；
+// 线程模式下拥有者可能持锁阻塞在写上，取不到锁时视为尚未清空，不等待
+inline bool output_drained(Connection& conn) {
+    std::unique_lock<std::mutex> lock(conn.out_mtx, std::try_to_lock);
+    if (!lock.owns_lock()) return false;
+    return conn.closed || (conn.out.empty() && conn.staged == 0 && conn.mailbox.size() == 0);
+}
+
+// 把邮箱中的消息移入发送队列并发送 (仅由拥有者线程调用)
+// 发送队列积压过多时停止，剩余消息留在邮箱中，等 socket 可写后再继续
+inline bool deliver_mail(Connection& conn) {
+    thread_local std::vector<Mail> batch; // 线程本地复用，不必每次分配
+    std::lock_guard<std::mutex> lock(conn.out_mtx);
+    bool ok = true;
+    while (!conn.closed && conn.out.pending_bytes() < OUTPUT_HIGH_WATERMARK) {
+        batch.clear();
+        if (conn.mailbox.drain(batch, MAIL_BATCH) == 0) break;
+        for (const Mail& mail : batch) conn.out.push_shared(mail);
+        if (!conn.corked && !flush_locked(conn)) {
+            ok = false;
+            break;
+        }
+    }
+    batch.clear();
+    return ok && !conn.closed;
+}
+
+#endif // CONNECTION_H
@@ -0,0 +1,88 @@
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+// === CRC32C (Castagnoli) ===
+// x86-64 上使用 SSE4.2 的 crc32 指令 (运行时检测 CPU 是否支持)，
+// ARMv8 上使用 CRC 扩展指令，其他平台退回查表实现。三者结果一致。
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+
+// 查表实现 (多项式 0x1EDC6F41 的反射形式 0x82F63B78)
+inline uint32_t crc32c_sw(uint32_t crc, const char* data, size_t len) {
+    struct Table {
+        uint32_t entries[256];
+        Table() {
+            for (uint32_t i = 0; i < 256; ++i) {
+                uint32_t c = i;
+                for (int k = 0; k < 8; ++k) c = (c >> 1) ^ (0x82F63B78u & (0u - (c & 1)));
+                entries[i] = c;
+            }
+        }
+    };
+    static const Table table;
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < len; ++i) crc = table.entries[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+    return crc;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2")))
+inline uint32_t crc32c_hw(uint32_t crc, const char* data, size_t len) {
+    uint64_t c = crc;
+    while (len >= 8) {
+        uint64_t v;
+        memcpy(&v, data, 8);
+        c = _mm_crc32_u64(c, v);
+        data += 8;
+        len -= 8;
+    }
+    uint32_t c32 = (uint32_t)c;
+    while (len > 0) {
+        c32 = _mm_crc32_u8(c32, (unsigned char)*data++);
+        --len;
+    }
+    return c32;
+}
+
+inline bool crc32c_hw_available() {
+    static const bool available = __builtin_cpu_supports("sse4.2");
+    return available;
+}
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+inline uint32_t crc32c_hw(uint32_t crc, const char* data, size_t len) {
+    while (len >= 8) {
+        uint64_t v;
+        memcpy(&v, data, 8);
+        crc = __crc32cd(crc, v);
+        data += 8;
+        len -= 8;
+    }
+    while (len > 0) {
+        crc = __crc32cb(crc, (unsigned char)*data++);
+        --len;
+    }
+    return crc;
+}
+
+inline bool crc32c_hw_available() { return true; }
+#else
+inline uint32_t crc32c_hw(uint32_t crc, const char* data, size_t len) { return crc32c_sw(crc, data, len); }
+inline bool crc32c_hw_available() { return false; }
+#endif
+
+// 计算 data 的 CRC32C
+inline uint32_t crc32c(const char* data, size_t len) {
+    uint32_t crc = 0xFFFFFFFFu;
+    crc = crc32c_hw_available() ? crc32c_hw(crc, data, len) : crc32c_sw(crc, data, len);
+    return crc ^ 0xFFFFFFFFu;
+}
+
+#endif // CRC32C_H
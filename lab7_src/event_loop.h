@@ -0,0 +1,210 @@
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+// === Reactor 事件循环 (仅 Linux，基于 epoll 边沿触发) ===
+// 每个 EventLoop 由一个线程运行，负责若干连接的读写事件；
+// 所有连接在 EventLoop 中以 EPOLLIN | EPOLLOUT | EPOLLET 注册一次，之后不再修改，
+// 读事件需要读到 EAGAIN 为止，写事件只在 socket 从"不可写"变为"可写"时到达。
+// 连接的超时由事件循环自己的时间轮管理：epoll_wait 最多等到下一个刻度，醒来后推进时间轮。
+
+#ifdef __linux__
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <functional>
+#include <cstdio>
+#include <cstdint>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include "connection.h"
+
+class EventLoop {
+public:
+    typedef std::function<void(const std::shared_ptr<Connection>&)> Callback;
+
+    Callback on_readable;  // 有数据可读 / 对端关闭 / 出错
+    Callback on_writable;  // socket 重新变为可写
+    Callback on_mail;      // 连接的邮箱收到新消息 (由 post 触发)
+    Callback on_timeout;   // 连接已过 deadline_of 给出的时刻，应关闭
+
+    // 连接的下一个超时时刻 (单调时钟毫秒)，0 表示不需要定时器；为空时不管理超时
+    std::function<uint64_t(Connection&)> deadline_of;
+
+    EventLoop() : running_(true) {
+        epfd_ = epoll_create1(EPOLL_CLOEXEC);
+        wakeup_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (epfd_ < 0 || wakeup_fd_ < 0) {
+            perror("epoll_create1/eventfd");
+            return;
+        }
+        // data.ptr == nullptr 表示唤醒事件
+        epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.ptr = nullptr;
+        epoll_ctl(epfd_, EPOLL_CTL_ADD, wakeup_fd_, &ev);
+    }
+
+    ~EventLoop() {
+        if (wakeup_fd_ >= 0) close(wakeup_fd_);
+        if (epfd_ >= 0) close(epfd_);
+    }
+
+    EventLoop(const EventLoop&) = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+
+    // 加入一个非阻塞连接 (可由 accept 线程调用)
+    bool add(const std::shared_ptr<Connection>& conn) {
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            conns_[conn.get()] = conn;
+        }
+        epoll_event ev;
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        ev.data.ptr = conn.get();
+        if (epoll_ctl(epfd_, EPOLL_CTL_ADD, conn->fd, &ev) < 0) {
+            perror("epoll_ctl add");
+            std::lock_guard<std::mutex> lock(mtx_);
+            conns_.erase(conn.get());
+            return false;
+        }
+        if (deadline_of) post(conn.get());  // 时间轮只由事件循环线程访问，由 run_posted 加入
+        return true;
+    }
+
+    // 移除连接 (必须在 close(fd) 之前调用，否则 fd 可能已被复用)
+    void remove(Connection& conn) {
+        epoll_ctl(epfd_, EPOLL_CTL_DEL, conn.fd, nullptr);
+        timers_.cancel(conn.timer);
+        std::lock_guard<std::mutex> lock(mtx_);
+        conns_.erase(&conn);
+    }
+
+    // 通知事件循环处理该连接的邮箱 (任意线程调用)
+    void post(Connection* conn) {
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            posted_.push_back(conn);
+        }
+        wakeup();
+    }
+
+    // 事件循环主体，直到 stop() 被调用
+    void run() {
+        std::vector<epoll_event> events(256);
+        while (running_) {
+            int n = epoll_wait(epfd_, events.data(), (int)events.size(), timers_.next_timeout_ms(monotonic_ms()));
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                perror("epoll_wait");
+                break;
+            }
+            expire_timers();
+            for (int i = 0; i < n; ++i) {
+                if (events[i].data.ptr == nullptr) {
+                    uint64_t v;
+                    while (read(wakeup_fd_, &v, sizeof(v)) > 0) {}
+                    run_posted();
+                    continue;
+                }
+                std::shared_ptr<Connection> conn = find(static_cast<Connection*>(events[i].data.ptr));
+                if (!conn) continue;
+
+                uint32_t ev = events[i].events;
+                if (ev & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+                    if (on_readable) on_readable(conn);
+                    refresh_timer(*conn);
+                }
+                if (ev & EPOLLOUT) {
+                    if (on_writable) on_writable(conn);
+                }
+            }
+        }
+    }
+
+    // 通知事件循环退出 (线程安全)
+    void stop() {
+        running_ = false;
+        wakeup();
+    }
+
+    // 当前持有的连接 (用于关闭时统一清理)
+    std::vector<std::shared_ptr<Connection>> connections() {
+        std::vector<std::shared_ptr<Connection>> result;
+        std::lock_guard<std::mutex> lock(mtx_);
+        for (const auto& item : conns_) result.push_back(item.second);
+        return result;
+    }
+
+private:
+    void wakeup() {
+        uint64_t one = 1;
+        ssize_t ret = write(wakeup_fd_, &one, sizeof(one));
+        (void)ret;
+    }
+
+    // 处理其他线程投递过来的连接 (已移除的连接直接跳过)
+    // 两个数组交换使用，各自保留容量
+    void run_posted() {
+        std::vector<Connection*>& posted = draining_;
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            posted.swap(posted_);
+        }
+        for (Connection* ptr : posted) {
+            std::shared_ptr<Connection> conn = find(ptr);
+            if (!conn) continue;
+            refresh_timer(*conn);
+            if (on_mail) on_mail(conn);
+        }
+        posted.clear();
+    }
+
+    // 超时时刻提前 (例如开始残留不完整的请求) 或尚未加入时间轮时设置定时器；
+    // 推迟的情况 (收到新数据) 不移动节点，到期时再重新计算
+    void refresh_timer(Connection& conn) {
+        if (!deadline_of || conn.closed) return;
+        uint64_t deadline = deadline_of(conn);
+        if (deadline && (!conn.timer.linked() || deadline < timers_.expires_ms(conn.timer))) timers_.schedule(conn.timer, deadline);
+    }
+
+    // 推进时间轮：到期的连接重新计算超时时刻，确实超时的交给 on_timeout
+    void expire_timers() {
+        if (timers_.empty()) return;
+        uint64_t now = monotonic_ms();
+        timers_.advance(now, [this, now](TimerNode& node) {
+            std::shared_ptr<Connection> conn = find(static_cast<Connection*>(node.owner));
+            if (!conn) return;
+            uint64_t deadline = deadline_of(*conn);
+            if (deadline == 0) return;
+            if (deadline > now) {
+                timers_.schedule(node, deadline);
+            } else if (on_timeout) {
+                on_timeout(conn);
+            }
+        });
+    }
+
+    std::shared_ptr<Connection> find(Connection* ptr) {
+        std::lock_guard<std::mutex> lock(mtx_);
+        auto it = conns_.find(ptr);
+        if (it == conns_.end()) return nullptr;
+        return it->second;
+    }
+
+    int epfd_;
+    int wakeup_fd_;
+    std::atomic<bool> running_;
+    std::mutex mtx_;
+    std::map<Connection*, std::shared_ptr<Connection>> conns_;  // 已注册的连接 (按地址索引，避免解引用已释放的指针)
+    std::vector<Connection*> posted_;                           // 待处理邮箱的连接
+    std::vector<Connection*> draining_;                         // 正在处理的连接 (仅事件循环线程访问)
+    TimerWheel timers_;                                         // 连接的超时 (仅事件循环线程访问)
+};
+
+#endif // __linux__
+
+#endif // EVENT_LOOP_H
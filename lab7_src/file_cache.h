@@ -0,0 +1,312 @@
+#ifndef FILE_CACHE_H
+#define FILE_CACHE_H
+
+#include <string>
+#include <string_view>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <unordered_map>
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+#include "crc32c.h"
+#include "http_codec.h"
+#include "output_queue.h"
+#include "mailbox.h"
+
+// === 静态文件缓存 ===
+// HTTP 静态资源第一次访问时整个读入内存，按 (HTTP 版本, 是否保持连接) 预先拼好应答头部，
+// 之后命中时把共享的头部与 Body 先后放进发送队列 (push_shared，不拷贝)，一次 writev 写出，不再读盘。
+// Body 只存一份 (头部不与 Body 拼在一起)，缓存占用的内存与 bytes() 统计的一致。
+// ETag 由内容的 CRC32C 与长度组成，请求带 If-None-Match 且匹配时回复 304。
+// 文件所在的目录加入 inotify 监视，文件被修改、替换或删除时由后台线程移除对应的条目，下次访问重新加载；
+// inotify 不可用时 (非 Linux，或监视数达到上限) 每次命中用 stat 比较修改时间与大小。
+
+struct CachedFile {
+    std::string path;
+    std::string body;
+    std::string etag;          // 带引号，例如 "5f3c2a1b-b335"
+    const char* content_type;
+    off_t size;
+    struct timespec mtime;
+    bool watched;              // 所在目录由 inotify 监视，命中时不必 stat
+
+    // 200 应答的头部：下标为 (HTTP/1.0 ? 2 : 0) + (保持连接 ? 1 : 0)，第一次用到时生成
+    // 通过 std::atomic_load / atomic_store 访问，并发生成时后到的一份被丢弃
+    mutable SharedFrame heads[4];
+
+    SharedFrame head(const std::string& version, bool keep_alive) const {
+        bool http10 = version == "HTTP/1.0";
+        SharedFrame& slot = heads[(http10 ? 2 : 0) + (keep_alive ? 1 : 0)];
+        SharedFrame frame = std::atomic_load(&slot);
+        if (frame) return frame;
+        std::string text;
+        append_http_head(text, version, 200, content_type, body.size(), keep_alive, "ETag: " + etag + "\r\n");
+        frame = std::make_shared<const std::string>(std::move(text));
+        std::atomic_store(&slot, frame);
+        return frame;
+    }
+};
+
+// 条目的 Body 作为共享包 (别名 shared_ptr：引用计数记在条目上，发送队列持有期间条目不会释放)
+inline SharedFrame cached_body(const std::shared_ptr<const CachedFile>& entry) {
+    return SharedFrame(entry, &entry->body);
+}
+
+// If-None-Match 中是否有与 etag 匹配的标签 ("*" 匹配任何标签，弱比较忽略 W/ 前缀)
+inline bool etag_matches(const std::string* if_none_match, const std::string& etag) {
+    if (!if_none_match) return false;
+    std::string_view rest(*if_none_match);
+    while (!rest.empty()) {
+        size_t comma = rest.find(',');
+        std::string_view tag = rest.substr(0, comma);
+        while (!tag.empty() && (tag.front() == ' ' || tag.front() == '\t')) tag.remove_prefix(1);
+        while (!tag.empty() && (tag.back() == ' ' || tag.back() == '\t')) tag.remove_suffix(1);
+        if (tag.substr(0, 2) == "W/") tag.remove_prefix(2);
+        if (tag == "*" || tag == etag) return true;
+        if (comma == std::string_view::npos) break;
+        rest.remove_prefix(comma + 1);
+    }
+    return false;
+}
+
+class FileCache {
+public:
+    static const size_t DEFAULT_CAPACITY = 64 * 1024 * 1024;  // 缓存的 Body 总字节数上限
+    static const size_t MAX_FILE = 4 * 1024 * 1024;           // 超过该大小的文件不缓存 (仍走 sendfile)
+
+    FileCache() : capacity_(DEFAULT_CAPACITY), bytes_(0), generation_(0), inotify_fd_(-1) {}
+
+    ~FileCache() { stop(); }
+
+    // capacity 为 0 表示关闭缓存
+    void set_capacity(size_t capacity) { capacity_ = capacity; }
+    bool enabled() const { return capacity_ > 0; }
+
+    // 启动 inotify 监视线程；失败时缓存仍可用，命中时改为 stat 校验
+    void start() {
+#ifdef __linux__
+        if (!enabled()) return;
+        inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (inotify_fd_ < 0) {
+            perror("inotify_init1");
+            return;
+        }
+        watcher_ = std::thread(&FileCache::run, this);
+#endif
+    }
+
+    void stop() {
+        if (watcher_.joinable()) {
+            stopping_ = true;
+            waker_.notify();
+            watcher_.join();
+        }
+        if (inotify_fd_ >= 0) {
+            close(inotify_fd_);
+            inotify_fd_ = -1;
+        }
+    }
+
+    // 取文件的缓存条目，未缓存时加载；文件不存在、不是普通文件或过大时返回 nullptr (调用方退回 sendfile)
+    // hit 表示命中了已有的条目
+    std::shared_ptr<const CachedFile> get(const std::string& path, bool& hit) {
+        hit = false;
+        if (!enabled()) return nullptr;
+        std::shared_ptr<const CachedFile> entry;
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            auto it = entries_.find(path);
+            if (it != entries_.end()) entry = it->second;
+        }
+        if (entry && (entry->watched || still_fresh(*entry))) {
+            hit = true;
+            return entry;
+        }
+        return load(path);
+    }
+
+    size_t bytes() const { return bytes_.load(std::memory_order_relaxed); }
+
+    size_t entries() {
+        std::lock_guard<std::mutex> lock(mtx_);
+        return entries_.size();
+    }
+
+private:
+    static std::string dir_of(const std::string& path) {
+        size_t slash = path.rfind('/');
+        return slash == std::string::npos ? "." : path.substr(0, slash);
+    }
+
+    static bool same_mtime(const struct timespec& a, const struct timespec& b) {
+        return a.tv_sec == b.tv_sec && a.tv_nsec == b.tv_nsec;
+    }
+
+    static struct timespec mtime_of(const struct stat& st) {
+#ifdef __APPLE__
+        return st.st_mtimespec;
+#else
+        return st.st_mtim;
+#endif
+    }
+
+    static bool still_fresh(const CachedFile& entry) {
+        struct stat st;
+        return stat(entry.path.c_str(), &st) == 0 && st.st_size == entry.size && same_mtime(mtime_of(st), entry.mtime);
+    }
+
+    // 读入整个文件并 (容量允许时) 放进缓存
+    std::shared_ptr<const CachedFile> load(const std::string& path) {
+        // 1. 先监视目录再读文件：读的过程中发生的修改一定会产生事件；
+        //    期间有任何失效事件 (generation 变化) 时本次读到的内容只用于这一次应答，不放进缓存
+        bool watched = watch_dir(dir_of(path));
+        uint64_t generation = generation_.load(std::memory_order_acquire);
+
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC | O_NONBLOCK);  // FIFO 等不会阻塞在 open 上，随后被拒绝
+        if (fd < 0) return nullptr;
+        struct stat st;
+        if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || (size_t)st.st_size > MAX_FILE) {
+            close(fd);
+            return nullptr;
+        }
+        std::shared_ptr<CachedFile> entry = std::make_shared<CachedFile>();
+        entry->body.resize(st.st_size);
+        size_t got = 0;
+        while (got < entry->body.size()) {
+            ssize_t n = read(fd, &entry->body[got], entry->body.size() - got);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+            got += n;
+        }
+        close(fd);
+        if (got != entry->body.size()) return nullptr;  // 读取期间被截断
+
+        entry->path = path;
+        entry->size = st.st_size;
+        entry->mtime = mtime_of(st);
+        entry->content_type = http_content_type(path);
+        entry->watched = watched;
+        char etag[32];
+        snprintf(etag, sizeof(etag), "\"%08x-%llx\"", crc32c(entry->body.data(), entry->body.size()),
+                 (unsigned long long)entry->body.size());
+        entry->etag = etag;
+
+        // 2. 容量不足时不缓存，仍用这份内容应答
+        std::lock_guard<std::mutex> lock(mtx_);
+        if (generation_.load(std::memory_order_relaxed) != generation) return entry;
+        auto it = entries_.find(path);
+        size_t old_size = it == entries_.end() ? 0 : it->second->body.size();
+        if (bytes_ - old_size + entry->body.size() > capacity_) return entry;
+        bytes_ += entry->body.size() - old_size;
+        entries_[path] = entry;
+        return entry;
+    }
+
+    // 监视文件所在的目录 (而不是文件本身：编辑器常用 "写临时文件再 rename" 的方式替换文件)
+    bool watch_dir(const std::string& dir) {
+#ifdef __linux__
+        if (inotify_fd_ < 0) return false;
+        std::lock_guard<std::mutex> lock(mtx_);
+        if (dirs_.count(dir)) return true;
+        int wd = inotify_add_watch(inotify_fd_, dir.c_str(),
+                                   IN_CLOSE_WRITE | IN_MODIFY | IN_ATTRIB | IN_CREATE | IN_DELETE | IN_MOVED_FROM |
+                                       IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF);
+        if (wd < 0) return false;
+        dirs_[dir] = wd;
+        watches_[wd] = dir;
+        return true;
+#else
+        (void)dir;
+        return false;
+#endif
+    }
+
+    // 移除条目 (调用方持有 mtx_)；prefix 为目录时移除该目录下的所有条目
+    void invalidate_locked(const std::string& path, bool whole_dir) {
+        generation_.fetch_add(1, std::memory_order_release);
+        if (!whole_dir) {
+            auto it = entries_.find(path);
+            if (it == entries_.end()) return;
+            bytes_ -= it->second->body.size();
+            entries_.erase(it);
+            return;
+        }
+        std::string prefix = path + "/";
+        for (auto it = entries_.begin(); it != entries_.end();) {
+            if (it->first.compare(0, prefix.size(), prefix) == 0 && it->first.find('/', prefix.size()) == std::string::npos) {
+                bytes_ -= it->second->body.size();
+                it = entries_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+#ifdef __linux__
+    // 后台线程：读取 inotify 事件，移除被修改的文件对应的条目
+    void run() {
+        alignas(struct inotify_event) char buf[16 * 1024];
+        while (!stopping_) {
+            struct pollfd fds[2];
+            fds[0].fd = inotify_fd_;
+            fds[0].events = POLLIN;
+            fds[1].fd = waker_.fd();
+            fds[1].events = POLLIN;
+            if (poll(fds, 2, -1) < 0 && errno != EINTR) break;
+            if (!(fds[0].revents & POLLIN)) continue;
+
+            ssize_t n;
+            while ((n = read(inotify_fd_, buf, sizeof(buf))) > 0) {
+                std::lock_guard<std::mutex> lock(mtx_);
+                for (char* p = buf; p < buf + n;) {
+                    const struct inotify_event* event = reinterpret_cast<const struct inotify_event*>(p);
+                    p += sizeof(struct inotify_event) + event->len;
+                    if (event->mask & IN_Q_OVERFLOW) {
+                        // 事件丢失：整个缓存作废
+                        generation_.fetch_add(1, std::memory_order_release);
+                        entries_.clear();
+                        bytes_ = 0;
+                        continue;
+                    }
+                    auto it = watches_.find(event->wd);
+                    if (it == watches_.end()) continue;
+                    if (event->len > 0) {
+                        invalidate_locked(it->second + "/" + event->name, false);
+                    } else if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) {
+                        // 目录本身被删除或移走：其中的条目全部作废，之后访问时重新监视
+                        invalidate_locked(it->second, true);
+                        if (event->mask & IN_IGNORED) {
+                            dirs_.erase(it->second);
+                            watches_.erase(it);
+                        }
+                    }
+                }
+            }
+        }
+    }
+#endif
+
+    size_t capacity_;
+    std::atomic<size_t> bytes_;
+    std::atomic<uint64_t> generation_;  // 每次失效加一
+    std::mutex mtx_;
+    std::unordered_map<std::string, std::shared_ptr<const CachedFile>> entries_;
+    std::unordered_map<std::string, int> dirs_;   // 已监视的目录 -> watch descriptor
+    std::unordered_map<int, std::string> watches_;
+
+    int inotify_fd_;
+    Waker waker_;
+    std::atomic<bool> stopping_{false};
+    std::thread watcher_;
+};
+
+#endif // FILE_CACHE_H
@@ -0,0 +1,224 @@
+#ifndef FRAME_CODEC_H
+#define FRAME_CODEC_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cstddef>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include "protocol.h"
+#include "crc32c.h"
+
+// === 接收缓冲 ===
+// 连接独占、反复复用的缓冲区：[read_pos_, write_pos_) 为尚未解析的数据。
+// 读指针追上写指针时两者归零；尾部空间不足时先把未解析数据搬到头部，仍不够再扩容。
+// 这样缓冲区像环形缓冲一样循环使用，同时保证每个包在内存中连续，解析时无需拷贝拼接。
+class RecvBuffer {
+public:
+    explicit RecvBuffer(size_t initial_capacity = 4096)
+        : buf_(initial_capacity), read_pos_(0), write_pos_(0) {}
+
+    const char* data() const { return buf_.data() + read_pos_; }
+    size_t size() const { return write_pos_ - read_pos_; }
+    bool empty() const { return read_pos_ == write_pos_; }
+
+    // 丢弃已解析的 n 字节
+    void consume(size_t n) {
+        read_pos_ += n;
+        if (read_pos_ >= write_pos_) read_pos_ = write_pos_ = 0;
+    }
+
+    void clear() { read_pos_ = write_pos_ = 0; }
+
+    // 保证尾部至少有 n 字节可写
+    void ensure_writable(size_t n) {
+        if (buf_.size() - write_pos_ >= n) return;
+        size_t pending = size();
+        if (read_pos_ > 0) {
+            memmove(buf_.data(), buf_.data() + read_pos_, pending);
+            read_pos_ = 0;
+            write_pos_ = pending;
+        }
+        if (buf_.size() - write_pos_ < n) {
+            buf_.resize(std::max(buf_.size() * 2, write_pos_ + n));
+        }
+    }
+
+    // 一次 recv 读入当前可用的所有数据 (最多填满剩余空间)
+    // 返回值与 recv 相同：>0 读到的字节数，0 对端关闭，<0 出错 (errno 有效)
+    ssize_t read_from(int fd, size_t min_space = 4096) {
+        ensure_writable(min_space);
+        ssize_t n = recv(fd, buf_.data() + write_pos_, buf_.size() - write_pos_, 0);
+        if (n > 0) write_pos_ += n;
+        return n;
+    }
+
+    // 追加已由其他途径收到的数据 (io_uring 的 provided buffer)
+    void append(const char* data, size_t len) {
+        ensure_writable(len);
+        memcpy(buf_.data() + write_pos_, data, len);
+        write_pos_ += len;
+    }
+
+private:
+    std::vector<char> buf_;
+    size_t read_pos_;
+    size_t write_pos_;
+};
+
+// 连接的线路格式：v1，或协商后的 v2 及双方同意的标志
+struct WireFormat {
+    uint8_t version;
+    uint8_t flags;
+
+    WireFormat(uint8_t v = 1, uint8_t f = 0) : version(v), flags(f) {}
+};
+
+// 序列化 v1 包头 (网络字节序)
+inline void encode_header(char* out, uint32_t type, uint32_t length) {
+    PacketHeader header;
+    header.magic = MAGIC_LAB7;
+    header.type = type;
+    header.length = length;
+    header.host_to_network(); // 序列化
+    memcpy(out, &header, HEADER_SIZE);
+}
+
+// 序列化 v2 包头；flags 含 FLAG_CHECKSUM 时计算 body 的 CRC32C
+inline void encode_header_v2(char* out, uint32_t type, const char* body, uint32_t length,
+                             uint8_t flags, uint32_t request_id) {
+    PacketHeaderV2 header;
+    header.magic = MAGIC_LAB7_V2;
+    header.type = type;
+    header.length = length;
+    header.version = PROTOCOL_VERSION;
+    header.flags = flags;
+    header.reserved = 0;
+    header.request_id = (flags & FLAG_REQUEST_ID) ? request_id : 0;
+    header.checksum = (flags & FLAG_CHECKSUM) ? crc32c(body, length) : 0;
+    header.host_to_network(); // 序列化
+    memcpy(out, &header, HEADER_V2_SIZE);
+}
+
+// 按连接的线路格式序列化包头，返回包头长度 (out 至少 MAX_HEADER_SIZE 字节)
+// v2 连接上：协商了校验和则总是带校验和；request_id 非 0 时带上请求 ID；
+// extra_flags 为分片等逐包标志，同样只保留对端协商过的部分
+inline size_t encode_header_for(char* out, const WireFormat& wire, uint32_t type, const char* body, uint32_t length,
+                                uint32_t request_id = 0, uint8_t extra_flags = 0) {
+    if (wire.version < 2) {
+        encode_header(out, type, length);
+        return HEADER_SIZE;
+    }
+    uint8_t flags = (extra_flags | FLAG_CHECKSUM) & wire.flags;
+    if (request_id != 0 && (wire.flags & FLAG_REQUEST_ID)) flags |= FLAG_REQUEST_ID;
+    encode_header_v2(out, type, body, length, flags, request_id);
+    return HEADER_V2_SIZE;
+}
+
+// 把一个完整的包追加到 out 末尾 (用于拼装批量请求 / 批量响应)
+inline void append_frame(std::string& out, uint32_t type, std::string_view body,
+                         const WireFormat& wire = WireFormat(), uint32_t request_id = 0, uint8_t extra_flags = 0) {
+    char header[MAX_HEADER_SIZE];
+    size_t header_len = encode_header_for(header, wire, type, body.data(), body.size(), request_id, extra_flags);
+    out.append(header, header_len);
+    out += body;
+}
+
+// === 流式解码器 ===
+// 同时接受 v1 与 v2 包头，由魔数区分
+enum DecodeStatus {
+    DECODE_NEED_MORE,    // 数据不足一个完整的包，等待下一次读取
+    DECODE_FRAME,        // 解析出一个完整的包
+    DECODE_HTTP,         // 数据以 HTTP 请求开头 (Lab8 兼容)
+    DECODE_BAD_MAGIC,    // 魔数或版本错误，不是 Lab7 协议
+    DECODE_BAD_CHECKSUM, // 完整的 v2 包，但 Body 的 CRC32C 不符 (frame 仍可用于跳过该包)
+    DECODE_TOO_LARGE     // 包头声明的 Body 长度超过上限 (frame.header 有效)
+};
+
+// 解码结果：body 指向接收缓冲内部，仅在 consume() 之前有效
+struct Frame {
+    PacketHeader header;   // magic / type / length，已转换为主机字节序
+    uint8_t version;       // 1 或 2
+    uint8_t flags;         // v2 标志，v1 包为 0
+    uint32_t request_id;   // FLAG_REQUEST_ID 时有效，否则为 0
+    size_t header_size;    // HEADER_SIZE 或 HEADER_V2_SIZE
+    const char* body;
+
+    size_t size() const { return header_size + header.length; }
+};
+
+// 判断数据开头是否为 HTTP 请求
+inline bool is_http_request(const char* data) {
+    static const char* const methods[] = {"GET ", "POST", "HEAD", "PUT ", "DELE", "OPTI", "PATC", "TRAC", "CONN"};
+    for (const char* method : methods) {
+        if (memcmp(data, method, 4) == 0) return true;
+    }
+    return false;
+}
+
+// 从 [data, data + len) 的开头尝试解出一个包，不修改缓冲区
+// max_body 为 Body 长度上限：只看包头就能拒绝超长的包，不必等整个 Body 到达
+inline DecodeStatus decode_frame(const char* data, size_t len, Frame& frame, uint32_t max_body = UINT32_MAX) {
+    // 1. 协议嗅探：HTTP 请求至少需要 4 字节才能识别
+    if (len >= 4 && is_http_request(data)) return DECODE_HTTP;
+
+    // 2. 头部不完整
+    if (len < HEADER_SIZE) return DECODE_NEED_MORE;
+
+    memcpy(&frame.header, data, HEADER_SIZE);
+    frame.header.network_to_host(); // 反序列化
+    uint32_t checksum = 0;
+    if (frame.header.magic == MAGIC_LAB7) {
+        frame.version = 1;
+        frame.flags = 0;
+        frame.request_id = 0;
+        frame.header_size = HEADER_SIZE;
+    } else if (frame.header.magic == MAGIC_LAB7_V2) {
+        if (len < HEADER_V2_SIZE) return DECODE_NEED_MORE;
+        PacketHeaderV2 v2;
+        memcpy(&v2, data, HEADER_V2_SIZE);
+        v2.network_to_host();
+        if (v2.version != PROTOCOL_VERSION) return DECODE_BAD_MAGIC;
+        frame.version = v2.version;
+        frame.flags = v2.flags;
+        frame.request_id = (v2.flags & FLAG_REQUEST_ID) ? v2.request_id : 0;
+        frame.header_size = HEADER_V2_SIZE;
+        checksum = v2.checksum;
+    } else {
+        return DECODE_BAD_MAGIC;
+    }
+
+    // 3. 长度检查，然后判断包体是否完整
+    if (frame.header.length > max_body) return DECODE_TOO_LARGE;
+    if (len - frame.header_size < frame.header.length) return DECODE_NEED_MORE;
+
+    frame.body = data + frame.header_size;
+    if ((frame.flags & FLAG_CHECKSUM) && crc32c(frame.body, frame.header.length) != checksum) {
+        return DECODE_BAD_CHECKSUM;
+    }
+    return DECODE_FRAME;
+}
+
+inline DecodeStatus decode_frame(const RecvBuffer& buf, Frame& frame, uint32_t max_body = UINT32_MAX) {
+    return decode_frame(buf.data(), buf.size(), frame, max_body);
+}
+
+// 依次解出接收缓冲中所有完整的包 (包括校验和错误的包，由 handle 决定如何应答)，
+// 每个包交给 handle(frame, status) 后从缓冲中丢弃；handle 返回 false 时停止。
+// 返回停止时的解码状态：DECODE_NEED_MORE 表示缓冲中只剩不完整的包，
+// DECODE_FRAME / DECODE_BAD_CHECKSUM 表示 handle 要求停止，其余为无法继续解析的错误 (frame.header 有效)
+template <typename Handler>
+inline DecodeStatus drain_frames(RecvBuffer& in, Frame& frame, uint32_t max_body, Handler&& handle) {
+    DecodeStatus status;
+    while ((status = decode_frame(in, frame, max_body)) == DECODE_FRAME || status == DECODE_BAD_CHECKSUM) {
+        bool keep = handle(static_cast<const Frame&>(frame), status);
+        in.consume(frame.size());
+        if (!keep) break;
+    }
+    return status;
+}
+
+#endif // FRAME_CODEC_H
@@ -0,0 +1,105 @@
+// 帧解码器模糊测试 (libFuzzer 接口)
+// 输入：第 1 字节选 Body 长度上限，第 2 字节选每次到达的字节数，其余为连接上收到的字节流。
+// 检查：
+//   1. 同一字节流一次到达与分段到达，解出的包序列与最终状态完全相同 (服务器按 recv 的边界逐段解析)
+//   2. 解出的包不越过输入边界，Body 不超过上限，带校验和的包校验和确实匹配
+//   3. 按包的版本与标志重新编码后再解码，得到相同的类型、标志、请求 ID 与 Body
+//   4. REQ_BATCH 的 Body 按 handle_batch 的方式逐个解出子请求
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include "../frame_codec.h"
+
+#define FUZZ_CHECK(cond)                                                          \
+    do {                                                                          \
+        if (!(cond)) {                                                            \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            abort();                                                              \
+        }                                                                         \
+    } while (0)
+
+namespace {
+
+struct Decoded {
+    DecodeStatus status;
+    uint32_t type;
+    uint8_t version;
+    uint8_t flags;
+    uint32_t request_id;
+    std::string body;
+
+    bool operator==(const Decoded& o) const {
+        return status == o.status && type == o.type && version == o.version && flags == o.flags &&
+               request_id == o.request_id && body == o.body;
+    }
+};
+
+// 与服务器的处理循环相同：每段数据到达后取出所有完整的包，遇到无法继续解析的状态时停止
+DecodeStatus decode_stream(const char* data, size_t len, size_t chunk, uint32_t max_body, std::vector<Decoded>& out) {
+    RecvBuffer in(64);
+    Frame frame;
+    DecodeStatus status = DECODE_NEED_MORE;
+    for (size_t pos = 0; pos < len && status == DECODE_NEED_MORE; pos += chunk) {
+        in.append(data + pos, std::min(chunk, len - pos));
+        status = drain_frames(in, frame, max_body, [&](const Frame& f, DecodeStatus s) {
+            FUZZ_CHECK(f.header.length <= max_body);
+            FUZZ_CHECK(f.size() <= in.size());
+            FUZZ_CHECK(f.body == in.data() + f.header_size);
+            out.push_back(Decoded{s, f.header.type, f.version, f.flags, f.request_id, std::string(f.body, f.header.length)});
+            return true;
+        });
+    }
+    return status;
+}
+
+void check_reencode(const Decoded& d) {
+    if (d.status != DECODE_FRAME) return;
+    WireFormat wire(d.version, d.version < 2 ? 0 : d.flags);
+    std::string encoded;
+    append_frame(encoded, d.type, d.body, wire, d.request_id, d.flags & FLAG_CONTINUATION);
+    Frame frame;
+    FUZZ_CHECK(decode_frame(encoded.data(), encoded.size(), frame) == DECODE_FRAME);
+    FUZZ_CHECK(frame.size() == encoded.size());
+    FUZZ_CHECK(frame.header.type == d.type && frame.version == d.version);
+    FUZZ_CHECK(frame.request_id == d.request_id);
+    uint8_t expected = d.flags & (FLAG_CONTINUATION | FLAG_CHECKSUM);
+    if (d.request_id != 0) expected |= FLAG_REQUEST_ID;
+    FUZZ_CHECK(frame.flags == expected);
+    FUZZ_CHECK(std::string(frame.body, frame.header.length) == d.body);
+}
+
+// 批量请求：子请求在 Body 内首尾相接，格式错误时整批拒绝
+void decode_batch(const std::string& body) {
+    size_t pos = 0;
+    while (pos < body.size()) {
+        Frame sub;
+        DecodeStatus status = decode_frame(body.data() + pos, body.size() - pos, sub);
+        if (status != DECODE_FRAME && status != DECODE_BAD_CHECKSUM) return;
+        FUZZ_CHECK(sub.size() <= body.size() - pos);
+        pos += sub.size();
+    }
+}
+
+}  // namespace
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    if (size < 2) return 0;
+    uint32_t max_body = data[0] == 0 ? UINT32_MAX : (uint32_t)data[0] * 64;
+    size_t chunk = (size_t)data[1] + 1;
+    const char* stream = reinterpret_cast<const char*>(data + 2);
+    size_t len = size - 2;
+
+    std::vector<Decoded> whole, pieces;
+    DecodeStatus whole_status = decode_stream(stream, len, len ? len : 1, max_body, whole);
+    DecodeStatus chunk_status = decode_stream(stream, len, chunk, max_body, pieces);
+    FUZZ_CHECK(whole_status == chunk_status);
+    FUZZ_CHECK(whole == pieces);
+
+    for (const Decoded& d : whole) {
+        check_reencode(d);
+        if (d.type == REQ_BATCH) decode_batch(d.body);
+    }
+    return 0;
+}
@@ -0,0 +1,60 @@
+// HTTP 请求解析模糊测试 (libFuzzer 接口)
+// 输入：第 1 字节选每次到达的字节数，其余为协议端口上嗅探到 HTTP 之后收到的字节流。
+// 检查：一次到达与分段到达解析出的请求序列相同、出错时的状态码相同；Body 不超过上限。
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include "../http_codec.h"
+
+#define FUZZ_CHECK(cond)                                                          \
+    do {                                                                          \
+        if (!(cond)) {                                                            \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            abort();                                                              \
+        }                                                                         \
+    } while (0)
+
+namespace {
+
+const size_t MAX_BODY = 4096;
+
+// 与 process_http 相同：每段数据到达后解析出所有完整的请求，出错时停止；返回出错的状态码 (0 表示未出错)
+int parse_stream(const char* data, size_t len, size_t chunk, std::vector<std::string>& out) {
+    RecvBuffer in(64);
+    HttpParser parser(MAX_BODY);
+    for (size_t pos = 0; pos < len; pos += chunk) {
+        in.append(data + pos, std::min(chunk, len - pos));
+        HttpParseStatus status;
+        while ((status = parser.parse(in)) == HTTP_REQUEST) {
+            const HttpRequest& req = parser.request();
+            FUZZ_CHECK(req.body.size() <= MAX_BODY);
+            std::string summary = req.method + ' ' + req.target + ' ' + req.version + (req.keep_alive ? " k " : " c ");
+            for (const auto& h : req.headers) summary += h.first + ':' + h.second + '\n';
+            out.push_back(summary + req.body);
+            parser.reset();
+        }
+        if (status == HTTP_ERROR) {
+            FUZZ_CHECK(parser.error_status() >= 400);
+            return parser.error_status();
+        }
+    }
+    return 0;
+}
+
+}  // namespace
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    if (size < 1) return 0;
+    size_t chunk = (size_t)data[0] + 1;
+    const char* stream = reinterpret_cast<const char*>(data + 1);
+    size_t len = size - 1;
+
+    std::vector<std::string> whole, pieces;
+    int whole_error = parse_stream(stream, len, len ? len : 1, whole);
+    int chunk_error = parse_stream(stream, len, chunk, pieces);
+    FUZZ_CHECK(whole == pieces);
+    FUZZ_CHECK(whole_error == chunk_error);
+    return 0;
+}
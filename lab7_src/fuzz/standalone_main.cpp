@@ -0,0 +1,181 @@
+// 没有 libFuzzer (只有 g++) 时的模糊测试驱动，与 LLVMFuzzerTestOneInput 目标链接，配合 ASan / UBSan 使用
+// 1. 依次执行命令行给出的语料文件 (目录中的所有文件)
+// 2. 以语料为种子做 -runs=N 次随机变异：翻转位、改写字节、插入 / 删除 / 复制片段、拼接两个种子、
+//    把 4 字节字段改成边界值 (长度、魔数)；不覆盖率引导，靠次数与帧结构相关的变异弥补
+// 出错 (检查失败或 sanitizer 报告) 时把当前输入写入 crash-<hash>，可直接作为参数重放
+// 用法：./fuzz_frame [-runs=N] [-seed=N] [-max_len=N] 语料文件或目录...
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <csignal>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sanitizer/common_interface_defs.h>
+#include "../protocol.h"
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size);
+
+namespace {
+
+std::string current;     // 正在执行的输入
+char crash_path[64];     // 出错时写入的文件名 (信号处理函数中只能用预先生成的字符串)
+
+void save_crash() {
+    int fd = open(crash_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return;
+    ssize_t n = write(fd, current.data(), current.size());
+    (void)n;
+    close(fd);
+    const char msg[] = "Input saved to ";
+    n = write(STDERR_FILENO, msg, sizeof(msg) - 1);
+    n = write(STDERR_FILENO, crash_path, strlen(crash_path));
+    n = write(STDERR_FILENO, "\n", 1);
+}
+
+void on_abort(int) {
+    save_crash();
+    signal(SIGABRT, SIG_DFL);
+    raise(SIGABRT);
+}
+
+void run_one(const std::string& input) {
+    current = input;
+    snprintf(crash_path, sizeof(crash_path), "crash-%016zx", std::hash<std::string>()(input));
+    LLVMFuzzerTestOneInput(reinterpret_cast<const uint8_t*>(current.data()), current.size());
+}
+
+bool read_file(const std::string& path, std::string& out) {
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f) return false;
+    char buf[4096];
+    size_t n;
+    out.clear();
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) out.append(buf, n);
+    fclose(f);
+    return true;
+}
+
+void load_corpus(const std::string& path, std::vector<std::string>& corpus) {
+    struct stat st;
+    if (stat(path.c_str(), &st) < 0) {
+        fprintf(stderr, "Cannot open %s\n", path.c_str());
+        exit(1);
+    }
+    std::string data;
+    if (!S_ISDIR(st.st_mode)) {
+        if (read_file(path, data)) corpus.push_back(data);
+        return;
+    }
+    DIR* dir = opendir(path.c_str());
+    while (dirent* entry = dir ? readdir(dir) : nullptr) {
+        if (entry->d_name[0] == '.') continue;
+        std::string file = path + "/" + entry->d_name;
+        if (stat(file.c_str(), &st) == 0 && S_ISREG(st.st_mode) && read_file(file, data)) corpus.push_back(data);
+    }
+    if (dir) closedir(dir);
+}
+
+class Mutator {
+public:
+    Mutator(uint64_t seed, size_t max_len) : rng_(seed), max_len_(max_len) {}
+
+    std::string mutate(const std::vector<std::string>& corpus) {
+        std::string data = corpus.empty() ? std::string() : corpus[pick(corpus.size())];
+        int rounds = 1 + (int)pick(4);
+        for (int i = 0; i < rounds; ++i) mutate_once(data, corpus);
+        if (data.size() > max_len_) data.resize(max_len_);
+        return data;
+    }
+
+private:
+    size_t pick(size_t n) { return n == 0 ? 0 : std::uniform_int_distribution<size_t>(0, n - 1)(rng_); }
+    char random_byte() { return (char)pick(256); }
+
+    void mutate_once(std::string& data, const std::vector<std::string>& corpus) {
+        switch (pick(8)) {
+            case 0:  // 翻转一位
+                if (!data.empty()) data[pick(data.size())] ^= (char)(1 << pick(8));
+                break;
+            case 1:  // 改写一个字节
+                if (!data.empty()) data[pick(data.size())] = random_byte();
+                break;
+            case 2: {  // 插入随机字节
+                std::string bytes(1 + pick(8), '\0');
+                for (char& c : bytes) c = random_byte();
+                data.insert(pick(data.size() + 1), bytes);
+                break;
+            }
+            case 3:  // 删除一段
+                if (!data.empty()) {
+                    size_t pos = pick(data.size());
+                    data.erase(pos, 1 + pick(std::min<size_t>(data.size() - pos, 64)));
+                }
+                break;
+            case 4:  // 复制一段 (制造连续的多个包 / 重复的头部行)
+                if (!data.empty()) {
+                    size_t pos = pick(data.size());
+                    std::string piece = data.substr(pos, 1 + pick(data.size() - pos));
+                    data.insert(pick(data.size() + 1), piece);
+                }
+                break;
+            case 5:  // 拼接另一个种子
+                if (!corpus.empty()) data += corpus[pick(corpus.size())];
+                break;
+            case 6: {  // 4 字节字段改成边界值 (网络字节序)
+                static const uint32_t values[] = {0, 1, 0x7F, 0xFF, 0x100, 0xFFFF, 0x10000, 0x7FFFFFFF, 0xFFFFFFFF,
+                                                  MAGIC_LAB7, MAGIC_LAB7_V2};
+                if (data.size() < 4) break;
+                uint32_t v = htonl(values[pick(sizeof(values) / sizeof(values[0]))]);
+                memcpy(&data[pick(data.size() - 3)], &v, 4);
+                break;
+            }
+            case 7:  // 截断
+                if (!data.empty()) data.resize(pick(data.size()));
+                break;
+        }
+    }
+
+    std::mt19937_64 rng_;
+    size_t max_len_;
+};
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    long runs = 0;
+    uint64_t seed = (uint64_t)std::chrono::steady_clock::now().time_since_epoch().count();
+    size_t max_len = 4096;
+    std::vector<std::string> corpus;
+    for (int i = 1; i < argc; ++i) {
+        if (strncmp(argv[i], "-runs=", 6) == 0) {
+            runs = atol(argv[i] + 6);
+        } else if (strncmp(argv[i], "-seed=", 6) == 0) {
+            seed = strtoull(argv[i] + 6, nullptr, 10);
+        } else if (strncmp(argv[i], "-max_len=", 9) == 0) {
+            max_len = (size_t)std::max(1L, atol(argv[i] + 9));
+        } else if (argv[i][0] == '-') {
+            fprintf(stderr, "Ignoring unsupported flag %s\n", argv[i]);
+        } else {
+            load_corpus(argv[i], corpus);
+        }
+    }
+
+    __sanitizer_set_death_callback(save_crash);
+    signal(SIGABRT, on_abort);
+
+    auto begin = std::chrono::steady_clock::now();
+    for (const std::string& input : corpus) run_one(input);
+    Mutator mutator(seed, max_len);
+    for (long i = 0; i < runs; ++i) run_one(mutator.mutate(corpus));
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    printf("%s: %zu corpus input(s) + %ld mutation(s) in %.1f s, seed=%llu\n", argv[0], corpus.size(), runs, secs,
+           (unsigned long long)seed);
+    return 0;
+}
@@ -0,0 +1,371 @@
+#ifndef HTTP_CODEC_H
+#define HTTP_CODEC_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <cstring>
+#include <cstddef>
+#include <cstdint>
+#include "frame_codec.h"
+#include "buffer_pool.h"
+
+// === HTTP/1.1 请求解析 ===
+// 与二进制协议共用端口和接收缓冲：嗅探到 HTTP 后连接改由 HttpParser 增量解析。
+// 解析器记住已扫描到的位置与 Body 的解析状态，数据分多次到达时不会从头重新扫描；
+// 一个请求解析完后从接收缓冲中消费掉，缓冲中剩下的字节就是流水线上的下一个请求。
+// 支持 Content-Length 与 chunked 两种 Body 编码，HTTP/1.1 默认保持连接。
+
+struct HttpRequest {
+    std::string method;
+    std::string target;   // 请求行中的 URI (原样保留查询串)
+    std::string version;  // "HTTP/1.0" 或 "HTTP/1.1"
+    std::vector<std::pair<std::string, std::string>> headers;
+    std::string body;     // 已解码的 Body (chunked 已拼接)
+    bool keep_alive = false;
+
+    // 按名字查找头部 (不区分大小写)，不存在返回 nullptr
+    const std::string* header(std::string_view name) const {
+        for (const auto& h : headers) {
+            if (h.first.size() == name.size() && strncasecmp(h.first.data(), name.data(), name.size()) == 0) {
+                return &h.second;
+            }
+        }
+        return nullptr;
+    }
+
+    // 请求路径：去掉查询串与片段
+    std::string_view path() const {
+        std::string_view t(target);
+        return t.substr(0, t.find_first_of("?#"));
+    }
+
+    void clear() {
+        method.clear();
+        target.clear();
+        version.clear();
+        headers.clear();
+        body.clear();
+        keep_alive = false;
+    }
+};
+
+enum HttpParseStatus {
+    HTTP_NEED_MORE,  // 请求不完整，等待更多数据
+    HTTP_REQUEST,    // 解析出一个完整的请求 (request() 有效)
+    HTTP_ERROR       // 请求格式错误，应答 error_status() 后关闭连接
+};
+
+// 逗号分隔的头部值中是否包含某个选项 (不区分大小写)，例如 Connection: keep-alive, Upgrade
+inline bool header_has_token(const std::string* value, std::string_view token) {
+    if (!value) return false;
+    std::string_view rest(*value);
+    while (!rest.empty()) {
+        size_t comma = rest.find(',');
+        std::string_view item = rest.substr(0, comma);
+        while (!item.empty() && (item.front() == ' ' || item.front() == '\t')) item.remove_prefix(1);
+        while (!item.empty() && (item.back() == ' ' || item.back() == '\t')) item.remove_suffix(1);
+        if (item.size() == token.size() && strncasecmp(item.data(), token.data(), token.size()) == 0) return true;
+        if (comma == std::string_view::npos) break;
+        rest.remove_prefix(comma + 1);
+    }
+    return false;
+}
+
+class HttpParser {
+public:
+    static const size_t MAX_HEADER = 16 * 1024;  // 请求行 + 头部的长度上限
+    static const size_t MAX_HEADERS = 100;       // 头部个数上限
+
+    explicit HttpParser(size_t max_body) : max_body_(max_body) { reset(); }
+
+    // 为下一个请求做准备 (保留请求对象中字符串的容量)
+    void reset() {
+        state_ = STATE_HEAD;
+        scan_ = 0;
+        remaining_ = 0;
+        error_status_ = 0;
+        error_reason_ = "";
+        request_.clear();
+    }
+
+    HttpRequest& request() { return request_; }
+    // 已读完请求头、正在接收 Body (读缓冲可能已被取空)
+    bool in_body() const { return state_ != STATE_HEAD; }
+    int error_status() const { return error_status_; }
+    const char* error_reason() const { return error_reason_; }
+
+    // 从接收缓冲解析，消费已解析的字节
+    HttpParseStatus parse(RecvBuffer& in) {
+        while (true) {
+            switch (state_) {
+                case STATE_HEAD: {
+                    // 1. 逐行扫描到空行 (请求头结束)，从上次扫描到的位置继续；请求行之前的空行忽略 (RFC 9112)
+                    while (true) {
+                        std::string_view data(in.data(), in.size());
+                        size_t nl = data.find('\n', scan_);
+                        if (nl == std::string_view::npos) {
+                            if (data.size() > MAX_HEADER) return fail(431, "Request Header Fields Too Large");
+                            return HTTP_NEED_MORE;
+                        }
+                        size_t line_end = nl > scan_ && data[nl - 1] == '\r' ? nl - 1 : nl;
+                        bool blank = line_end == scan_;
+                        if (blank && scan_ == 0) {
+                            in.consume(nl + 1);
+                            continue;
+                        }
+                        scan_ = nl + 1;
+                        if (!blank) continue;
+                        if (scan_ > MAX_HEADER) return fail(431, "Request Header Fields Too Large");
+                        if (!parse_head(data.substr(0, line_end))) return HTTP_ERROR;
+                        in.consume(scan_);
+                        scan_ = 0;
+                        if (!begin_body()) return HTTP_ERROR;
+                        break;
+                    }
+                    break;
+                }
+                case STATE_BODY: {
+                    // 2. Content-Length：收齐 remaining_ 字节
+                    size_t n = std::min(remaining_, in.size());
+                    request_.body.append(in.data(), n);
+                    in.consume(n);
+                    remaining_ -= n;
+                    if (remaining_ > 0) return HTTP_NEED_MORE;
+                    state_ = STATE_DONE;
+                    break;
+                }
+                case STATE_CHUNK_SIZE: {
+                    // 3. chunked：每块以 "十六进制长度[;扩展]\r\n" 开头
+                    std::string_view line;
+                    if (!next_line(in, line)) return in.size() > MAX_HEADER ? fail(400, "Bad Request") : HTTP_NEED_MORE;
+                    size_t size = 0, digits = 0;
+                    for (char c : line) {
+                        int v = hex_value(c);
+                        if (v < 0) break;
+                        if (size > (SIZE_MAX >> 4)) return fail(413, "Payload Too Large");
+                        size = (size << 4) | (size_t)v;
+                        ++digits;
+                    }
+                    if (digits == 0) return fail(400, "Bad Request");
+                    in.consume(line_consumed_);
+                    if (size == 0) {
+                        state_ = STATE_TRAILER;
+                    } else if (size > max_body_ - request_.body.size()) {
+                        return fail(413, "Payload Too Large");
+                    } else {
+                        remaining_ = size;
+                        state_ = STATE_CHUNK_DATA;
+                    }
+                    break;
+                }
+                case STATE_CHUNK_DATA: {
+                    size_t n = std::min(remaining_, in.size());
+                    request_.body.append(in.data(), n);
+                    in.consume(n);
+                    remaining_ -= n;
+                    if (remaining_ > 0) return HTTP_NEED_MORE;
+                    state_ = STATE_CHUNK_END;
+                    break;
+                }
+                case STATE_CHUNK_END: {
+                    // 块数据之后紧跟 CRLF
+                    std::string_view line;
+                    if (!next_line(in, line)) return in.size() >= 2 ? fail(400, "Bad Request") : HTTP_NEED_MORE;
+                    if (!line.empty()) return fail(400, "Bad Request");
+                    in.consume(line_consumed_);
+                    state_ = STATE_CHUNK_SIZE;
+                    break;
+                }
+                case STATE_TRAILER: {
+                    // 最后一块之后的尾部字段：忽略，直到空行
+                    std::string_view line;
+                    if (!next_line(in, line)) return in.size() > MAX_HEADER ? fail(431, "Request Header Fields Too Large") : HTTP_NEED_MORE;
+                    in.consume(line_consumed_);
+                    if (line.empty()) state_ = STATE_DONE;
+                    break;
+                }
+                case STATE_DONE:
+                    return HTTP_REQUEST;
+                case STATE_ERROR:
+                    return HTTP_ERROR;
+            }
+        }
+    }
+
+private:
+    enum State { STATE_HEAD, STATE_BODY, STATE_CHUNK_SIZE, STATE_CHUNK_DATA, STATE_CHUNK_END, STATE_TRAILER, STATE_DONE, STATE_ERROR };
+
+    HttpParseStatus fail(int status, const char* reason) {
+        state_ = STATE_ERROR;
+        error_status_ = status;
+        error_reason_ = reason;
+        return HTTP_ERROR;
+    }
+
+    bool reject(int status, const char* reason) {
+        fail(status, reason);
+        return false;
+    }
+
+    static int hex_value(char c) {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    }
+
+    static std::string_view trim(std::string_view s) {
+        while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) s.remove_prefix(1);
+        while (!s.empty() && (s.back() == ' ' || s.back() == '\t')) s.remove_suffix(1);
+        return s;
+    }
+
+    // 读缓冲开头的一行 (不含行尾的 CRLF / LF)，line_consumed_ 为包括行尾在内的长度
+    bool next_line(const RecvBuffer& in, std::string_view& line) {
+        std::string_view data(in.data(), in.size());
+        size_t nl = data.find('\n');
+        if (nl == std::string_view::npos) return false;
+        line_consumed_ = nl + 1;
+        line = data.substr(0, nl > 0 && data[nl - 1] == '\r' ? nl - 1 : nl);
+        return true;
+    }
+
+    // 请求行与头部 (不含结束的空行)
+    bool parse_head(std::string_view head) {
+        size_t eol = head.find('\n');
+        std::string_view line = head.substr(0, eol);
+        if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+
+        // 请求行: METHOD SP target SP HTTP/1.x
+        size_t sp1 = line.find(' ');
+        size_t sp2 = sp1 == std::string_view::npos ? sp1 : line.find(' ', sp1 + 1);
+        if (sp1 == 0 || sp2 == std::string_view::npos || sp2 == sp1 + 1) return reject(400, "Bad Request");
+        std::string_view version = line.substr(sp2 + 1);
+        if (version.substr(0, 5) != "HTTP/") return reject(400, "Bad Request");
+        if (version != "HTTP/1.0" && version != "HTTP/1.1") return reject(505, "HTTP Version Not Supported");
+        request_.method.assign(line.data(), sp1);
+        request_.target.assign(line.data() + sp1 + 1, sp2 - sp1 - 1);
+        request_.version.assign(version.data(), version.size());
+
+        // 头部: "Name: value"，值去掉首尾空白
+        std::string_view rest = eol == std::string_view::npos ? std::string_view() : head.substr(eol + 1);
+        while (!rest.empty()) {
+            size_t nl = rest.find('\n');
+            std::string_view field = rest.substr(0, nl);
+            rest = nl == std::string_view::npos ? std::string_view() : rest.substr(nl + 1);
+            if (!field.empty() && field.back() == '\r') field.remove_suffix(1);
+            size_t colon = field.find(':');
+            if (colon == 0 || colon == std::string_view::npos) return reject(400, "Bad Request");
+            if (request_.headers.size() >= MAX_HEADERS) return reject(431, "Request Header Fields Too Large");
+            std::string_view name = trim(field.substr(0, colon));
+            std::string_view value = trim(field.substr(colon + 1));
+            request_.headers.emplace_back(std::string(name), std::string(value));
+        }
+
+        // 持久连接：HTTP/1.1 默认保持，HTTP/1.0 需要显式的 keep-alive
+        const std::string* connection = request_.header("Connection");
+        request_.keep_alive = request_.version == "HTTP/1.1" ? !header_has_token(connection, "close")
+                                                             : header_has_token(connection, "keep-alive");
+        return true;
+    }
+
+    // 根据 Transfer-Encoding / Content-Length 决定 Body 的读取方式
+    bool begin_body() {
+        const std::string* encoding = request_.header("Transfer-Encoding");
+        const std::string* length = request_.header("Content-Length");
+        if (encoding) {
+            // 只支持 chunked (且必须是最后一层编码)；同时出现 Content-Length 时以 chunked 为准
+            if (!header_has_token(encoding, "chunked")) return reject(501, "Not Implemented");
+            state_ = STATE_CHUNK_SIZE;
+            return true;
+        }
+        if (length) {
+            size_t n;
+            if (!parse_int(std::string_view(*length), n)) return reject(400, "Bad Request");
+            if (n > max_body_) return reject(413, "Payload Too Large");
+            request_.body.reserve(n);
+            remaining_ = n;
+            state_ = n > 0 ? STATE_BODY : STATE_DONE;
+            return true;
+        }
+        state_ = STATE_DONE;
+        return true;
+    }
+
+    size_t max_body_;
+    State state_;
+    size_t scan_;           // STATE_HEAD：已扫描过的字节数 (下一行的起点)
+    size_t remaining_;      // STATE_BODY / STATE_CHUNK_DATA：还要读取的 Body 字节数
+    size_t line_consumed_ = 0;
+    int error_status_;
+    const char* error_reason_;
+    HttpRequest request_;
+};
+
+// HTTP 状态码对应的原因短语
+inline const char* http_reason(int status) {
+    switch (status) {
+        case 200: return "OK";
+        case 304: return "Not Modified";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 413: return "Payload Too Large";
+        case 431: return "Request Header Fields Too Large";
+        case 500: return "Internal Server Error";
+        case 501: return "Not Implemented";
+        case 505: return "HTTP Version Not Supported";
+        default: return "Unknown";
+    }
+}
+
+// 按扩展名猜测 Content-Type
+inline const char* http_content_type(std::string_view path) {
+    size_t dot = path.rfind('.');
+    std::string_view ext = dot == std::string_view::npos ? std::string_view() : path.substr(dot + 1);
+    auto is = [&](const char* e) { return ext.size() == strlen(e) && strncasecmp(ext.data(), e, ext.size()) == 0; };
+    if (is("html") || is("htm")) return "text/html";
+    if (is("txt")) return "text/plain";
+    if (is("css")) return "text/css";
+    if (is("js")) return "application/javascript";
+    if (is("json")) return "application/json";
+    if (is("jpg") || is("jpeg")) return "image/jpeg";
+    if (is("png")) return "image/png";
+    if (is("gif")) return "image/gif";
+    if (is("svg")) return "image/svg+xml";
+    if (is("ico")) return "image/x-icon";
+    return "application/octet-stream";
+}
+
+// 应答的状态行与头部 (以空行结束)：版本跟随请求，keep_alive 决定 Connection 头
+// HTTP/1.1 保持连接时省略 Connection 头，HTTP/1.0 保持连接时需要显式的 keep-alive；304 没有 Body，不发 Content-Length
+inline void append_http_head(std::string& out, const std::string& version, int status, const char* content_type,
+                             size_t content_length, bool keep_alive, std::string_view extra_headers = std::string_view()) {
+    out += version == "HTTP/1.0" ? "HTTP/1.0 " : "HTTP/1.1 ";
+    append_int(out, status);
+    out += ' ';
+    out += http_reason(status);
+    out += "\r\nServer: Lab7\r\n";
+    if (content_type) {
+        out += "Content-Type: ";
+        out += content_type;
+        out += "\r\n";
+    }
+    if (status != 304) {
+        out += "Content-Length: ";
+        append_int(out, (long long)content_length);
+        out += "\r\n";
+    }
+    if (!keep_alive) {
+        out += "Connection: close\r\n";
+    } else if (version == "HTTP/1.0") {
+        out += "Connection: keep-alive\r\n";
+    }
+    out += extra_headers;
+    out += "\r\n";
+}
+
+#endif // HTTP_CODEC_H
@@ -0,0 +1,172 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <string>
+#include <vector>
+#include <sstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+
+// === 异步日志 ===
+// 调用线程只把格式化好的一行放进有界队列，由后台线程批量写出并 fflush，
+// 连接 / 断开等高频日志不再在处理线程上同步刷新标准输出。
+// 每秒最多接受 rate 行 (超出的行在格式化之前就被丢弃)，队列满时同样丢弃；
+// 被丢弃的行数每秒汇总报告一次，并在 /metrics 中可见。
+
+enum LogLevel {
+    LOG_INFO,   // 写到 stdout
+    LOG_WARN,   // 写到 stderr
+    LOG_ERROR   // 写到 stderr
+};
+
+class AsyncLogger {
+public:
+    static const size_t QUEUE_MAX = 8192;  // 队列中最多积压的行数
+
+    AsyncLogger() : rate_(1000), window_(0), window_count_(0), suppressed_(0), dropped_(0), reported_(0), stopped_(false) {
+        writer_ = std::thread(&AsyncLogger::run, this);
+    }
+
+    // 每秒最多接受的行数，0 表示不限
+    void set_rate(uint32_t lines_per_second) { rate_.store(lines_per_second, std::memory_order_relaxed); }
+
+    template <typename... Args>
+    void log(LogLevel level, const Args&... args) {
+        if (!admit()) return;
+        thread_local std::ostringstream os;
+        os.str("");
+        (os << ... << args);
+        os << '\n';
+        push(level, os.str());
+    }
+
+    // 因限速或队列满而丢弃的行数
+    uint64_t suppressed() const {
+        return suppressed_.load(std::memory_order_relaxed) + dropped_.load(std::memory_order_relaxed);
+    }
+
+    // 写完队列中剩余的行并结束后台线程；之后的日志直接同步写出
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            if (stopped_) return;
+            stopped_ = true;
+        }
+        cv_.notify_one();
+        writer_.join();
+    }
+
+private:
+    struct Line {
+        LogLevel level;
+        std::string text;
+    };
+
+    // 限速：按整秒划分窗口计数，窗口切换时清零 (近似即可，不需要精确的令牌桶)
+    bool admit() {
+        uint32_t rate = rate_.load(std::memory_order_relaxed);
+        if (rate == 0) return true;
+        int64_t second = std::chrono::duration_cast<std::chrono::seconds>(
+                             std::chrono::steady_clock::now().time_since_epoch()).count();
+        int64_t window = window_.load(std::memory_order_relaxed);
+        if (window != second && window_.compare_exchange_strong(window, second, std::memory_order_relaxed)) {
+            window_count_.store(0, std::memory_order_relaxed);
+        }
+        if (window_count_.fetch_add(1, std::memory_order_relaxed) < rate) return true;
+        suppressed_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    void push(LogLevel level, std::string&& text) {
+        std::unique_lock<std::mutex> lock(mtx_);
+        if (stopped_) {
+            write_line(level, text);
+            fflush(level == LOG_INFO ? stdout : stderr);
+            return;
+        }
+        if (queue_.size() >= QUEUE_MAX) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        bool was_empty = queue_.empty();
+        queue_.push_back(Line{level, std::move(text)});
+        lock.unlock();
+        if (was_empty) cv_.notify_one();
+    }
+
+    static void write_line(LogLevel level, const std::string& text) {
+        fwrite(text.data(), 1, text.size(), level == LOG_INFO ? stdout : stderr);
+    }
+
+    // 后台线程：整批取走队列，写完后各 fflush 一次；每秒检查一次是否有新丢弃的行
+    void run() {
+        std::vector<Line> batch;
+        bool stopping = false;
+        while (!stopping) {
+            {
+                std::unique_lock<std::mutex> lock(mtx_);
+                cv_.wait_for(lock, std::chrono::seconds(1), [this] { return stopped_ || !queue_.empty(); });
+                batch.swap(queue_);
+                stopping = stopped_;
+            }
+            for (const Line& line : batch) write_line(line.level, line.text);
+            batch.clear();
+
+            uint64_t lost = suppressed();
+            if (lost != reported_) {
+                fprintf(stderr, "[Warn] %llu log line(s) suppressed (rate limit or full queue).\n",
+                        (unsigned long long)(lost - reported_));
+                reported_ = lost;
+            }
+            fflush(stdout);
+            fflush(stderr);
+        }
+    }
+
+    std::atomic<uint32_t> rate_;
+    std::atomic<int64_t> window_;          // 当前计数窗口 (单调时钟的整秒数)
+    std::atomic<uint32_t> window_count_;   // 当前窗口内已请求的行数
+    std::atomic<uint64_t> suppressed_;     // 超过限速丢弃的行数
+    std::atomic<uint64_t> dropped_;        // 队列满丢弃的行数
+    uint64_t reported_;                    // 已报告过的丢弃行数 (仅后台线程访问)
+
+    std::mutex mtx_;
+    std::condition_variable cv_;
+    std::vector<Line> queue_;
+    bool stopped_;
+    std::thread writer_;
+};
+
+// 全局日志：第一次使用时启动后台线程，进程退出 (main 返回或 exit) 时写完剩余的行
+// 有意不析构：进程退出时分离的处理线程可能仍在写日志，stop 之后改为同步写出
+inline AsyncLogger& server_log() {
+    static AsyncLogger* logger = [] {
+        AsyncLogger* created = new AsyncLogger();
+        std::atexit([] { server_log().stop(); });
+        return created;
+    }();
+    return *logger;
+}
+
+template <typename... Args>
+void log_info(const Args&... args) {
+    server_log().log(LOG_INFO, "[Info] ", args...);
+}
+
+template <typename... Args>
+void log_warn(const Args&... args) {
+    server_log().log(LOG_WARN, "[Warn] ", args...);
+}
+
+template <typename... Args>
+void log_error(const Args&... args) {
+    server_log().log(LOG_ERROR, "[Error] ", args...);
+}
+
+#endif // LOGGER_H
@@ -0,0 +1,103 @@
+#ifndef MAILBOX_H
+#define MAILBOX_H
+
+#include <mutex>
+#include <string>
+#include <vector>
+#include "output_queue.h"
+#include "ring_queue.h"
+#include <algorithm>
+#include <cstdint>
+#include <fcntl.h>
+#include <unistd.h>
+
+// === 转发邮箱 ===
+// 每个连接一个有界的多生产者 / 单消费者队列：其他连接转发来的消息只入队，
+// 由拥有该连接的线程 (线程模式下的处理线程，或 Reactor 模式下的事件循环) 取出并发送。
+// 发送者从不直接写目标 socket，不会被慢接收者阻塞，也不会与其他发送者交错写出半个包。
+
+// 邮箱中的一条消息：序列化好的共享包，广播时多个邮箱引用同一块内存
+typedef SharedFrame Mail;
+
+// 邮箱满时的处理策略
+enum OverflowPolicy {
+    OVERFLOW_REJECT,     // 拒绝：向发送者回复 RES_ERROR，由发送者稍后重试 (背压)
+    OVERFLOW_DROP,       // 丢弃新消息
+    OVERFLOW_DISCONNECT  // 断开过慢的接收者
+};
+
+class Mailbox {
+public:
+    explicit Mailbox(size_t capacity) : capacity_(capacity) {}
+
+    // 入队；邮箱已满返回 false。was_empty 表示入队前是否为空 (为空时才需要唤醒消费者)
+    // force 为 true 时不检查容量 (服务器关闭通知必须送达)
+    bool push(Mail&& mail, bool& was_empty, bool force = false) {
+        std::lock_guard<std::mutex> lock(mtx_);
+        if (!force && queue_.size() >= capacity_) return false;
+        was_empty = queue_.empty();
+        queue_.push_back() = std::move(mail);
+        return true;
+    }
+
+    // 取出最多 max_count 条消息追加到 out，返回取出的条数
+    size_t drain(std::vector<Mail>& out, size_t max_count) {
+        std::lock_guard<std::mutex> lock(mtx_);
+        size_t n = std::min(max_count, queue_.size());
+        for (size_t i = 0; i < n; ++i) {
+            out.push_back(std::move(queue_.front()));
+            queue_.pop_front();
+        }
+        return n;
+    }
+
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(mtx_);
+        return queue_.size();
+    }
+
+private:
+    mutable std::mutex mtx_;
+    RingQueue<Mail> queue_;  // 槽位复用，稳态下入队不分配内存
+    size_t capacity_;
+};
+
+// 线程模式下唤醒阻塞在 poll 中的处理线程 (非阻塞管道)
+class Waker {
+public:
+    Waker() {
+        fds_[0] = fds_[1] = -1;
+        if (pipe(fds_) == 0) {
+            for (int i = 0; i < 2; ++i) {
+                fcntl(fds_[i], F_SETFL, fcntl(fds_[i], F_GETFL, 0) | O_NONBLOCK);
+                fcntl(fds_[i], F_SETFD, FD_CLOEXEC);
+            }
+        }
+    }
+
+    ~Waker() {
+        if (fds_[0] >= 0) close(fds_[0]);
+        if (fds_[1] >= 0) close(fds_[1]);
+    }
+
+    Waker(const Waker&) = delete;
+    Waker& operator=(const Waker&) = delete;
+
+    int fd() const { return fds_[0]; }
+
+    void notify() {
+        char c = 1;
+        ssize_t ret = write(fds_[1], &c, 1); // 管道已满说明已有未处理的唤醒，忽略即可
+        (void)ret;
+    }
+
+    void drain() {
+        char buf[64];
+        while (read(fds_[0], buf, sizeof(buf)) > 0) {}
+    }
+
+private:
+    int fds_[2];
+};
+
+#endif // MAILBOX_H
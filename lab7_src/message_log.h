@@ -0,0 +1,406 @@
+#ifndef MESSAGE_LOG_H
+#define MESSAGE_LOG_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "crc32c.h"
+
+// === 离线消息日志 ===
+// 发给离线用户的消息追加到目录下的分段文件中，用户重新连接时按批取出重放。
+//   - 每个分段是固定大小的文件 (ftruncate 后 mmap)，记录直接 memcpy 进映射区，写满后切换到下一个分段
+//   - 组提交：后台线程把上次同步之后写入的范围一次 msync(MS_SYNC)，同步期间到达的记录进入下一组，
+//     写入方不等待磁盘；需要持久化保证的调用方用 wait_durable 等待覆盖自己的那次同步
+//   - 重放后追加一条 DELIVERED 记录 (用户 ID + 已投递到的序号)；启动时顺序扫描所有分段，
+//     按 CRC 截掉末尾写了一半的记录，重建每个用户待投递的消息
+//   - 最老的分段中已没有待投递的消息且已同步时删除；只按顺序删除前缀，
+//     保证仍存在的消息所对应的 DELIVERED 记录不会先于消息被删掉
+
+const uint32_t LOG_MAGIC = 0x4C37474C;  // "L7GL"
+
+enum LogRecordType : uint8_t {
+    LOG_MESSAGE = 1,    // 一条消息 (或分片)：user 为接收者，src 为发送者 ID，Body 为消息内容
+    LOG_DELIVERED = 2,  // user 的序号 <= seq 的消息都已交给连接
+};
+
+// 记录头 (本机字节序，按 8 字节对齐)；crc 覆盖 crc 之后的头部字段与 Body
+struct LogRecordHeader {
+    uint32_t magic;
+    uint32_t crc;
+    uint32_t length;  // Body 长度
+    uint8_t type;
+    uint8_t flags;    // 消息的 FLAG_CONTINUATION (重放时保留分片边界) 或 MSG_ABORTED
+    uint16_t reserved;
+    uint64_t seq;
+    uint32_t user;
+    uint32_t src;
+};
+static_assert(sizeof(LogRecordHeader) == 32, "log record header must be 32 bytes");
+
+class MessageLog {
+public:
+    static constexpr size_t DEFAULT_SEGMENT_SIZE = 64 * 1024 * 1024;
+
+    struct Message {
+        uint64_t seq;
+        uint32_t src;
+        uint8_t flags;
+        std::string body;
+    };
+
+    MessageLog() : segment_size_(DEFAULT_SEGMENT_SIZE), next_seq_(1), pending_(0), synced_seq_(0), written_seq_(0),
+                   dirty_(false), syncs_(0), running_(false) {}
+
+    ~MessageLog() { close(); }
+
+    MessageLog(const MessageLog&) = delete;
+    MessageLog& operator=(const MessageLog&) = delete;
+
+    bool enabled() const { return running_; }
+
+    // 打开 (不存在时创建) 日志目录，恢复未投递的消息并启动同步线程；失败时填写 error
+    bool open(const std::string& dir, size_t segment_size, std::string& error) {
+        dir_ = dir;
+        segment_size_ = std::max<size_t>(segment_size, 64 * 1024);
+        if (mkdir(dir.c_str(), 0755) < 0 && errno != EEXIST) return fail(error, "mkdir " + dir);
+
+        // 1. 按编号顺序恢复已有的分段
+        std::vector<uint64_t> ids;
+        if (DIR* d = opendir(dir.c_str())) {
+            while (dirent* entry = readdir(d)) {
+                unsigned long long id;
+                char suffix[8];
+                if (sscanf(entry->d_name, "%20llu.%7s", &id, suffix) == 2 && strcmp(suffix, "seg") == 0) ids.push_back(id);
+            }
+            closedir(d);
+        }
+        std::sort(ids.begin(), ids.end());
+        std::lock_guard<std::mutex> lock(mtx_);
+        for (uint64_t id : ids) {
+            if (!map_segment(id, false, error)) return false;
+            recover(segments_.back());
+        }
+        // 2. 没有分段时新建一个；最后一个分段继续追加，清掉其末尾写了一半的记录，
+        //    避免之后的追加与残留数据拼出一条"合法"的记录
+        if (segments_.empty() && !roll(error)) return false;
+        Segment& last = segments_.back();
+        memset(last.base + last.used, 0, std::min(segment_size_ - last.used, (size_t)4096));
+        synced_seq_ = written_seq_ = next_seq_ - 1;
+        sync_segment_ = segments_.back().id;
+        sync_offset_ = segments_.back().used;
+        trim_locked();
+
+        running_ = true;
+        sync_thread_ = std::thread(&MessageLog::sync_loop, this);
+        return true;
+    }
+
+    // 停止同步线程 (剩余的数据同步一次) 并解除映射
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            if (!running_) return;
+            running_ = false;
+        }
+        sync_cv_.notify_all();
+        sync_thread_.join();
+        std::lock_guard<std::mutex> lock(mtx_);
+        for (Segment& seg : segments_) unmap_segment(seg);
+        segments_.clear();
+    }
+
+    // 追加一条消息，返回其序号 (0 表示失败：未打开或记录超过分段大小)；数据在 wait_durable 之后才保证落盘
+    uint64_t append(uint32_t user, uint32_t src, uint8_t flags, std::string_view body) {
+        std::unique_lock<std::mutex> lock(mtx_);
+        if (!running_) return 0;
+        uint64_t seq = next_seq_;
+        if (!write_locked(LOG_MESSAGE, flags, seq, user, src, body)) return 0;
+        ++next_seq_;
+        pending_by_user_[user].push_back(Entry{seq, segments_.back().id, segments_.back().used - record_size(body.size())});
+        ++segments_.back().live;
+        ++pending_;
+        written_seq_ = seq;
+        dirty_ = true;
+        lock.unlock();
+        sync_cv_.notify_one();
+        return seq;
+    }
+
+    // 取出某个用户最多 limit 条序号不超过 max_seq 的待投递消息 (按序号)，并记下 DELIVERED；没有时返回 0
+    size_t take_pending(uint32_t user, std::vector<Message>& out, size_t limit, uint64_t max_seq = UINT64_MAX) {
+        std::unique_lock<std::mutex> lock(mtx_);
+        auto it = pending_by_user_.find(user);
+        if (!running_ || it == pending_by_user_.end()) return 0;
+        std::deque<Entry>& entries = it->second;
+        size_t count = 0;
+        uint64_t last = 0;
+        while (!entries.empty() && count < limit && entries.front().seq <= max_seq) {
+            const Entry& entry = entries.front();
+            Segment* seg = find_segment(entry.segment);
+            const LogRecordHeader* rec = reinterpret_cast<const LogRecordHeader*>(seg->base + entry.offset);
+            out.push_back(Message{rec->seq, rec->src, rec->flags, std::string(seg->base + entry.offset + sizeof(*rec), rec->length)});
+            --seg->live;
+            --pending_;
+            last = entry.seq;
+            entries.pop_front();
+            ++count;
+        }
+        if (entries.empty()) pending_by_user_.erase(it);
+        if (count > 0) {
+            if (write_locked(LOG_DELIVERED, 0, last, user, 0, std::string_view())) dirty_ = true;
+            trim_locked();
+            lock.unlock();
+            sync_cv_.notify_one();
+        }
+        return count;
+    }
+
+    // 按批取出 user 在调用时已有的全部待投递消息交给 sink(batch)，返回取出的消息数
+    // sink 可以把消息重新写回日志 (例如转发失败)：写回的消息序号更大，不会在这一轮中再被取出
+    template <typename Sink>
+    size_t take_all(uint32_t user, std::vector<Message>& batch, size_t limit, Sink sink) {
+        uint64_t last = last_seq();
+        size_t total = 0;
+        while (take_pending(user, batch, limit, last) > 0) {
+            sink(batch);
+            total += batch.size();
+            batch.clear();
+        }
+        return total;
+    }
+
+    // 最近一条已写入的消息的序号
+    uint64_t last_seq() {
+        std::lock_guard<std::mutex> lock(mtx_);
+        return next_seq_ - 1;
+    }
+
+    // 等待序号 <= seq 的记录都已同步到磁盘
+    void wait_durable(uint64_t seq) {
+        std::unique_lock<std::mutex> lock(mtx_);
+        durable_cv_.wait(lock, [this, seq]() { return synced_seq_ >= seq || !running_; });
+    }
+
+    size_t pending() {
+        std::lock_guard<std::mutex> lock(mtx_);
+        return pending_;
+    }
+
+    size_t segments() {
+        std::lock_guard<std::mutex> lock(mtx_);
+        return segments_.size();
+    }
+
+    // 已完成的同步次数 (每次覆盖一组记录)
+    uint64_t syncs() {
+        std::lock_guard<std::mutex> lock(mtx_);
+        return syncs_;
+    }
+
+private:
+    struct Segment {
+        uint64_t id;
+        int fd;
+        char* base;
+        size_t used;   // 已写入的字节数 (下一条记录的偏移)
+        size_t live;   // 尚未投递的消息数
+    };
+
+    // 待投递的消息在日志中的位置
+    struct Entry {
+        uint64_t seq;
+        uint64_t segment;
+        size_t offset;
+    };
+
+    static bool fail(std::string& error, const std::string& what) {
+        error = what + ": " + strerror(errno);
+        return false;
+    }
+
+    static size_t record_size(size_t body) { return (sizeof(LogRecordHeader) + body + 7) & ~(size_t)7; }
+
+    std::string segment_path(uint64_t id) const {
+        char name[32];
+        snprintf(name, sizeof(name), "%020llu.seg", (unsigned long long)id);
+        return dir_ + "/" + name;
+    }
+
+    bool map_segment(uint64_t id, bool create, std::string& error) {
+        std::string path = segment_path(id);
+        int fd = ::open(path.c_str(), O_RDWR | O_CLOEXEC | (create ? O_CREAT | O_EXCL : 0), 0644);
+        if (fd < 0) return fail(error, "open " + path);
+        struct stat st;
+        if (fstat(fd, &st) < 0 || ((size_t)st.st_size != segment_size_ && ftruncate(fd, segment_size_) < 0)) {
+            ::close(fd);
+            return fail(error, "ftruncate " + path);
+        }
+        void* base = mmap(nullptr, segment_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (base == MAP_FAILED) {
+            ::close(fd);
+            return fail(error, "mmap " + path);
+        }
+        segments_.push_back(Segment{id, fd, static_cast<char*>(base), 0, 0});
+        return true;
+    }
+
+    void unmap_segment(Segment& seg) {
+        munmap(seg.base, segment_size_);
+        ::close(seg.fd);
+    }
+
+    static uint32_t record_crc(const LogRecordHeader& rec, const char* body) {
+        const char* fields = reinterpret_cast<const char*>(&rec) + 8;
+        uint32_t crc = crc32c(fields, sizeof(rec) - 8);
+        return crc32c(body, rec.length) ^ crc;
+    }
+
+    // 扫描一个分段：校验通过的记录重建待投递索引，遇到空白或损坏的记录即停止 (之后的内容视为未写入)
+    void recover(Segment& seg) {
+        size_t pos = 0;
+        while (pos + sizeof(LogRecordHeader) <= segment_size_) {
+            const LogRecordHeader* rec = reinterpret_cast<const LogRecordHeader*>(seg.base + pos);
+            if (rec->magic != LOG_MAGIC || rec->length > segment_size_ - pos - sizeof(*rec) ||
+                record_crc(*rec, seg.base + pos + sizeof(*rec)) != rec->crc) {
+                break;
+            }
+            if (rec->type == LOG_MESSAGE) {
+                pending_by_user_[rec->user].push_back(Entry{rec->seq, seg.id, pos});
+                ++seg.live;
+                ++pending_;
+            } else if (rec->type == LOG_DELIVERED) {
+                auto it = pending_by_user_.find(rec->user);
+                while (it != pending_by_user_.end() && !it->second.empty() && it->second.front().seq <= rec->seq) {
+                    --find_segment(it->second.front().segment)->live;
+                    --pending_;
+                    it->second.pop_front();
+                }
+                if (it != pending_by_user_.end() && it->second.empty()) pending_by_user_.erase(it);
+            }
+            next_seq_ = std::max(next_seq_, rec->seq + 1);
+            pos += record_size(rec->length);
+        }
+        seg.used = pos;
+    }
+
+    // 新建下一个分段作为追加目标 (调用方持有 mtx_)
+    bool roll(std::string& error) {
+        uint64_t id = segments_.empty() ? 0 : segments_.back().id + 1;
+        return map_segment(id, true, error);
+    }
+
+    // 写入一条记录，当前分段放不下时切换分段 (调用方持有 mtx_)
+    bool write_locked(uint8_t type, uint8_t flags, uint64_t seq, uint32_t user, uint32_t src, std::string_view body) {
+        size_t size = record_size(body.size());
+        if (size > segment_size_) return false;
+        if (segments_.back().used + size > segment_size_) {
+            std::string error;
+            if (!roll(error)) {
+                perror(error.c_str());
+                return false;
+            }
+        }
+        Segment& seg = segments_.back();
+        LogRecordHeader rec;
+        rec.magic = LOG_MAGIC;
+        rec.length = (uint32_t)body.size();
+        rec.type = type;
+        rec.flags = flags;
+        rec.reserved = 0;
+        rec.seq = seq;
+        rec.user = user;
+        rec.src = src;
+        rec.crc = record_crc(rec, body.data());
+        char* dst = seg.base + seg.used;
+        if (!body.empty()) memcpy(dst + sizeof(rec), body.data(), body.size());  // DELIVERED 记录没有 Body
+        memcpy(dst, &rec, sizeof(rec));
+        seg.used += size;
+        return true;
+    }
+
+    Segment* find_segment(uint64_t id) {
+        // 分段按编号连续排列
+        return &segments_[id - segments_.front().id];
+    }
+
+    // 删除最老的、已没有待投递消息且已同步的分段 (保留正在追加的分段；调用方持有 mtx_)
+    void trim_locked() {
+        while (segments_.size() > 1 && segments_.front().live == 0 && segments_.front().id < sync_segment_) {
+            Segment& seg = segments_.front();
+            unmap_segment(seg);
+            unlink(segment_path(seg.id).c_str());
+            segments_.pop_front();
+        }
+    }
+
+    // 组提交：把 (sync_segment_, sync_offset_) 到当前写入位置之间的数据 msync，完成后唤醒等待者
+    void sync_loop() {
+        std::unique_lock<std::mutex> lock(mtx_);
+        while (true) {
+            sync_cv_.wait(lock, [this]() { return dirty_ || !running_; });
+            if (!dirty_) break;  // 已停止且没有未同步的数据
+            dirty_ = false;
+            uint64_t target_seq = written_seq_;
+            uint64_t end_segment = segments_.back().id;
+            size_t end_offset = segments_.back().used;
+            std::vector<std::pair<char*, size_t>> ranges;  // 按页对齐的 [起始地址, 长度)
+            for (uint64_t id = sync_segment_; id <= end_segment; ++id) {
+                Segment* seg = find_segment(id);
+                size_t from = (id == sync_segment_ ? sync_offset_ : 0) & ~(size_t)4095;
+                size_t to = id == end_segment ? end_offset : seg->used;
+                if (to > from) ranges.push_back({seg->base + from, to - from});
+            }
+            // msync 期间放开锁：新的追加进入下一组；正在同步的分段不会被删除 (id >= sync_segment_)
+            lock.unlock();
+            for (auto& range : ranges) {
+                if (msync(range.first, range.second, MS_SYNC) < 0) perror("msync");
+            }
+            lock.lock();
+            sync_segment_ = end_segment;
+            sync_offset_ = end_offset;
+            synced_seq_ = target_seq;
+            ++syncs_;
+            durable_cv_.notify_all();
+            trim_locked();
+        }
+        durable_cv_.notify_all();
+    }
+
+    std::string dir_;
+    size_t segment_size_;
+    std::deque<Segment> segments_;
+    std::unordered_map<uint32_t, std::deque<Entry>> pending_by_user_;
+    uint64_t next_seq_;
+    size_t pending_;
+
+    // 同步进度：(sync_segment_, sync_offset_) 之前的数据已落盘，对应的最大序号为 synced_seq_
+    uint64_t sync_segment_ = 0;
+    size_t sync_offset_ = 0;
+    uint64_t synced_seq_;
+    uint64_t written_seq_;  // 已写入映射区的最大消息序号
+    bool dirty_;            // 上次同步之后有新写入的记录 (包括 DELIVERED)
+    uint64_t syncs_;
+
+    std::mutex mtx_;
+    std::condition_variable sync_cv_;
+    std::condition_variable durable_cv_;
+    bool running_;
+    std::thread sync_thread_;
+};
+
+#endif // MESSAGE_LOG_H
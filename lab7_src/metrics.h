@@ -0,0 +1,264 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+
+// === 运行指标 ===
+// 热路径上的计数器与直方图按线程各存一份：只有所属线程写 (relaxed load + store，没有 lock 前缀的原子指令，
+// 也没有缓存行争用)，读取 /metrics 时才把所有线程的值加起来。线程退出时把自己的值并入 retired，
+// 线程模式下处理线程随连接频繁创建销毁，累计值不会丢失。
+
+// 单写者计数器：只由所属线程累加，其他线程可以随时读取
+class MetricCounter {
+public:
+    void add(uint64_t n = 1) { value_.store(value_.load(std::memory_order_relaxed) + n, std::memory_order_relaxed); }
+    uint64_t get() const { return value_.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint64_t> value_{0};
+};
+
+// 处理耗时直方图的桶上界：1 us, 2 us, 4 us, ..., 32.768 ms，最后一个桶为 +Inf
+const int LATENCY_BUCKETS = 16;
+
+inline uint64_t latency_bucket_bound_ns(int i) { return 1000ull << i; }
+
+// 耗时 ns 落在哪个桶：第一个上界 >= ns 的桶
+inline int latency_bucket(uint64_t ns) {
+    uint64_t us = (ns + 999) / 1000;
+    if (us <= 1) return 0;
+    return std::min(LATENCY_BUCKETS, 64 - __builtin_clzll(us - 1));
+}
+
+template <typename T>
+struct LatencyData {
+    T buckets[LATENCY_BUCKETS + 1]{};  // 各桶自己的计数 (输出时再累加成 Prometheus 的累积形式)
+    T sum_ns{};
+};
+
+// 按类型统计处理耗时的请求：下标为 protocol.h 中的请求类型 (REQ_CONNECT .. REQ_PING)，0 为未知类型
+const int METRIC_MSG_TYPES = 11;
+
+inline const char* metric_type_name(int type) {
+    static const char* const names[METRIC_MSG_TYPES] = {
+        "unknown", "connect", "time", "name", "list", "send_msg", "exit", "broadcast", "multicast", "batch", "ping"};
+    return names[type];
+}
+
+// 转发结果：前四种与 MailResult 一一对应，最后一种为目标不存在
+const int FORWARD_RESULTS = 5;
+const int FORWARD_NOT_FOUND = 4;
+
+inline const char* forward_result_name(int result) {
+    static const char* const names[FORWARD_RESULTS] = {"ok", "rejected", "dropped", "disconnected", "not_found"};
+    return names[result];
+}
+
+// 一组指标：T 为 MetricCounter 时是线程本地的写入端，为 uint64_t 时是汇总结果
+template <typename T>
+struct MetricsData {
+    T frames_in{};      // 解析出的请求包
+    T bytes_in{};       // 请求包的字节数 (Header + Body)
+    T frames_out{};     // 写出的协议包 (应答与转发)
+    T bytes_out{};      // 交给 socket 的字节数
+    T http_requests{};  // 嗅探到的 HTTP 请求
+    T file_cache_hits{};    // 静态文件从缓存中的条目应答
+    T file_cache_misses{};  // 静态文件需要读盘 (加载进缓存或 sendfile)
+    T not_modified{};       // If-None-Match 匹配，回复 304
+    T idle_timeouts{};      // 空闲超时关闭的连接
+    T read_timeouts{};      // 请求未在读超时内收完而关闭的连接
+    T conns_rejected{};     // 超过连接数上限、接收后立即关闭的连接
+    T messages_stored{};    // 目标离线、写入消息日志的消息 (分片各计一次)
+    T messages_replayed{};  // 用户重新连接时从消息日志重放的消息
+    T peer_out{};           // 发往其他节点的包 (集群)
+    T peer_in{};            // 从其他节点收到的包
+    T rate_limited[METRIC_MSG_TYPES]{};  // 超过限流被拒绝的请求 (按类型)
+    T forward[FORWARD_RESULTS]{};
+    LatencyData<T> handle_time[METRIC_MSG_TYPES];
+};
+
+typedef MetricsData<MetricCounter> ThreadMetrics;
+typedef MetricsData<uint64_t> MetricsSnapshot;
+
+// 把一个线程的指标加到汇总结果上
+inline void merge_metrics(MetricsSnapshot& to, const ThreadMetrics& from) {
+    to.frames_in += from.frames_in.get();
+    to.bytes_in += from.bytes_in.get();
+    to.frames_out += from.frames_out.get();
+    to.bytes_out += from.bytes_out.get();
+    to.http_requests += from.http_requests.get();
+    to.file_cache_hits += from.file_cache_hits.get();
+    to.file_cache_misses += from.file_cache_misses.get();
+    to.not_modified += from.not_modified.get();
+    to.idle_timeouts += from.idle_timeouts.get();
+    to.read_timeouts += from.read_timeouts.get();
+    to.conns_rejected += from.conns_rejected.get();
+    to.messages_stored += from.messages_stored.get();
+    to.messages_replayed += from.messages_replayed.get();
+    to.peer_out += from.peer_out.get();
+    to.peer_in += from.peer_in.get();
+    for (int t = 0; t < METRIC_MSG_TYPES; ++t) to.rate_limited[t] += from.rate_limited[t].get();
+    for (int i = 0; i < FORWARD_RESULTS; ++i) to.forward[i] += from.forward[i].get();
+    for (int t = 0; t < METRIC_MSG_TYPES; ++t) {
+        for (int b = 0; b <= LATENCY_BUCKETS; ++b) to.handle_time[t].buckets[b] += from.handle_time[t].buckets[b].get();
+        to.handle_time[t].sum_ns += from.handle_time[t].sum_ns.get();
+    }
+}
+
+// 所有线程的指标块：线程第一次写指标时登记，退出时注销
+class MetricsRegistry {
+public:
+    ThreadMetrics* attach() {
+        ThreadMetrics* metrics = new ThreadMetrics();
+        std::lock_guard<std::mutex> lock(mtx_);
+        live_.push_back(metrics);
+        return metrics;
+    }
+
+    void detach(ThreadMetrics* metrics) {
+        std::lock_guard<std::mutex> lock(mtx_);
+        merge_metrics(retired_, *metrics);
+        live_.erase(std::find(live_.begin(), live_.end(), metrics));
+        delete metrics;
+    }
+
+    // 读取时汇总：已退出线程的累计值 + 每个存活线程的当前值
+    MetricsSnapshot collect() {
+        std::lock_guard<std::mutex> lock(mtx_);
+        MetricsSnapshot total = retired_;
+        for (const ThreadMetrics* metrics : live_) merge_metrics(total, *metrics);
+        return total;
+    }
+
+private:
+    std::mutex mtx_;
+    std::vector<ThreadMetrics*> live_;
+    MetricsSnapshot retired_;
+};
+
+// 有意不析构：进程退出时分离的处理线程可能仍在注销
+inline MetricsRegistry& metrics_registry() {
+    static MetricsRegistry* registry = new MetricsRegistry();
+    return *registry;
+}
+
+// 当前线程的指标块；线程本地对象析构之后的写入落到 discard 上，不再统计
+inline thread_local ThreadMetrics* tls_metrics = nullptr;
+inline ThreadMetrics discard_metrics;
+
+struct ThreadMetricsSlot {
+    ThreadMetrics* metrics;
+    ThreadMetricsSlot() : metrics(metrics_registry().attach()) { tls_metrics = metrics; }
+    ~ThreadMetricsSlot() {
+        tls_metrics = &discard_metrics;
+        metrics_registry().detach(metrics);
+    }
+};
+
+__attribute__((noinline)) inline ThreadMetrics& attach_thread_metrics() {
+    thread_local ThreadMetricsSlot slot;
+    return *tls_metrics;
+}
+
+inline ThreadMetrics& thread_metrics() {
+    ThreadMetrics* metrics = tls_metrics;
+    return metrics ? *metrics : attach_thread_metrics();
+}
+
+inline uint64_t monotonic_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// 记录一次请求的处理耗时
+inline void record_handle_time(uint32_t type, uint64_t ns) {
+    LatencyData<MetricCounter>& data = thread_metrics().handle_time[type < METRIC_MSG_TYPES ? type : 0];
+    data.buckets[latency_bucket(ns)].add();
+    data.sum_ns.add(ns);
+}
+
+// === Prometheus 文本格式 (text/plain; version=0.0.4) ===
+class MetricsWriter {
+public:
+    explicit MetricsWriter(std::string& out) : out_(out) {}
+
+    // 每个指标名先输出一次 HELP 与 TYPE
+    void describe(const char* name, const char* type, const char* help) {
+        out_ += "# HELP ";
+        out_ += name;
+        out_ += ' ';
+        out_ += help;
+        out_ += "\n# TYPE ";
+        out_ += name;
+        out_ += ' ';
+        out_ += type;
+        out_ += '\n';
+    }
+
+    // labels 形如 type="time",le="0.001"，为空时不输出花括号
+    void sample(const std::string& name, const std::string& labels, double value) {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%.9g", value);
+        out_ += name;
+        if (!labels.empty()) {
+            out_ += '{';
+            out_ += labels;
+            out_ += '}';
+        }
+        out_ += ' ';
+        out_ += buf;
+        out_ += '\n';
+    }
+
+    void counter(const char* name, const char* help, uint64_t value) {
+        describe(name, "counter", help);
+        sample_int(name, "", value);
+    }
+
+    void gauge(const char* name, const char* help, uint64_t value) {
+        describe(name, "gauge", help);
+        sample_int(name, "", value);
+    }
+
+    // 输出一个直方图序列 (单位为秒)：桶计数转换为累积形式
+    void histogram(const std::string& name, const std::string& labels, const LatencyData<uint64_t>& data) {
+        std::string prefix = labels.empty() ? "" : labels + ",";
+        uint64_t cumulative = 0;
+        for (int b = 0; b <= LATENCY_BUCKETS; ++b) {
+            cumulative += data.buckets[b];
+            char le[32];
+            if (b < LATENCY_BUCKETS) {
+                snprintf(le, sizeof(le), "%g", latency_bucket_bound_ns(b) / 1e9);
+            } else {
+                snprintf(le, sizeof(le), "+Inf");
+            }
+            sample_int(name + "_bucket", prefix + "le=\"" + le + "\"", cumulative);
+        }
+        sample(name + "_sum", labels, data.sum_ns / 1e9);
+        sample_int(name + "_count", labels, cumulative);
+    }
+
+    void sample_int(const std::string& name, const std::string& labels, uint64_t value) {
+        out_ += name;
+        if (!labels.empty()) {
+            out_ += '{';
+            out_ += labels;
+            out_ += '}';
+        }
+        out_ += ' ';
+        out_ += std::to_string(value);
+        out_ += '\n';
+    }
+
+private:
+    std::string& out_;
+};
+
+#endif // METRICS_H
@@ -0,0 +1,299 @@
+#ifndef OUTPUT_QUEUE_H
+#define OUTPUT_QUEUE_H
+
+#include <string>
+#include <string_view>
+#include <memory>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+#include "protocol.h"
+#include "frame_codec.h"
+#include "buffer_pool.h"
+#include "ring_queue.h"
+#include "metrics.h"
+
+// === 发送队列 ===
+// 每个连接一个，保存尚未写出的包。flush 时把队列中若干个包的 Header 与 Body
+// 组装成一个 iovec 数组，用一次 writev 发出；短写时记录偏移，下次从断点继续。
+// 队列是环形的，出队的槽位连同包体容量留给后续的包复用。
+// 调用方负责加锁 (见 Connection::out_mtx)。
+
+// 序列化好的完整协议包 (Header + Body)，引用计数共享，只读
+// 同一条广播消息只序列化一次，所有接收者的发送队列共享同一块内存。
+// 包缓冲取自 BufferPool，控制块取自 SlabPool，最后一个引用释放时归还到释放线程的池中
+typedef std::shared_ptr<const std::string> SharedFrame;
+
+struct ReleaseToPool {
+    void operator()(const std::string* buf) const { BufferPool::release(const_cast<std::string*>(buf)); }
+};
+
+inline SharedFrame make_frame(uint32_t type, std::string_view body, const WireFormat& wire = WireFormat(),
+                              uint8_t extra_flags = 0) {
+    std::string* frame = BufferPool::acquire();
+    frame->reserve(MAX_HEADER_SIZE + body.size());
+    append_frame(*frame, type, body, wire, 0, extra_flags);
+    return SharedFrame(frame, ReleaseToPool(), SlabAllocator<char>());
+}
+
+// 同一条消息按不同线路格式序列化的结果，按需生成并缓存
+// 广播的接收者可能混用 v1 / v2，每种格式仍只序列化一次
+// Body 在第一次 get 之前通过 body() 填写 (缓冲取自 BufferPool)
+class FrameVariants {
+public:
+    explicit FrameVariants(uint32_t type, uint8_t extra_flags = 0) : type_(type), extra_flags_(extra_flags) {}
+
+    std::string& body() { return *body_; }
+
+    const SharedFrame& get(const WireFormat& wire) {
+        // v2 包头只受校验和与分片两个标志影响 (FLAG_CONTINUATION = 0x04, FLAG_CHECKSUM = 0x08)
+        int index = wire.version < 2 ? 0 : 1 + ((wire.flags & (FLAG_CONTINUATION | FLAG_CHECKSUM)) >> 2);
+        if (!variants_[index]) variants_[index] = make_frame(type_, *body_, wire, extra_flags_);
+        return variants_[index];
+    }
+
+private:
+    uint32_t type_;
+    uint8_t extra_flags_;
+    PooledBuffer body_;
+    SharedFrame variants_[5];  // v1 / v2 的四种标志组合
+};
+
+// 以 sendfile 发送的文件 (HTTP 静态资源)：最后一个引用释放时关闭文件描述符
+struct FileSource {
+    int fd;
+    explicit FileSource(int file_fd) : fd(file_fd) {}
+    ~FileSource() { close(fd); }
+    FileSource(const FileSource&) = delete;
+    FileSource& operator=(const FileSource&) = delete;
+};
+
+typedef std::shared_ptr<FileSource> SharedFile;
+
+// 把文件 [offset, offset + len) 的一部分发到 socket，返回发出的字节数 (语义同 write)
+// Linux 上由 sendfile 直接从页缓存发出，不经过用户态；其他平台退回 pread + send
+inline ssize_t send_file_range(int sock, int file_fd, off_t offset, size_t len) {
+#ifdef __linux__
+    return sendfile(sock, file_fd, &offset, len);
+#else
+    char buf[64 * 1024];
+    ssize_t n = pread(file_fd, buf, std::min(len, sizeof(buf)), offset);
+    if (n <= 0) return n;
+    return send(sock, buf, n, 0);
+#endif
+}
+
+enum FlushResult {
+    FLUSH_DONE,   // 队列已清空
+    FLUSH_AGAIN,  // socket 缓冲区已满 (EAGAIN)，剩余数据保留在队列中
+    FLUSH_ERROR   // 连接出错
+};
+
+class OutputQueue {
+public:
+    OutputQueue() : offset_(0), bytes_(0) {}
+
+    bool empty() const { return items_.empty(); }
+    size_t pending_bytes() const { return bytes_; }
+
+    // 依次访问尚未完整发出的共享包 visit(frame, written)，written 为已发出的字节数 (只有队首可能非 0)
+    // 用于关闭连接时找回未送达的数据
+    template <typename Visitor>
+    void for_each_shared(Visitor visit) const {
+        for (size_t i = 0; i < items_.size(); ++i) {
+            const Item& item = items_.at(i);
+            if (item.shared) visit(item.shared, i == 0 ? offset_ : 0);
+        }
+    }
+
+    // 追加一个协议包 (按连接的线路格式生成包头)
+    // 包体直接拷贝进复用的槽位，槽位的容量足够时没有堆分配
+    void push_frame(uint32_t type, std::string_view body, const WireFormat& wire = WireFormat(),
+                    uint32_t request_id = 0) {
+        Item& item = items_.push_back();
+        item.header_len = encode_header_for(item.header, wire, type, body.data(), body.size(), request_id);
+        item.body.assign(body.data(), body.size());
+        item.frame = true;
+        bytes_ += item.size();
+    }
+
+    // 追加一个共享的已序列化包 (不拷贝)；is_frame 为 false 时是协议包以外的数据 (例如缓存的 HTTP 应答)
+    void push_shared(const SharedFrame& frame, bool is_frame = true) {
+        Item& item = items_.push_back();
+        item.header_len = 0;
+        item.body.clear();
+        item.shared = frame;
+        item.frame = is_frame;
+        bytes_ += item.size();
+    }
+
+    // 追加原始字节 (例如 HTTP 应答)
+    void push_raw(std::string_view data) {
+        Item& item = items_.push_back();
+        item.header_len = 0;
+        item.body.assign(data.data(), data.size());
+        item.frame = false;
+        bytes_ += item.size();
+    }
+
+    // 追加文件的一段，flush 时用 sendfile 发送
+    void push_file(const SharedFile& file, off_t offset, size_t len) {
+        Item& item = items_.push_back();
+        item.header_len = 0;
+        item.body.clear();
+        item.frame = false;
+        item.file = file;
+        item.file_offset = offset;
+        item.file_len = len;
+        bytes_ += item.size();
+    }
+
+    // 尽量写出队列中的数据，多个包合并为一次 writev
+    FlushResult flush(int fd) {
+        struct iovec iov[MAX_IOV];
+        while (!items_.empty()) {
+            // 0. 队首是文件：sendfile 发出，之前的内存数据已经写完
+            Item& front = items_.front();
+            if (front.file) {
+                ssize_t n = send_file_range(fd, front.file->fd, front.file_offset + offset_, front.file_len - offset_);
+                if (n < 0) {
+                    if (errno == EINTR) continue;
+                    if (errno == EAGAIN || errno == EWOULDBLOCK) return FLUSH_AGAIN;
+                    return FLUSH_ERROR;
+                }
+                if (n == 0) return FLUSH_ERROR;  // 文件在发送期间被截断
+                consume(n);
+                continue;
+            }
+
+            // 1. 从队首开始组装 iovec，第一个包可能已经发出了一部分；遇到文件时先停下
+            int iovcnt = 0;
+            size_t skip = offset_;
+            for (size_t i = 0; i < items_.size() && iovcnt + 2 <= MAX_IOV; ++i) {
+                Item& item = items_.at(i);
+                if (item.file) break;
+                if (skip < item.header_len) {
+                    iov[iovcnt].iov_base = item.header + skip;
+                    iov[iovcnt].iov_len = item.header_len - skip;
+                    ++iovcnt;
+                    skip = 0;
+                } else {
+                    skip -= item.header_len;
+                }
+                const std::string& body = item.payload();
+                if (skip < body.size()) {
+                    iov[iovcnt].iov_base = const_cast<char*>(body.data()) + skip;
+                    iov[iovcnt].iov_len = body.size() - skip;
+                    ++iovcnt;
+                }
+                skip = 0;
+            }
+
+            // 2. 一次系统调用发出
+            ssize_t n = writev(fd, iov, iovcnt);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK) return FLUSH_AGAIN;
+                return FLUSH_ERROR;
+            }
+
+            // 3. 弹出已完整发出的包，记录短写的偏移
+            consume(n);
+        }
+        return FLUSH_DONE;
+    }
+
+    // 把队首最多 max 字节拷贝到 out 末尾并出队 (用于异步发送：数据交给内核期间队列仍可继续追加)
+    // 文件用 pread 读入；返回 false 表示文件读取失败
+    bool take(std::string& out, size_t max) {
+        size_t taken = 0;
+        bool ok = true;
+        size_t skip = offset_;
+        for (size_t i = 0; i < items_.size() && taken < max; ++i) {
+            Item& item = items_.at(i);
+            if (skip < item.header_len) {
+                size_t n = std::min(item.header_len - skip, max - taken);
+                out.append(item.header + skip, n);
+                taken += n;
+                skip = 0;
+            } else {
+                skip -= item.header_len;
+            }
+            const std::string& body = item.payload();
+            if (taken < max && skip < body.size()) {
+                size_t n = std::min(body.size() - skip, max - taken);
+                out.append(body.data() + skip, n);
+                taken += n;
+            }
+            if (item.file && taken < max && skip < item.file_len) {
+                size_t n = std::min(item.file_len - skip, max - taken);
+                size_t old_size = out.size();
+                out.resize(old_size + n);
+                ssize_t got = pread(item.file->fd, &out[old_size], n, item.file_offset + skip);
+                if (got != (ssize_t)n) {
+                    out.resize(old_size + std::max<ssize_t>(got, 0));
+                    taken += std::max<ssize_t>(got, 0);
+                    ok = false;
+                    break;
+                }
+                taken += n;
+            }
+            skip = 0;
+        }
+        consume(taken);
+        return ok;
+    }
+
+private:
+    // writev 一次最多携带的 iovec 数 (每个包占 2 个)
+    static const int MAX_IOV = IOV_MAX < 128 ? IOV_MAX : 128;
+    // 槽位中保留的包体容量上限，发送过大包的槽位出队时释放内存
+    static const size_t MAX_KEPT_CAPACITY = 64 * 1024;
+
+    struct Item {
+        char header[MAX_HEADER_SIZE];
+        size_t header_len = 0;  // 0 表示没有单独的包头 (原始字节或共享包)
+        std::string body;
+        SharedFrame shared;     // 非空时发送共享包，忽略 body
+        SharedFile file;        // 非空时发送文件的 [file_offset, file_offset + file_len)，body 为空
+        off_t file_offset = 0;
+        size_t file_len = 0;
+        bool frame = false;     // 是否计入 frames_out (协议包)
+
+        const std::string& payload() const { return shared ? *shared : body; }
+        size_t size() const { return header_len + payload().size() + file_len; }
+    };
+
+    // 出队已交给 socket 的 n 字节，计入发送线程的指标
+    void consume(size_t n) {
+        ThreadMetrics& metrics = thread_metrics();
+        metrics.bytes_out.add(n);
+        bytes_ -= n;
+        n += offset_;
+        while (!items_.empty() && n >= items_.front().size()) {
+            Item& item = items_.front();
+            n -= item.size();
+            if (item.frame) metrics.frames_out.add();
+            // 槽位留给下一个包复用：释放共享包的引用，保留包体容量
+            item.shared.reset();
+            item.file.reset();
+            item.file_len = 0;
+            if (item.body.capacity() > MAX_KEPT_CAPACITY) std::string().swap(item.body);
+            items_.pop_front();
+        }
+        offset_ = n;
+    }
+
+    RingQueue<Item> items_;
+    size_t offset_;  // 队首元素已发出的字节数
+    size_t bytes_;   // 队列中尚未发出的总字节数
+};
+
+#endif // OUTPUT_QUEUE_H
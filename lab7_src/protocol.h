@@ -10,22 +10,40 @@
 // 1. Magic Number: 用于区分 Lab7 协议和 HTTP 协议
 // 'L', 'A', 'B', '7' 的 ASCII 码
 const uint32_t MAGIC_LAB7 = 0x4C414237; 
+// v2 包头魔数：'L', 'A', '7', '2'，双方通过 REQ_CONNECT 协商后才会使用
+const uint32_t MAGIC_LAB7_V2 = 0x4C413732;
 
 // 2. 消息类型定义
 enum MessageType : uint32_t {
     // 请求 (Request)
-    REQ_CONNECT   = 0x01, // 连接/握手
+    REQ_CONNECT   = 0x01, // 连接/握手 (Body: "version=2;flags=N"，响应 RES_OK 携带服务器接受的版本与标志)
     REQ_TIME      = 0x02, // 获取时间
     REQ_NAME      = 0x03, // 获取名字
-    REQ_LIST      = 0x04, // 获取列表
+    REQ_LIST      = 0x04, // 获取列表 (Body 为空：完整列表；"since=N"：版本 N 之后的增量；"offset=K;limit=M"：分页)
     REQ_SEND_MSG  = 0x05, // 发送消息 (Body: "TargetID|Message")
     REQ_EXIT      = 0x06, // 断开连接
+    REQ_BROADCAST = 0x07, // 广播给所有其他在线客户端 (Body: "Message")
+    REQ_MULTICAST = 0x08, // 发送给多个客户端 (Body: "ID1,ID2,...:Message")
+    REQ_BATCH     = 0x09, // 批量请求 (Body: 依次拼接的 N 个完整子请求包)
+    REQ_PING      = 0x0A, // 心跳 (Body 任意，在 RES_PONG 中原样返回)；空闲超时按最近一次收到数据的时刻计算
 
     // 响应 (Response) / 指示 (Indication)
     RES_OK        = 0x10, // 通用成功 (Body: 消息内容)
     RES_ERROR     = 0x11, // 通用失败 (Body: 错误原因)
     RES_LIST      = 0x12, // 列表响应 (Body: 格式化的列表字符串)
-    IND_RECV_MSG  = 0x20  // 收到转发消息 (Body: "SrcID|Message")
+    RES_BATCH     = 0x13, // 批量响应 (Body: 依次拼接的 N 个子响应包，第 i 个对应第 i 个子请求)
+    RES_PONG      = 0x14, // 心跳响应 (Body: 请求的 Body)
+    IND_RECV_MSG  = 0x20, // 收到转发消息 (Body: "SrcID|Message")
+    IND_SHUTDOWN  = 0x21, // 服务器即将关闭 (Body: "drain_ms=N;retry_after_ms=M")：服务器最多再服务 N 毫秒，
+                          // 客户端应在 M 毫秒后重连 (M 按连接随机分散，避免所有客户端同时重连)
+    IND_MSG_ABORT = 0x22, // 分片消息被放弃 (Body: "SrcID")：发送者在最后一个分片之前断开或消息中途出错，
+                          // 接收者丢弃该发送者已收到的分片；只发给协商了 FLAG_CONTINUATION 的客户端
+
+    // 集群节点之间 (v1 包头，只在以 PEER_HELLO 开始的节点间连接上处理，见 cluster.h)
+    PEER_HELLO     = 0x30, // 节点间连接的第一个包 (Body: "node=N;secret=S")，之后该连接只用于接收对端的包，不应答
+    PEER_FORWARD   = 0x31, // 转发点对点消息 (Body: "TargetID:SrcID:Flags|Message"，Flags 为 0、FLAG_CONTINUATION 或 MSG_ABORTED)
+    PEER_BROADCAST = 0x32, // 广播 (Body: "SrcID|Message")，接收节点只投递给本地客户端
+    PEER_LOCATION  = 0x33  // 用户目录与位置更新 (Body: 若干行，"=UserID Name Token" 注册、"+UserID" 上线、"-UserID" 下线)
 };
 
 // 3. 定长包头结构 (12 字节)
@@ -52,7 +70,59 @@ struct PacketHeader {
 };
 #pragma pack(pop)
 
-// 4. 辅助常量
+// 4. v2 包头 (24 字节)：前 12 字节与 v1 布局相同，之后是版本、标志、请求 ID 与校验和
+// 各标志需要在 REQ_CONNECT 中协商，服务器只会使用双方都同意的标志
+enum HeaderFlags : uint8_t {
+    FLAG_COMPRESSED   = 0x01, // Body 已压缩 (预留：当前服务器不支持，协商时不会同意)
+    FLAG_REQUEST_ID   = 0x02, // request_id 有效，响应携带与请求相同的 ID
+    FLAG_CONTINUATION = 0x04, // 后续还有分片 (大消息分片传输)
+    FLAG_CHECKSUM     = 0x08  // checksum 为 Body 的 CRC32C
+};
+
+// 不出现在包头中，只用于消息日志的记录与 PEER_FORWARD：分片消息被放弃 (Body 为空)，投递时变为 IND_MSG_ABORT
+const uint8_t MSG_ABORTED = 0x80;
+
+#pragma pack(push, 1)
+struct PacketHeaderV2 {
+    uint32_t magic;       // 魔数，必须为 MAGIC_LAB7_V2
+    uint32_t type;        // 消息类型 (MessageType)
+    uint32_t length;      // Body 的长度 (不包含 Header 本身)
+    uint8_t  version;     // 协议版本，当前为 2
+    uint8_t  flags;       // HeaderFlags 的组合
+    uint16_t reserved;    // 保留，填 0
+    uint32_t request_id;  // 请求 ID (FLAG_REQUEST_ID)
+    uint32_t checksum;    // Body 的 CRC32C (FLAG_CHECKSUM)
+
+    void host_to_network() {
+        magic = htonl(magic);
+        type = htonl(type);
+        length = htonl(length);
+        reserved = htons(reserved);
+        request_id = htonl(request_id);
+        checksum = htonl(checksum);
+    }
+
+    void network_to_host() {
+        magic = ntohl(magic);
+        type = ntohl(type);
+        length = ntohl(length);
+        reserved = ntohs(reserved);
+        request_id = ntohl(request_id);
+        checksum = ntohl(checksum);
+    }
+};
+#pragma pack(pop)
+
+// 5. 辅助常量
 const size_t HEADER_SIZE = sizeof(PacketHeader);
+const size_t HEADER_V2_SIZE = sizeof(PacketHeaderV2);
+const size_t MAX_HEADER_SIZE = HEADER_V2_SIZE;
+const uint8_t PROTOCOL_VERSION = 2;
+
+// 6. 包大小限制
+// 单个包 Body 的默认上限：包头声明的长度超过上限时直接拒绝，不为其分配内存
+const uint32_t DEFAULT_MAX_FRAME = 1024 * 1024;
+// 大消息按该大小分片发送 (FLAG_CONTINUATION)，服务器收到一个分片就转发一个分片
+const uint32_t FRAGMENT_SIZE = 64 * 1024;
 
 #endif // PROTOCOL_H
\ No newline at end of file
@@ -0,0 +1,36 @@
+#ifndef RATE_LIMIT_H
+#define RATE_LIMIT_H
+
+#include <cstdint>
+
+// === 令牌桶限流 ===
+// 每个连接每种请求类型一个桶，只由连接的拥有者线程访问 (请求总在拥有者线程上处理)，
+// 不需要锁也不需要原子操作。实现为 GCRA (与令牌桶等价)：桶只记一个"理论到达时刻" tat，
+// 每个请求把它推后一个发放间隔，tat 领先当前时刻超过容许的突发量时拒绝；一次检查只有几次整数运算。
+
+struct RateRule {
+    uint32_t rate = 0;   // 每秒发放的令牌数，0 表示不限
+    uint32_t burst = 0;  // 桶容量：空闲一段时间后允许连续通过的请求数
+};
+
+class TokenBucket {
+public:
+    // 取一个令牌 (now_ns 为单调时钟纳秒)；不足时返回 false，retry_ms 为攒够一个令牌还需的毫秒数
+    bool take(const RateRule& rule, uint64_t now_ns, uint64_t& retry_ms) {
+        if (rule.rate == 0) return true;
+        uint64_t interval = 1000000000ull / rule.rate;
+        uint64_t tolerance = interval * (rule.burst > 1 ? rule.burst - 1 : 0);
+        uint64_t tat = tat_ns_ > now_ns ? tat_ns_ : now_ns;  // 第一次使用时桶是满的
+        if (tat - now_ns > tolerance) {
+            retry_ms = (tat - now_ns - tolerance + 999999) / 1000000;
+            return false;
+        }
+        tat_ns_ = tat + interval;
+        return true;
+    }
+
+private:
+    uint64_t tat_ns_ = 0;
+};
+
+#endif // RATE_LIMIT_H
@@ -0,0 +1,54 @@
+#ifndef RING_QUEUE_H
+#define RING_QUEUE_H
+
+#include <vector>
+#include <cstddef>
+#include <utility>
+
+// === 环形队列 ===
+// 代替 std::deque：槽位循环使用，出队时元素不析构，下次入队直接复用
+// (例如字符串成员保留已分配的容量)。只在队列满时扩容，稳态下没有堆分配。
+// 调用方负责在出队前释放元素持有的资源。不加锁。
+template <typename T>
+class RingQueue {
+public:
+    RingQueue() : head_(0), count_(0) {}
+
+    bool empty() const { return count_ == 0; }
+    size_t size() const { return count_; }
+
+    T& front() { return slots_[head_]; }
+    const T& front() const { return slots_[head_]; }
+
+    // 第 i 个元素 (0 为队首)
+    T& at(size_t i) { return slots_[(head_ + i) & (slots_.size() - 1)]; }
+    const T& at(size_t i) const { return slots_[(head_ + i) & (slots_.size() - 1)]; }
+
+    // 在队尾占用一个槽位并返回它 (槽位中可能是上次出队的旧元素，由调用方重新赋值)
+    T& push_back() {
+        if (count_ == slots_.size()) grow();
+        T& slot = at(count_);
+        ++count_;
+        return slot;
+    }
+
+    void pop_front() {
+        head_ = (head_ + 1) & (slots_.size() - 1);
+        --count_;
+    }
+
+private:
+    // 容量翻倍 (始终为 2 的幂)，按队列顺序搬到新数组开头
+    void grow() {
+        std::vector<T> slots(slots_.empty() ? 8 : slots_.size() * 2);
+        for (size_t i = 0; i < count_; ++i) slots[i] = std::move(at(i));
+        slots_.swap(slots);
+        head_ = 0;
+    }
+
+    std::vector<T> slots_;
+    size_t head_;
+    size_t count_;
+};
+
+#endif // RING_QUEUE_H
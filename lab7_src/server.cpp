@@ -4,279 +4,2258 @@
 #include <cstring>
 #include <thread>
 #include <mutex>
-#include <map>
 #include <ctime>
 #include <algorithm>
 #include <atomic>
 #include <csignal>
+#include <memory>
+#include <new>
+#include <cstdlib>
+#include <string_view>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <random>
 #include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include "protocol.h"
+#include "buffer_pool.h"
+#include "connection.h"
+#include "event_loop.h"
+#include "uring_loop.h"
+#include "client_registry.h"
+#include "http_codec.h"
+#include "file_cache.h"
+#include "metrics.h"
+#include "logger.h"
+#include "message_log.h"
+#include "user_directory.h"
+#include "cluster.h"
 
 #define SERVER_PORT 2996
 
-// 全局变量：存储在线客户端 <SocketFD, IP:Port>
-std::map<int, std::string> online_clients;
-std::mutex clients_mtx;
+// 运行模式
+enum ServerMode {
+    MODE_THREAD,  // 每个连接一个线程 (阻塞 I/O)
+    MODE_EPOLL,   // 固定数量的 epoll 事件循环线程 (非阻塞 I/O，仅 Linux)
+    MODE_URING    // 固定数量的 io_uring 事件循环线程 (Linux，编译时需检测到 io_uring；初始化失败时退回 epoll)
+};
 
-// 全局退出标志
+// 集群中的其他节点 (--peer ID=HOST:PORT)
+struct PeerAddress {
+    int node;
+    std::string host;
+    int port;
+};
+
+// 启动参数
+struct ServerConfig {
+    ServerMode mode = MODE_THREAD;
+    int loops = 0;  // 事件循环线程数，0 表示使用 CPU 核数
+    size_t mailbox_capacity = 1024;           // 每个连接转发邮箱的容量 (消息条数)
+    OverflowPolicy overflow = OVERFLOW_REJECT; // 邮箱满时的处理策略
+    uint32_t max_frame = DEFAULT_MAX_FRAME;    // 单个包 Body 的长度上限
+    int drain_timeout = 5;                     // 关闭时排空连接的最长秒数
+    int idle_timeout = 300;                    // 连接多少秒没有收到任何数据即关闭，0 表示不限制
+    int read_timeout = 30;                     // 不完整的请求 (半个包、HTTP 请求头或 Body) 须在多少秒内收完，0 表示不限制
+    int max_conns = 0;                         // 同时打开的连接数上限，0 表示不限制
+
+    // 每个连接按请求类型的限流 (下标同 metric_type_name，{每秒请求数, 突发量})，默认只限制代价高或会放大的请求：
+    // REQ_LIST 遍历在线列表，REQ_BROADCAST / REQ_MULTICAST 一次请求投递多份，REQ_SEND_MSG 的上限远高于正常用量
+    RateRule rate_limits[METRIC_MSG_TYPES] = {{}, {}, {}, {}, {200, 400}, {20000, 40000}, {}, {200, 400}, {200, 400}, {}, {}};
+
+    // 监听与 socket 选项
+    int port = SERVER_PORT;
+    int backlog = SOMAXCONN;   // listen 队列长度 (内核还会按 net.core.somaxconn 截断)
+    int acceptors = 1;         // 接收线程数
+    bool nodelay = true;       // 对连接设置 TCP_NODELAY
+    int sndbuf = 0;            // SO_SNDBUF，0 表示使用系统默认值
+    int rcvbuf = 0;            // SO_RCVBUF，0 表示使用系统默认值
+    int defer_accept = 0;      // TCP_DEFER_ACCEPT 秒数，0 表示关闭 (仅 Linux)
+
+    std::string assets_root;   // HTTP 静态资源目录，默认依次尝试 assets 与 ../assets
+
+    // 离线消息存储：用户目录 DIR/users 与消息日志 DIR/messages，为空表示不存储 (用户身份只保存在内存中)
+    std::string store_dir;
+    size_t store_segment = MessageLog::DEFAULT_SEGMENT_SIZE;  // 消息日志分段大小
+
+    // 集群：本节点编号 (0 表示单机运行)、其他节点的协议端口与节点间的共享密钥 (从文件第一行读取)
+    int node = 0;
+    std::vector<PeerAddress> peers;
+    std::string cluster_secret_file;
+    std::string cluster_secret;
+};
+
+ServerConfig config;
+
+// HTTP 静态文件缓存 (--file-cache MB，0 表示关闭)
+FileCache file_cache;
+
+// 服务器支持的 v2 标志 (REQ_CONNECT 协商时与客户端请求的标志取交集)
+const uint8_t SUPPORTED_FLAGS = FLAG_REQUEST_ID | FLAG_CONTINUATION | FLAG_CHECKSUM;
+
+// 全局变量：存储在线客户端 <SocketFD, 连接>
+ClientRegistry online_clients;
+
+// 稳定身份 (REQ_CONNECT 的 "user=NAME") 与发给离线用户的消息
+UserDirectory users;
+MessageLog message_log;
+// 发送者确认目标离线并写入日志，与目标上线时重放并绑定连接，二者互斥：
+// 否则在重放之后、绑定之前写入的消息要等到下次上线才会投递
+std::mutex offline_mtx;
+// 重放时每次从日志取出的消息数
+const size_t REPLAY_BATCH = 256;
+
+// 集群成员、节点间连接与其他节点上在线用户的位置 (--node / --peer)
+Cluster cluster;
+
+// 分配计数：替换全局 operator new，统计整个进程的堆分配次数
+void* operator new(size_t size) {
+    count_stat(ALLOC_HEAP);
+    if (void* p = malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+// 打印分配统计
+void print_alloc_stats() {
+    uint64_t allocs = alloc_stats.total(ALLOC_HEAP);
+    uint64_t requests = alloc_stats.total(ALLOC_REQUESTS);
+    server_log().log(LOG_INFO, "[Stats] Requests: ", requests, ", heap allocations: ", allocs,
+                     " (", (requests ? (double)allocs / requests : 0.0), " per request)",
+                     ", pool hits: ", alloc_stats.total(ALLOC_POOL_HIT), ", pool misses: ", alloc_stats.total(ALLOC_POOL_MISS));
+}
+
+// 全局退出标志：server_running 为 false 后不再接收新连接；server_draining 为 true 时已通知客户端即将关闭
 std::atomic<bool> server_running(true);
-int server_fd = -1;
+std::atomic<bool> server_draining(false);
+// 线程模式下仍在运行的处理线程数 (关闭时等待它们退出)
+std::atomic<int> active_handlers(0);
+// 已接收、尚未关闭的连接数 (--max-conns 的计数，包括 HTTP 连接)
+std::atomic<int> open_connections(0);
+// 监听 socket (启动后不再修改)
+std::vector<int> listen_fds;
+
+#ifdef __linux__
+// Reactor 模式的事件循环，新连接轮询分配
+std::vector<std::unique_ptr<EventLoop>> event_loops;
+std::atomic<size_t> next_loop(0);
+#ifdef HAVE_IO_URING
+std::vector<std::unique_ptr<UringLoop>> uring_loops;
+#endif
+#endif
+
+// 信号处理：自管道 (self-pipe)。处理函数只记下信号并写管道 (async-signal-safe)，
+// 关闭流程由主线程在 poll 到管道可读后执行
+Waker signal_pipe;
+volatile sig_atomic_t last_signal = 0;
+
+// HTTP 连接排空时关闭：管道写入后不再读取，一直可读，唤醒所有在 poll 中等待的线程模式 HTTP 连接
+Waker drain_pipe;
 
-// 信号处理函数
 void signal_handler(int signum) {
-    std::cout << "\n[Info] Received signal " << signum << ", shutting down server..." << std::endl;
-    server_running = false;
-    
-    // 关闭服务器socket，使accept()返回错误
-    if (server_fd != -1) {
-        close(server_fd);
-        server_fd = -1;
+    int saved_errno = errno;
+    last_signal = signum;
+    signal_pipe.notify();
+    errno = saved_errno;
+}
+
+// GET /metrics：各线程的计数器与直方图在此汇总，队列深度在读取时遍历在线连接采样
+void render_metrics(std::string& out) {
+    MetricsSnapshot m = metrics_registry().collect();
+    MetricsWriter w(out);
+    w.counter("lab7_frames_in_total", "Protocol frames received.", m.frames_in);
+    w.counter("lab7_bytes_in_total", "Bytes of protocol frames received.", m.bytes_in);
+    w.counter("lab7_frames_out_total", "Protocol frames written to sockets (replies and forwarded messages).", m.frames_out);
+    w.counter("lab7_bytes_out_total", "Bytes written to sockets.", m.bytes_out);
+    w.counter("lab7_http_requests_total", "HTTP requests sniffed on the protocol port.", m.http_requests);
+    w.counter("lab7_file_cache_hits_total", "Static files answered from a cached response.", m.file_cache_hits);
+    w.counter("lab7_file_cache_misses_total", "Static files read from disk.", m.file_cache_misses);
+    w.counter("lab7_http_not_modified_total", "Conditional requests answered with 304.", m.not_modified);
+    w.counter("lab7_idle_timeouts_total", "Connections closed after receiving nothing for --idle-timeout seconds.", m.idle_timeouts);
+    w.counter("lab7_read_timeouts_total", "Connections closed with a request still incomplete after --read-timeout seconds.",
+              m.read_timeouts);
+    w.counter("lab7_connections_rejected_total", "Connections refused at accept time because --max-conns was reached.",
+              m.conns_rejected);
+    w.gauge("lab7_open_connections", "Accepted connections not yet closed (protocol and HTTP).", open_connections.load());
+    w.counter("lab7_messages_stored_total", "Messages (or fragments) to offline users appended to the message log.",
+              m.messages_stored);
+    w.counter("lab7_messages_replayed_total", "Stored messages replayed to users on reconnect.", m.messages_replayed);
+    w.gauge("lab7_store_pending_messages", "Messages in the message log not yet replayed.", message_log.pending());
+    if (cluster.enabled()) {
+        w.counter("lab7_peer_frames_out_total", "Frames queued to other cluster nodes.", m.peer_out);
+        w.counter("lab7_peer_frames_in_total", "Frames received from other cluster nodes.", m.peer_in);
+        w.gauge("lab7_cluster_remote_users", "Signed-in users located on other nodes.", cluster.remote_users());
+        w.describe("lab7_cluster_link_up", "gauge", "Whether the outbound link to a node is connected.");
+        for (const auto& link : cluster.links()) {
+            w.sample_int("lab7_cluster_link_up", "node=\"" + std::to_string(link.first) + "\"", link.second->up() ? 1 : 0);
+        }
+        w.describe("lab7_cluster_link_queue_bytes", "gauge", "Bytes queued on the outbound link to a node.");
+        for (const auto& link : cluster.links()) {
+            w.sample_int("lab7_cluster_link_queue_bytes", "node=\"" + std::to_string(link.first) + "\"", link.second->queued());
+        }
+    }
+
+    w.describe("lab7_rate_limited_total", "counter", "Requests refused by the per-connection rate limit by message type.");
+    for (int t = 0; t < METRIC_MSG_TYPES; ++t) {
+        if (config.rate_limits[t].rate == 0 && m.rate_limited[t] == 0) continue;
+        w.sample_int("lab7_rate_limited_total", std::string("type=\"") + metric_type_name(t) + "\"", m.rate_limited[t]);
+    }
+    w.gauge("lab7_file_cache_bytes", "Bytes of file contents held by the static file cache.", file_cache.bytes());
+
+    w.describe("lab7_forward_total", "counter", "Messages posted to recipient mailboxes by result.");
+    for (int i = 0; i < FORWARD_RESULTS; ++i) {
+        w.sample_int("lab7_forward_total", std::string("result=\"") + forward_result_name(i) + "\"", m.forward[i]);
+    }
+
+    w.describe("lab7_handle_seconds", "histogram", "Request handling time by message type.");
+    for (int t = 0; t < METRIC_MSG_TYPES; ++t) {
+        w.histogram("lab7_handle_seconds", std::string("type=\"") + metric_type_name(t) + "\"", m.handle_time[t]);
     }
+
+    // 发送队列只尝试加锁 (与 output_drained 相同)：线程模式下拥有者持锁阻塞在写上，
+    // 等待它会让一个读得慢的客户端卡住整个抓取；这样的连接不计入队列长度，只计数
+    uint64_t clients = 0, mail_total = 0, mail_max = 0, out_total = 0, out_max = 0, out_busy = 0;
+    for (const auto& client : online_clients.snapshot()) {
+        Connection& conn = *client.second;
+        uint64_t mail = conn.mailbox.size();
+        ++clients;
+        mail_total += mail;
+        mail_max = std::max(mail_max, mail);
+        std::unique_lock<std::mutex> lock(conn.out_mtx, std::try_to_lock);
+        if (!lock.owns_lock()) {
+            ++out_busy;
+            continue;
+        }
+        uint64_t pending = conn.out.pending_bytes();
+        lock.unlock();
+        out_total += pending;
+        out_max = std::max(out_max, pending);
+    }
+    w.gauge("lab7_connections", "Online clients.", clients);
+    w.gauge("lab7_mailbox_depth", "Messages waiting in all mailboxes.", mail_total);
+    w.gauge("lab7_mailbox_depth_max", "Deepest single mailbox.", mail_max);
+    w.gauge("lab7_output_queue_bytes", "Bytes waiting in all output queues.", out_total);
+    w.gauge("lab7_output_queue_bytes_max", "Largest single output queue in bytes.", out_max);
+    w.gauge("lab7_output_queue_busy", "Connections whose output queue was locked by a writer and not counted.", out_busy);
+
+    w.counter("lab7_heap_allocations_total", "Global operator new calls.", alloc_stats.total(ALLOC_HEAP));
+    w.counter("lab7_buffer_pool_hits_total", "Buffers reused from the pool.", alloc_stats.total(ALLOC_POOL_HIT));
+    w.counter("lab7_buffer_pool_misses_total", "Buffers allocated because the pool was empty.", alloc_stats.total(ALLOC_POOL_MISS));
+    w.counter("lab7_log_suppressed_total", "Log lines dropped by the rate limit or a full queue.", server_log().suppressed());
 }
 
-// 辅助函数：确保读取指定长度的数据（处理 TCP 拆包）
-bool recv_full(int sock, char* buffer, size_t length) {
-    size_t total_read = 0;
-    while (total_read < length && server_running) {
-        int valread = recv(sock, buffer + total_read, length - total_read, 0);
-        if (valread <= 0) return false; // 连接断开或错误
-        total_read += valread;
+// === HTTP (Lab8 兼容) ===
+// 嗅探到 HTTP 请求后，连接从在线列表中移除，此后按 HTTP/1.1 处理：持久连接、流水线、
+// Content-Length / chunked Body。静态资源取自 assets 目录：小文件经 file_cache 整个应答缓存在内存中，
+// 超过缓存上限的文件用 sendfile 直接从页缓存发出。
+
+// 根路径的桩应答 (Lab8 之前的行为)
+const char HTTP_STUB_BODY[] = "Hello from Lab7 Server (HTTP Mode)";
+// POST /dopost 的登录账号 (与 lab8 服务器的默认值一致)
+const char HTTP_LOGIN_USER[] = "test";
+const char HTTP_LOGIN_PASS[] = "test";
+
+// Lab8 的 URI 映射：外部 URI -> assets 下的文件
+struct UriMapping {
+    const char* external;
+    const char* internal;
+};
+
+const UriMapping HTTP_URI_MAP[] = {
+    {"/index.html", "/html/test.html"},
+    {"/index_noimg.html", "/html/noimg.html"},
+    {"/info/server", "/txt/test.txt"},
+    {"/assets/logo.jpg", "/img/logo.jpg"},
+};
+
+// 请求路径对应的 assets 下的文件：先查映射表，否则按路径直接查找；不允许 ".." 跳出资源目录
+bool resolve_asset(std::string_view path, std::string& file) {
+    if (config.assets_root.empty()) return false;
+    std::string_view internal = path;
+    for (const UriMapping& mapping : HTTP_URI_MAP) {
+        if (path == mapping.external) internal = mapping.internal;
+    }
+    if (internal.size() < 2 || internal.front() != '/' || internal.find('\0') != std::string_view::npos) return false;
+    size_t pos = 0;
+    while (pos != std::string_view::npos) {
+        size_t next = internal.find('/', pos + 1);
+        std::string_view segment = internal.substr(pos + 1, next == std::string_view::npos ? next : next - pos - 1);
+        if (segment == "..") return false;
+        pos = next;
     }
-    return total_read == length;
+    file = config.assets_root;
+    file.append(internal.data(), internal.size());
+    return true;
 }
 
-// 辅助函数：发送协议包
-bool send_packet(int sock, uint32_t type, const std::string& body) {
-    PacketHeader header;
-    header.magic = MAGIC_LAB7;
-    header.type = type;
-    header.length = body.size();
-    header.host_to_network(); // 序列化
+// 表单 Body ("a=1&b=2") 中某个字段的值 (解码 %XX 与 '+')
+std::string form_value(std::string_view body, std::string_view key) {
+    std::string value;
+    size_t pos = 0;
+    while (pos <= body.size()) {
+        size_t amp = std::min(body.find('&', pos), body.size());
+        std::string_view item = body.substr(pos, amp - pos);
+        size_t eq = item.find('=');
+        if (eq != std::string_view::npos && item.substr(0, eq) == key) {
+            std::string_view raw = item.substr(eq + 1);
+            for (size_t i = 0; i < raw.size(); ++i) {
+                if (raw[i] == '+') {
+                    value += ' ';
+                } else if (raw[i] == '%' && i + 2 < raw.size() && isxdigit((unsigned char)raw[i + 1]) &&
+                           isxdigit((unsigned char)raw[i + 2])) {
+                    char hex[3] = {raw[i + 1], raw[i + 2], '\0'};
+                    value += (char)strtol(hex, nullptr, 16);
+                    i += 2;
+                } else {
+                    value += raw[i];
+                }
+            }
+            return value;
+        }
+        pos = amp + 1;
+    }
+    return value;
+}
+
+// 排队一个 Body 在内存中的应答 (HEAD 请求只发头部)
+void queue_http_response(Connection& conn, const HttpRequest& req, int status, const char* content_type,
+                         std::string_view body, std::string_view extra_headers = std::string_view()) {
+    PooledBuffer response;
+    append_http_head(*response, req.version, status, content_type, body.size(), req.keep_alive, extra_headers);
+    if (req.method != "HEAD") response->append(body.data(), body.size());
+    std::lock_guard<std::mutex> lock(conn.out_mtx);
+    conn.out.push_raw(*response);
+}
 
-    // 1. 发送 Header
-    if (send(sock, &header, HEADER_SIZE, 0) < 0) return false;
-    
-    // 2. 发送 Body
-    if (body.size() > 0) {
-        if (send(sock, body.c_str(), body.size(), 0) < 0) return false;
+// 静态文件；文件不存在或不是普通文件返回 false
+bool queue_http_file(Connection& conn, const HttpRequest& req, const std::string& file) {
+    // 1. 缓存中的文件：预先拼好的头部与共享的 Body 直接入队，If-None-Match 匹配时回复 304
+    bool hit = false;
+    std::shared_ptr<const CachedFile> cached = file_cache.get(file, hit);
+    ThreadMetrics& metrics = thread_metrics();
+    if (cached) {
+        (hit ? metrics.file_cache_hits : metrics.file_cache_misses).add();
+        if (etag_matches(req.header("If-None-Match"), cached->etag)) {
+            metrics.not_modified.add();
+            PooledBuffer head;
+            append_http_head(*head, req.version, 304, nullptr, 0, req.keep_alive, "ETag: " + cached->etag + "\r\n");
+            std::lock_guard<std::mutex> lock(conn.out_mtx);
+            conn.out.push_raw(*head);
+            return true;
+        }
+        SharedFrame head = cached->head(req.version, req.keep_alive);
+        std::lock_guard<std::mutex> lock(conn.out_mtx);
+        conn.out.push_shared(head, false);
+        if (req.method != "HEAD" && !cached->body.empty()) conn.out.push_shared(cached_body(cached), false);
+        return true;
     }
+
+    // 2. 不缓存的文件 (过大或缓存关闭)：头部入队后文件以 sendfile 发送
+    // O_NONBLOCK：assets 下的 FIFO / 设备文件在 open 时不会阻塞事件循环，随后按非普通文件拒绝 (404)
+    int fd = open(file.c_str(), O_RDONLY | O_CLOEXEC | O_NONBLOCK);
+    if (fd < 0) return false;
+    SharedFile source = std::make_shared<FileSource>(fd);
+    struct stat st;
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) return false;
+
+    metrics.file_cache_misses.add();
+    PooledBuffer head;
+    append_http_head(*head, req.version, 200, http_content_type(file), st.st_size, req.keep_alive);
+    std::lock_guard<std::mutex> lock(conn.out_mtx);
+    conn.out.push_raw(*head);
+    if (req.method != "HEAD" && st.st_size > 0) conn.out.push_file(source, 0, st.st_size);
     return true;
 }
 
-// 处理 HTTP 请求 (Lab8 预留桩代码)
-void handle_http(int sock) {
-    char buffer[4096];
-    recv(sock, buffer, sizeof(buffer), 0); // 简单读走数据
-    std::string response = "HTTP/1.0 200 OK\r\nContent-Type: text/plain\r\n\r\nHello from Lab7 Server (HTTP Mode)";
-    send(sock, response.c_str(), response.size(), 0);
+// 处理一个完整的 HTTP 请求：应答只入队，由 process_http 在本批次结束时统一发出
+void handle_http_request(Connection& conn, const HttpRequest& req) {
+    thread_metrics().http_requests.add();
+    std::string_view path = req.path();
+    bool read_only = req.method == "GET" || req.method == "HEAD";
+    if (read_only && path == "/metrics") {
+        // Prometheus 文本格式
+        PooledBuffer body;
+        render_metrics(*body);
+        queue_http_response(conn, req, 200, "text/plain; version=0.0.4", *body);
+    } else if (read_only && path == "/") {
+        queue_http_response(conn, req, 200, "text/plain", HTTP_STUB_BODY);
+    } else if (read_only) {
+        std::string file;
+        if (!resolve_asset(path, file) || !queue_http_file(conn, req, file)) {
+            queue_http_response(conn, req, 404, "text/plain", "Not Found");
+        }
+    } else if (req.method == "POST" && path == "/dopost") {
+        bool ok = form_value(req.body, "login") == HTTP_LOGIN_USER && form_value(req.body, "pass") == HTTP_LOGIN_PASS;
+        queue_http_response(conn, req, 200, "text/html",
+                            ok ? "<html><body>Login Success</body></html>" : "<html><body>Login Failed</body></html>");
+    } else if (req.method == "POST") {
+        queue_http_response(conn, req, 404, "text/plain", "Not Found");
+    } else {
+        queue_http_response(conn, req, 405, "text/plain", "Method Not Allowed", "Allow: GET, HEAD, POST\r\n");
+    }
+}
+
+// 解析读缓冲中所有完整的 HTTP 请求 (流水线上的多个请求按顺序应答，合并为一次写)
+// 请求要求关闭连接或格式错误时，应答写完后关闭，之后的输入全部丢弃。返回 false 表示连接出错
+bool process_http(Connection& conn) {
+    HttpParser& parser = *conn.http;
+    bool closing = false;
+    cork(conn);
+    while (!closing) {
+        HttpParseStatus status = parser.parse(conn.rbuf);
+        if (status == HTTP_NEED_MORE) break;
+        if (status == HTTP_ERROR) {
+            HttpRequest& req = parser.request();
+            if (req.version.empty()) req.version = "HTTP/1.1";
+            req.keep_alive = false;
+            queue_http_response(conn, req, parser.error_status(), "text/plain", parser.error_reason());
+            closing = true;
+        } else {
+            if (server_draining) parser.request().keep_alive = false;  // 排空期间应答后关闭
+            handle_http_request(conn, parser.request());
+            closing = !parser.request().keep_alive;
+            parser.reset();
+        }
+    }
+    if (closing) {
+        conn.rbuf.clear();
+        std::lock_guard<std::mutex> lock(conn.out_mtx);
+        conn.close_after_flush = true;
+    }
+    return uncork(conn);
+}
+
+// 把连接切换为 HTTP：不再出现在在线列表中，也不再接收转发消息
+void switch_to_http(Connection& conn) {
+    online_clients.remove(cluster.client_key(conn.fd), &conn);
+    std::vector<Mail> dropped; // 移除之前已投递的转发消息不能混入 HTTP 应答
+    conn.mailbox.drain(dropped, SIZE_MAX);
+    conn.http.reset(new HttpParser(config.max_frame));
+    log_info("Client ", conn.addr, " switched to HTTP.");
+}
+
+// 连接建立时请求已经到达且是 HTTP (例如开启 --defer-accept 后的 /metrics 抓取)
+bool peek_http(int fd) {
+    char head[4];
+    return recv(fd, head, sizeof(head), MSG_PEEK | MSG_DONTWAIT) == (ssize_t)sizeof(head) && is_http_request(head);
 }
 
-// 客户端处理线程
-void client_handler(int client_sock, std::string client_addr) {
-    // 注册客户端
+// 服务器关闭通知：retry_after_ms 在排空时间内随机分散，客户端不会在同一时刻一起重连
+void send_shutdown_notice(Connection& conn) {
+    thread_local std::mt19937 rng(std::random_device{}());
+    int drain_ms = config.drain_timeout * 1000;
+    int retry_ms = drain_ms > 0 ? (int)(rng() % (uint32_t)drain_ms) : 0;
+    std::string body = "drain_ms=" + std::to_string(drain_ms) + ";retry_after_ms=" + std::to_string(retry_ms);
+    post_notice(conn, make_frame(IND_SHUTDOWN, body, conn.wire()));
+}
+
+// 接收时的准入控制：超过 --max-conns 时回复 RES_ERROR (v1 格式，带建议的重试等待) 后立即关闭，
+// 不创建连接对象也不占用处理线程；返回 true 时连接已计入 open_connections，由 close_client 扣除
+void refuse_connection(int client_sock) {
+    thread_metrics().conns_rejected.add();
+    std::string busy;
+    append_frame(busy, RES_ERROR, "Server busy, retry_after_ms=1000.");
+    ssize_t ret = send(client_sock, busy.data(), busy.size(), MSG_DONTWAIT | MSG_NOSIGNAL);
+    (void)ret;
+    close(client_sock);
+}
+
+bool admit_connection(int client_sock) {
+    // 集群中匿名客户端的 ID 为 (节点 << NODE_SHIFT) | fd：更大的 fd 会混进节点编号，消息被路由到别的节点
+    // (启动时已把 RLIMIT_NOFILE 限制在这以下，这里只是兜底)
+    if (cluster.enabled() && client_sock > NODE_FD_MASK) {
+        refuse_connection(client_sock);
+        log_warn("Descriptor ", client_sock, " does not fit in a cluster client ID, refusing a new connection.");
+        return false;
+    }
+    int count = open_connections.fetch_add(1) + 1;
+    if (config.max_conns == 0 || count <= config.max_conns) return true;
+    open_connections.fetch_sub(1);
+    refuse_connection(client_sock);
+    log_warn("Connection limit (", config.max_conns, ") reached, refusing a new connection.");
+    return false;
+}
+
+// 注册客户端并发送欢迎消息
+void register_client(const std::shared_ptr<Connection>& conn) {
+    online_clients.add(cluster.client_key(conn->fd), conn);
+    log_info("Client ", conn->addr, " (ID:", cluster.client_key(conn->fd), ") connected.");
+
+    // 发送欢迎消息 (Lab7 Test 1 要求)；HTTP 请求不发，应答前不能混入二进制的协议包
+    if (!peek_http(conn->fd)) send_packet(*conn, RES_OK, "Welcome to Lab7 Server (Protocol v1.0)");
+    // 排空开始前刚接收的连接 (线程模式下处理线程可能晚于通知才登记)
+    if (server_draining) send_shutdown_notice(*conn);
+}
+
+void sign_out(Connection& conn);
+void abort_stream(Connection& conn);
+void requeue_replayed(Connection& conn);
+
+// 注销并关闭客户端
+// 先从表中移除再 close：close 之后 fd 编号可能立即被新连接复用
+void close_client(const std::shared_ptr<Connection>& conn) {
+    online_clients.remove(cluster.client_key(conn->fd), conn.get());
+    if (conn->user_id) sign_out(*conn);
+    if (conn->peer_node && cluster.remove_inbound(conn->peer_node, conn.get())) {
+        size_t dropped = cluster.drop_node(conn->peer_node);
+        log_warn("Cluster node ", conn->peer_node, " disconnected, ", dropped, " remote user(s) now offline.");
+    }
     {
-        std::lock_guard<std::mutex> lock(clients_mtx);
-        online_clients[client_sock] = client_addr;
+        std::lock_guard<std::mutex> lock(conn->out_mtx);
+        if (conn->closed) return;
+        conn->closed = true;
     }
-    std::cout << "[Info] Client " << client_addr << " (ID:" << client_sock << ") connected." << std::endl;
+    // 发送者在分片消息的最后一个分片之前断开
+    if (conn->streaming && !conn->stream_failed) abort_stream(*conn);
+    requeue_replayed(*conn);
+    {
+        std::lock_guard<std::mutex> lock(conn->fd_mtx);
+        close(conn->fd);
+    }
+    open_connections.fetch_sub(1);
+    log_info("Client ", conn->addr, " disconnected.");
+}
 
-    // 发送欢迎消息 (Lab7 Test 1 要求)
-    send_packet(client_sock, RES_OK, "Welcome to Lab7 Server (Protocol v1.0)");
+// === 业务逻辑 ===
+// 请求 Body 以 string_view 形式直接指向接收缓冲，原地解析，不拷贝；
+// 应答直接拷贝进发送队列复用的槽位，临时字符串取自线程本地的缓冲池。
 
-    bool is_running = true; // 控制循环的标志
+// 一次请求的上下文：应答写回发送者的发送队列，或在批处理中收集到批量响应里
+struct RequestContext {
+    Connection& conn;
+    uint32_t request_id;     // v2 请求 ID，应答原样带回；0 表示没有
+    uint8_t flags;           // 请求包的 v2 标志
+    std::string* batch_out;  // 非空表示正在处理 REQ_BATCH 的子请求
+    bool replied;
 
-    while (is_running && server_running) {
-        // === 协议嗅探与边界识别 ===
-        char header_buf[HEADER_SIZE];
-        
-        // 1. 使用 MSG_PEEK 偷看头部，不从缓冲区移除
-        int peek_len = recv(client_sock, header_buf, HEADER_SIZE, MSG_PEEK);
-        if (peek_len <= 0) break; // 断开
-
-        // 2. 检查是否为 HTTP (Lab8 兼容)
-        if (peek_len >= 4) {
-            if (strncmp(header_buf, "GET ", 4) == 0 || strncmp(header_buf, "POST", 4) == 0) {
-                std::cout << "[Info] Detected HTTP Request from " << client_sock << std::endl;
-                handle_http(client_sock);
-                is_running = false; // 处理完 HTTP 后退出循环
-                continue;
+    explicit RequestContext(Connection& c, uint32_t id = 0, uint8_t f = 0, std::string* out = nullptr)
+        : conn(c), request_id(id), flags(f), batch_out(out), replied(false) {}
+};
+
+// 回复当前请求
+void reply(RequestContext& ctx, uint32_t type, std::string_view body) {
+    ctx.replied = true;
+    if (ctx.batch_out) {
+        append_frame(*ctx.batch_out, type, body, ctx.conn.wire(), ctx.request_id);
+    } else {
+        send_packet(ctx.conn, type, body, ctx.request_id);
+    }
+}
+
+// 转发给其他客户端的消息 Body: "SrcID|Message"
+void fill_forward_body(FrameVariants& fwd, int src, std::string_view message) {
+    std::string& body = fwd.body();
+    append_int(body, src);
+    body += '|';
+    body.append(message.data(), message.size());
+}
+
+// 把 PEER_FORWARD / PEER_BROADCAST 中的消息投递给本地连接
+// MSG_ABORTED 投递为 IND_MSG_ABORT；接收者没有协商分片时每个分片都是独立的消息，无需通知
+bool deliver_local(Connection& target, int src, uint8_t flags, std::string_view message) {
+    if (flags & MSG_ABORTED) {
+        if (!(target.wire().flags & FLAG_CONTINUATION)) return true;
+        FrameVariants abort(IND_MSG_ABORT);
+        append_int(abort.body(), src);
+        return post_mail(target, abort.get(target.wire()), config.overflow) == MAIL_OK;
+    }
+    FrameVariants fwd(IND_RECV_MSG, flags);
+    fill_forward_body(fwd, src, message);
+    return post_mail(target, fwd.get(target.wire()), config.overflow) == MAIL_OK;
+}
+
+// 转发消息中的发送者 ID：注册了用户名的连接用稳定的用户 ID，否则用 fd (集群中带节点编号)
+int client_id(const Connection& conn) {
+    return conn.user_id ? (int)conn.user_id : cluster.client_key(conn.fd);
+}
+
+// 发往其他节点的点对点消息，Body: "TargetID:SrcID:Flags|Message"；节点未连接时返回 false
+bool forward_remote(int node, uint32_t target, int src, uint8_t flags, std::string_view message) {
+    PooledBuffer body;
+    append_int(*body, target);
+    *body += ':';
+    append_int(*body, src);
+    *body += ':';
+    append_int(*body, flags);
+    *body += '|';
+    body->append(message.data(), message.size());
+    // 中止标记在连接断开期间也排队：之前的分片可能保留在出向连接中，重连后重发
+    if (!cluster.send(node, PEER_FORWARD, *body, (flags & MSG_ABORTED) != 0)) return false;
+    thread_metrics().peer_out.add();
+    return true;
+}
+
+// 向所有节点发布一条目录 / 位置更新："=UserID Name Token"、"+UserID" 或 "-UserID"
+void publish_user(char op, uint32_t user, std::string_view name = std::string_view(), std::string_view token = std::string_view()) {
+    if (!cluster.enabled()) return;
+    PooledBuffer line;
+    *line += op;
+    append_int(*line, user);
+    if (!name.empty()) {
+        *line += ' ';
+        line->append(name.data(), name.size());
+    }
+    if (!token.empty()) {
+        *line += ' ';
+        line->append(token.data(), token.size());
+    }
+    thread_metrics().peer_out.add(cluster.send_all(PEER_LOCATION, *line));
+}
+
+// 按批取出用户 (及其别名) 的离线消息交给 sink，返回取出的消息数
+template <typename Sink>
+size_t take_offline(uint32_t user, Sink sink) {
+    thread_local std::vector<MessageLog::Message> batch; // 线程本地复用
+    if (!message_log.enabled()) return 0;
+    std::vector<uint32_t> ids = users.aliases(user);
+    ids.insert(ids.begin(), user);
+    size_t total = 0;
+    for (uint32_t id : ids) total += message_log.take_all(id, batch, REPLAY_BATCH, sink);
+    if (total > 0) thread_metrics().messages_replayed.add(total);
+    return total;
+}
+
+// 重放的消息所在的共享缓冲使用的删除器：连接关闭时据此 (std::get_deleter) 认出尚未写出的重放消息
+struct ReplayRelease : ReleaseToPool {};
+
+// 把用户的离线消息投递到连接的邮箱 (不受邮箱容量限制，排在已入队的消息之后)
+// 每 MAIL_BATCH 条消息序列化进同一块共享缓冲，作为一封邮件入队；返回重放的消息数
+// 取出时即记下 DELIVERED，连接在写出之前关闭的，由 requeue_replayed 写回日志
+size_t replay_offline(uint32_t user, Connection& conn) {
+    WireFormat wire = conn.wire();
+    PooledBuffer body;
+    return take_offline(user, [&](std::vector<MessageLog::Message>& batch) {
+        for (size_t i = 0; i < batch.size(); i += MAIL_BATCH) {
+            std::string* frames = BufferPool::acquire();
+            for (size_t j = i; j < std::min(batch.size(), i + MAIL_BATCH); ++j) {
+                const MessageLog::Message& msg = batch[j];
+                body->clear();
+                append_int(*body, msg.src);
+                if (msg.flags & MSG_ABORTED) {
+                    if (wire.flags & FLAG_CONTINUATION) append_frame(*frames, IND_MSG_ABORT, *body, wire);
+                    continue;
+                }
+                *body += '|';
+                *body += msg.body;
+                append_frame(*frames, IND_RECV_MSG, *body, wire, 0, msg.flags);
             }
+            bool was_empty = false;
+            conn.mailbox.push(Mail(SharedFrame(frames, ReplayRelease(), SlabAllocator<char>())), was_empty, true);
+            if (was_empty && conn.notify_mail) conn.notify_mail();
         }
+    });
+}
 
-        // 3. 检查是否为 Lab7 协议
-        // 必须读够 12 字节才能判断完整的 Header
-        if (peek_len < (int)HEADER_SIZE) { 
-             // 还没收够头部的长度，继续等待下一次循环（实际高并发可能需要更复杂的缓冲逻辑，此处简化）
-             continue; 
+// 用户在其他节点上线：把本节点为它存下的消息经节点间连接发过去 (调用方持有 offline_mtx)，返回转发的消息数
+// 连接已断开或发送队列已满时，这一条及之后的消息按原顺序写回日志，等下次上线 (take_all 不会在本轮中再取出它们)
+size_t replay_remote(uint32_t user, int node) {
+    size_t forwarded = 0;
+    bool failed = false;
+    take_offline(user, [&](std::vector<MessageLog::Message>& batch) {
+        for (const MessageLog::Message& msg : batch) {
+            if (!failed && forward_remote(node, user, msg.src, msg.flags, msg.body)) {
+                ++forwarded;
+            } else {
+                failed = true;
+                message_log.append(user, msg.src, msg.flags, msg.body);
+            }
         }
+    });
+    return forwarded;
+}
 
-        PacketHeader* peek_header = (PacketHeader*)header_buf;
-        // 注意：peek 到的数据是网络字节序，需要转换来检查
-        if (ntohl(peek_header->magic) != MAGIC_LAB7) {
-            std::cerr << "[Error] Unknown protocol magic. Closing." << std::endl;
-            break;
+// 连接关闭时仍在邮箱或发送队列中的重放消息写回消息日志，下次上线时再次重放 (调用方已解除用户绑定)
+// 已写出一部分的包整体写回，接收者可能收到重复的消息；用户期间已在其他连接上线的，立即重放过去
+void requeue_replayed(Connection& conn) {
+    if (!conn.user_id || !message_log.enabled()) return;
+    std::vector<std::pair<SharedFrame, size_t>> unsent;
+    {
+        std::lock_guard<std::mutex> lock(conn.out_mtx);
+        conn.out.for_each_shared([&](const SharedFrame& frame, size_t written) {
+            if (std::get_deleter<ReplayRelease>(frame)) unsent.emplace_back(frame, written);
+        });
+        std::vector<Mail> mail;
+        conn.mailbox.drain(mail, SIZE_MAX);
+        for (Mail& frame : mail) {
+            if (std::get_deleter<ReplayRelease>(frame)) unsent.emplace_back(std::move(frame), 0);
+        }
+    }
+    if (unsent.empty()) return;
+
+    std::lock_guard<std::mutex> lock(offline_mtx);
+    uint32_t user = users.canonical(conn.user_id);
+    if (user == 0) user = conn.user_id;
+    size_t requeued = 0;
+    for (const auto& item : unsent) {
+        const std::string& frames = *item.first;
+        Frame frame;
+        for (size_t pos = 0; pos < frames.size(); pos += frame.size()) {
+            if (decode_frame(frames.data() + pos, frames.size() - pos, frame) != DECODE_FRAME) break;
+            if (pos + frame.size() <= item.second) continue;  // 已完整写出
+            std::string_view body(frame.body, frame.header.length);
+            size_t bar = std::min(body.find('|'), body.size());
+            int src;
+            if (!parse_int(body.substr(0, bar), src)) continue;
+            bool aborted = frame.header.type == IND_MSG_ABORT;
+            std::string_view message = aborted ? std::string_view() : body.substr(std::min(bar + 1, body.size()));
+            uint8_t flags = aborted ? MSG_ABORTED : (uint8_t)(frame.flags & FLAG_CONTINUATION);
+            if (message_log.append(user, (uint32_t)src, flags, message) != 0) ++requeued;
+        }
+    }
+    if (requeued > 0) log_info("Requeued ", requeued, " unsent replayed message(s) for user ", user, ".");
+    std::shared_ptr<Connection> online;
+    int node;
+    if ((online = users.online(user))) {
+        replay_offline(user, *online);
+    } else if ((node = cluster.location(user)) != 0) {
+        replay_remote(user, node);
+    }
+}
+
+// REQ_CONNECT 的 "user=NAME;token=HEX"：注册 (或找回) 用户 ID 并记到连接上 (调用方持有 offline_mtx)
+// 首次注册时新令牌写入 issued，由调用方放进应答；成功后由调用方应答、切换线路格式，再调用 bring_online
+const char* sign_in(Connection& conn, std::string_view name, std::string_view token, uint32_t& user, std::string& issued) {
+    if (!UserDirectory::valid_name(name)) return "Invalid user name.";
+    std::shared_ptr<Connection> self = online_clients.find(cluster.client_key(conn.fd));
+    if (self.get() != &conn) return "Not a protocol connection.";
+    // 1. 已在其他连接上登录时先拒绝：补发给旧记录的令牌不能随错误应答丢掉
+    std::shared_ptr<Connection> bound;
+    if ((user = users.lookup(name)) != 0 && (((bound = users.online(user)) && bound != self) || cluster.location(user))) {
+        return "User already online.";
+    }
+    // 2. 核对令牌，首次注册时生成令牌并发布给其他节点
+    UserEntry entry;
+    switch (users.register_name(name, token, user, entry)) {
+        case REGISTER_OK: break;
+        case REGISTER_BAD_TOKEN:
+            log_warn("Client ", conn.addr, " (ID:", conn.fd, ") presented a wrong token for user ", name, ".");
+            return "Invalid token.";
+        case REGISTER_FAILED: return "User directory unavailable.";
+    }
+    if (!entry.token.empty()) publish_user('=', entry.id, entry.name, entry.token);
+    issued = entry.token;
+    // 3. 与其他节点同时注册时名字可能改为对应另一个 ID，按保留的 ID 再检查一次
+    if (((bound = users.online(user)) && bound != self) || cluster.location(user)) return "User already online.";
+    if (conn.user_id && conn.user_id != user && users.unbind(users.canonical(conn.user_id), &conn)) {
+        publish_user('-', users.canonical(conn.user_id));
+    }
+    conn.user_id = user;
+    log_info("Client ", conn.addr, " (ID:", conn.fd, ") signed in as ", name, " (ID:", user, ").");
+    return nullptr;
+}
+
+// 用户上线：先重放日志中的消息再绑定连接 (调用方持有 offline_mtx)，之后的消息直接投递，不会排到重放的消息之前；
+// 重放的消息经邮箱发送，总是排在 REQ_CONNECT 的应答之后
+// 集群中随后向所有节点发布上线，各节点把为该用户存下的消息转发过来
+void bring_online(Connection& conn) {
+    size_t replayed = replay_offline(conn.user_id, conn);
+    if (replayed > 0) log_info("Replayed ", replayed, " stored message(s) to user ", conn.user_id, ".");
+    users.bind(conn.user_id, online_clients.find(cluster.client_key(conn.fd)));
+    publish_user('+', conn.user_id);
+}
+
+// 连接关闭：解除用户绑定并向其他节点发布下线 (持有 offline_mtx，与上线、节点同步的发布保持顺序)
+void sign_out(Connection& conn) {
+    std::lock_guard<std::mutex> lock(offline_mtx);
+    uint32_t user = users.canonical(conn.user_id);
+    if (users.unbind(user, &conn)) publish_user('-', user);
+}
+
+// 消息目标的位置 (三者至多一个有效)
+struct Route {
+    std::shared_ptr<Connection> target;  // 本节点上在线的连接
+    uint32_t offline_user = 0;           // 离线的用户：消息写入消息日志
+    int node = 0;                        // 目标在其他节点上 (集群)，remote_id 为发给该节点的目标 ID
+    uint32_t remote_id = 0;
+};
+
+// 解析 REQ_SEND_MSG 的目标：临时 ID (fd，集群中带节点编号)、用户 ID (>= USER_ID_BASE) 或 "@用户名"
+// 出错时返回错误信息
+const char* resolve_target(std::string_view text, Route& route) {
+    uint32_t user = 0;
+    if (!text.empty() && text.front() == '@') {
+        user = users.lookup(text.substr(1));
+    } else {
+        int id;
+        if (!parse_int(text, id)) return "Invalid ID format.";
+        if (id >= 0 && (uint32_t)id < USER_ID_BASE) {
+            int node = cluster.node_of(id);
+            if (cluster.enabled() && node != cluster.self() && cluster.is_peer(node)) {
+                route.node = node;
+                route.remote_id = (uint32_t)id;
+                return nullptr;
+            }
+            route.target = online_clients.find(id);
+            if (route.target) return nullptr;
+        } else if (id > 0) {
+            user = users.canonical((uint32_t)id);
+        }
+    }
+    if (user == 0 || !users.known(user)) {
+        thread_metrics().forward[FORWARD_NOT_FOUND].add();
+        return "User not found.";
+    }
+    route.target = users.online(user);
+    if (route.target) return nullptr;
+    if ((route.node = cluster.location(user)) != 0) {
+        route.remote_id = user;
+        return nullptr;
+    }
+    if (!message_log.enabled()) {
+        thread_metrics().forward[FORWARD_NOT_FOUND].add();
+        return "User offline.";
+    }
+    route.offline_user = user;
+    return nullptr;
+}
+
+bool handle_packet(RequestContext& ctx, const PacketHeader& header, std::string_view body);
+
+// 按连接与请求类型限流：超出时回复 RES_ERROR 与建议的重试等待，请求不排队
+// 被拒绝的是分片消息的首个分片时，丢弃其余分片 (由 forward_message 按 stream_failed 处理)
+bool admit_request(RequestContext& ctx, uint32_t type) {
+    int index = type < METRIC_MSG_TYPES ? type : 0;
+    const RateRule& rule = config.rate_limits[index];
+    if (rule.rate == 0) return true;
+    uint64_t retry_ms = 0;
+    if (ctx.conn.buckets[index].take(rule, monotonic_ns(), retry_ms)) return true;
+    thread_metrics().rate_limited[index].add();
+    if (type == REQ_SEND_MSG && (ctx.flags & FLAG_CONTINUATION)) {
+        ctx.conn.streaming = true;
+        ctx.conn.stream_failed = true;
+    }
+    reply(ctx, RES_ERROR, "Rate limited, retry_after_ms=" + std::to_string(retry_ms) + ".");
+    return false;
+}
+
+// 分片消息在最后一个分片之前中止 (转发出错、分片损坏或发送者断开)：已转发的分片不会再有结尾，
+// 沿同一路线补发放弃标记——本地接收者收到 IND_MSG_ABORT，其他节点上的目标经 PEER_FORWARD 转交，
+// 离线用户的消息日志中追加一条放弃记录，重放时同样通知 (目标期间已上线的，立即重放)
+void abort_stream(Connection& conn) {
+    int src = client_id(conn);
+    if (conn.stream_user) {
+        std::lock_guard<std::mutex> lock(offline_mtx);
+        uint32_t user = conn.stream_user;
+        std::shared_ptr<Connection> online;
+        int node;
+        if (message_log.append(user, src, MSG_ABORTED, std::string_view()) == 0) {
+            log_warn("Failed to store abort of a fragmented message to user ", user, ".");
+        } else if ((online = users.online(user))) {
+            replay_offline(user, *online);
+        } else if ((node = cluster.location(user)) != 0) {
+            replay_remote(user, node);
         }
+    } else if (conn.stream_node) {
+        forward_remote(conn.stream_node, conn.stream_remote, src, MSG_ABORTED, std::string_view());
+    } else if (std::shared_ptr<Connection> target = conn.stream_target.lock()) {
+        deliver_local(*target, src, MSG_ABORTED, std::string_view());
+    }
+    conn.stream_target.reset();
+    conn.stream_user = 0;
+    conn.stream_node = 0;
+    conn.stream_remote = 0;
+}
 
-        // === 正式读取数据 ===
-        // 1. 确认是 Lab7 协议，正式将 Header 从缓冲区读走
-        if (!recv_full(client_sock, header_buf, HEADER_SIZE)) break;
-        PacketHeader header = *(PacketHeader*)header_buf;
-        header.network_to_host(); // 反序列化
+// 转发 REQ_SEND_MSG：Body 格式 "TargetID:Message"，TargetID 也可以是用户 ID 或 "@用户名"
+// 大消息分片发送：除最后一个分片外都带 FLAG_CONTINUATION，后续分片的 Body 只有消息内容。
+// 每个分片到达后立即转发，服务器不拼接整条消息；转发给目标的每个分片都带 "SrcID|" 前缀，
+// 协商了分片的接收者按发送者重组，其他接收者把每个分片当作一条独立的消息。
+// 整条消息只应答一次：出错时立即应答并丢弃剩余分片 (已转发过分片的，由 abort_stream 通知接收者放弃)，
+// 成功时在最后一个分片之后应答。
+// 已注册的用户离线时 (需要 --store) 消息逐个分片写入消息日志，上线时重放；应答在写入映射区后发出，
+// 不等待组提交落盘。
+// 目标在其他集群节点上时每个分片作为 PEER_FORWARD 交给到该节点的连接，进入发送队列即应答。
+void forward_message(RequestContext& ctx, std::string_view body) {
+    Connection& conn = ctx.conn;
+    bool more = (ctx.flags & FLAG_CONTINUATION) != 0;
+    bool first = !conn.streaming;
+    conn.streaming = more;
 
-        // 2. 读取 Body
-        std::string body;
-        if (header.length > 0) {
-            std::vector<char> body_buf(header.length); 
-            if (!recv_full(client_sock, body_buf.data(), header.length)) break;
-            body.assign(body_buf.data(), header.length);
+    // 1. 该消息已报告过错误
+    if (conn.stream_failed) {
+        conn.stream_failed = more;
+        return;
+    }
+
+    // 2. 首个分片 (或未分片的消息) 解析目标，后续分片沿用
+    Route route;
+    size_t content_pos = 0;
+    const char* error = nullptr;
+    if (first) {
+        size_t delim = body.find(':');
+        if (delim == std::string_view::npos) {
+            error = "Format error (ID:Msg).";
+        } else {
+            error = resolve_target(body.substr(0, delim), route);
+            content_pos = delim + 1;
+        }
+    } else if (conn.stream_user) {
+        route.offline_user = conn.stream_user;
+    } else if (conn.stream_node) {
+        route.node = conn.stream_node;
+        route.remote_id = conn.stream_remote;
+    } else {
+        route.target = conn.stream_target.lock();
+        if (!route.target) {
+            error = "User not found.";
+            thread_metrics().forward[FORWARD_NOT_FOUND].add();
         }
+    }
+
+    // 3. 目标离线：持有 offline_mtx 确认仍离线后写入消息日志；首个分片确认时目标已上线 (本节点或其他节点)
+    //    则改为直接投递。已开始写入日志的分片消息继续写入日志 (保持分片顺序)，目标期间上线的，
+    //    最后一个分片写入后立即重放
+    if (!error && route.offline_user) {
+        std::lock_guard<std::mutex> lock(offline_mtx);
+        uint32_t user = route.offline_user;
+        if (first && ((route.target = users.online(user)) || (route.node = cluster.location(user)) != 0)) {
+            route.offline_user = 0;
+            route.remote_id = user;
+        } else if (message_log.append(user, client_id(conn), more ? FLAG_CONTINUATION : 0, body.substr(content_pos)) == 0) {
+            error = "Message store unavailable.";
+        } else {
+            thread_metrics().messages_stored.add();
+            std::shared_ptr<Connection> online;
+            int node;
+            if (!first && !more) {
+                if ((online = users.online(user))) {
+                    replay_offline(user, *online);
+                } else if ((node = cluster.location(user)) != 0) {
+                    replay_remote(user, node);
+                }
+            }
+        }
+    }
+    if (first) {
+        conn.stream_target = route.target;
+        conn.stream_user = route.offline_user;
+        conn.stream_node = route.node;
+        conn.stream_remote = route.remote_id;
+    }
 
-        // === 业务逻辑 ===
-        switch (header.type) {
-            case REQ_TIME: {
-                time_t now = time(0);
-                std::string t(ctime(&now));
-                if (!t.empty()) t.pop_back();
-                send_packet(client_sock, RES_OK, t);
+    // 4. 目标在其他节点上：交给到该节点的连接
+    if (!error && route.node) {
+        if (!forward_remote(route.node, route.remote_id, client_id(conn), more ? FLAG_CONTINUATION : 0,
+                            body.substr(content_pos))) {
+            error = "Node unreachable.";
+        }
+    }
+
+    // 5. 投递到目标的邮箱，由目标的拥有者线程发送
+    if (!error && route.target) {
+        std::shared_ptr<Connection>& target = route.target;
+        FrameVariants fwd(IND_RECV_MSG, more ? FLAG_CONTINUATION : 0);
+        fill_forward_body(fwd, client_id(conn), body.substr(content_pos));
+        switch (post_mail(*target, fwd.get(target->wire()), config.overflow)) {
+            case MAIL_OK:
+                break;
+            case MAIL_REJECTED:
+                error = "Recipient mailbox full, retry later.";
+                break;
+            case MAIL_DROPPED:
+                error = "Recipient mailbox full, message dropped.";
+                break;
+            case MAIL_DISCONNECTED:
+                error = "Recipient too slow, disconnected.";
                 break;
+        }
+    }
+
+    if (error) {
+        reply(ctx, RES_ERROR, error);
+        if (!first) abort_stream(conn);
+        conn.stream_failed = more;
+    } else if (!more) {
+        reply(ctx, RES_OK, route.offline_user ? "Stored for offline delivery." : "Sent.");
+    }
+    if (!more) {
+        conn.stream_target.reset();
+        conn.stream_user = 0;
+        conn.stream_node = 0;
+        conn.stream_remote = 0;
+    }
+}
+
+// 处理 REQ_LIST：应答从当前在线列表快照的各页拷贝，不再逐行拼接
+// Body 为空：完整列表 (原格式)
+// "since=N"：版本 N 之后的变更，首行 "version=V;delta"，之后每行 "+ID\tAddress" 或 "-ID"；
+//            变更日志已覆盖不到 N 时首行为 "version=V;full"，之后是全部行
+// "offset=K;limit=M"：分页，首行 "version=V;total=T;offset=K"，之后最多 M 行
+void handle_list(RequestContext& ctx, std::string_view body) {
+    std::shared_ptr<const ListSnapshot> snap = online_clients.list_snapshot();
+    PooledBuffer out;
+    if (body.empty()) {
+        out->reserve(snap->bytes + 16);
+        *out = "ID\tAddress\n";
+        snap->append_rows(*out, 0, snap->row_count());
+        reply(ctx, RES_LIST, *out);
+        return;
+    }
+
+    uint64_t since, version;
+    size_t offset = 0, limit = 0;
+    bool has_offset = find_option(body, "offset", offset);
+    bool has_limit = find_option(body, "limit", limit);
+    if (find_option(body, "since", since)) {
+        PooledBuffer changes;
+        *out = "version=";
+        if (online_clients.changes_since(since, *changes, version)) {
+            append_int(*out, version);
+            *out += ";delta\n";
+            *out += *changes;
+        } else {
+            append_int(*out, snap->version);
+            *out += ";full\n";
+            snap->append_rows(*out, 0, snap->row_count());
+        }
+    } else if (has_offset || has_limit) {
+        offset = std::min(offset, snap->row_count());
+        if (!has_limit) limit = snap->row_count();
+        *out = "version=";
+        append_int(*out, snap->version);
+        *out += ";total=";
+        append_int(*out, snap->row_count());
+        *out += ";offset=";
+        append_int(*out, offset);
+        *out += '\n';
+        snap->append_rows(*out, offset, offset + std::min(limit, snap->row_count() - offset));
+    } else {
+        reply(ctx, RES_ERROR, "Format error (since=N or offset=K;limit=M).");
+        return;
+    }
+    reply(ctx, RES_LIST, *out);
+}
+
+// 处理批量请求：逐个执行子请求，所有子响应按顺序拼成一个 RES_BATCH 包
+void handle_batch(RequestContext& ctx, std::string_view body) {
+    PooledBuffer replies;
+    size_t pos = 0;
+    while (pos < body.size()) {
+        Frame sub;
+        DecodeStatus status = decode_frame(body.data() + pos, body.size() - pos, sub);
+        if (status != DECODE_FRAME && status != DECODE_BAD_CHECKSUM) {
+            reply(ctx, RES_ERROR, "Malformed batch.");
+            return;
+        }
+        RequestContext sub_ctx(ctx.conn, sub.request_id, sub.flags, replies.get());
+        if (status == DECODE_BAD_CHECKSUM) {
+            reply(sub_ctx, RES_ERROR, "Checksum mismatch.");
+        } else if (sub.header.type == REQ_BATCH || sub.header.type == REQ_EXIT || sub.header.type == REQ_CONNECT ||
+                   sub.header.type == PEER_HELLO || (sub.flags & FLAG_CONTINUATION)) {
+            reply(sub_ctx, RES_ERROR, "Not allowed in batch.");
+        } else {
+            handle_packet(sub_ctx, sub.header, std::string_view(sub.body, sub.header.length));
+            // 保证子响应与子请求一一对应
+            if (!sub_ctx.replied) reply(sub_ctx, RES_ERROR, "No response.");
+        }
+        pos += sub.size();
+    }
+    reply(ctx, RES_BATCH, *replies);
+}
+
+// === 集群：节点间连接的接收端 ===
+
+// 处理 PEER_HELLO ("node=N;secret=S")：对端节点的出向连接表明身份，之后该连接只用于接收节点间的包
+// 连接从在线列表中移除 (不计入 LIST / 广播)；节点不在 --peer 列表中、源地址不是该节点的地址或密钥不符时
+// 在改动任何集群状态之前拒绝并断开
+bool accept_peer(RequestContext& ctx, std::string_view body) {
+    Connection& conn = ctx.conn;
+    int node = 0;
+    std::string_view secret;
+    std::string_view ip = std::string_view(conn.addr).substr(0, conn.addr.rfind(':'));
+    std::shared_ptr<Connection> self = online_clients.find(cluster.client_key(conn.fd));
+    if (!cluster.enabled() || !find_option(body, "node", node) || node == cluster.self() || !cluster.is_peer(node) ||
+        self.get() != &conn || conn.user_id) {
+        log_warn("Rejected cluster connection from ", conn.addr, ": unknown node.");
+        reply(ctx, RES_ERROR, "Unknown cluster node.");
+        return false;
+    }
+    if (!find_option(body, "secret", secret) || !cluster.authenticate(node, ip, secret)) {
+        log_warn("Rejected cluster connection from ", conn.addr, " claiming to be node ", node, ": authentication failed.");
+        reply(ctx, RES_ERROR, "Unknown cluster node.");
+        return false;
+    }
+    online_clients.remove(cluster.client_key(conn.fd), &conn);
+    conn.peer_node = node;
+    // 重连的节点随后重新同步在线用户，旧的位置全部作废
+    cluster.drop_node(node);
+    cluster.add_inbound(node, self);
+    log_info("Cluster node ", node, " connected from ", conn.addr, ".");
+    return true;
+}
+
+// PEER_FORWARD："TargetID:SrcID:Flags|Message"
+// 目标是本节点的匿名客户端或在线用户时直接投递；用户已离线时 (位置更新还在路上) 写入本节点的消息日志，
+// 已转移到另一个节点时再转发一次；都不满足时丢弃 (发送者已收到 "Sent.")
+void handle_peer_forward(int node, std::string_view body) {
+    size_t bar = body.find('|');
+    size_t c1 = body.find(':');
+    size_t c2 = c1 == std::string_view::npos ? c1 : body.find(':', c1 + 1);
+    int target_id, src, flags;
+    if (bar == std::string_view::npos || c2 == std::string_view::npos || c2 > bar ||
+        !parse_int(body.substr(0, c1), target_id) || !parse_int(body.substr(c1 + 1, c2 - c1 - 1), src) ||
+        !parse_int(body.substr(c2 + 1, bar - c2 - 1), flags)) {
+        log_warn("Malformed PEER_FORWARD from node ", node, ".");
+        return;
+    }
+    std::string_view message = body.substr(bar + 1);
+    uint8_t frame_flags = (uint8_t)(flags & (FLAG_CONTINUATION | MSG_ABORTED));
+
+    std::shared_ptr<Connection> target;
+    uint32_t user = 0;
+    if (target_id >= 0 && (uint32_t)target_id < USER_ID_BASE) {
+        target = online_clients.find(target_id);
+    } else if ((user = users.canonical((uint32_t)target_id)) != 0) {
+        target = users.online(user);
+    }
+    if (target) {
+        deliver_local(*target, src, frame_flags, message);
+        return;
+    }
+    if (user) {
+        std::lock_guard<std::mutex> lock(offline_mtx);
+        int moved;
+        if ((target = users.online(user))) {
+            deliver_local(*target, src, frame_flags, message);
+            return;
+        }
+        if ((moved = cluster.location(user)) != 0 && moved != node && forward_remote(moved, user, src, frame_flags, message)) {
+            return;
+        }
+        if (message_log.enabled() && message_log.append(user, (uint32_t)src, frame_flags, message) != 0) {
+            thread_metrics().messages_stored.add();
+            return;
+        }
+    }
+    thread_metrics().forward[FORWARD_NOT_FOUND].add();
+}
+
+// PEER_LOCATION：逐行应用用户目录与位置更新
+// 用户在对端上线时，把本节点为它存下的离线消息转发过去
+void handle_peer_location(int node, std::string_view body) {
+    size_t pos = 0;
+    while (pos < body.size()) {
+        size_t end = std::min(body.find('\n', pos), body.size());
+        std::string_view line = body.substr(pos, end - pos);
+        pos = end + 1;
+        if (line.size() < 2) continue;
+        size_t space = std::min(line.find(' '), line.size());
+        int id;
+        if (!parse_int(line.substr(1, space - 1), id) || (uint32_t)id < USER_ID_BASE) continue;
+        uint32_t user = (uint32_t)id;
+        if (line[0] == '=') {
+            uint32_t renamed_from = 0;
+            if (space >= line.size()) continue;
+            std::string_view name = line.substr(space + 1), token;
+            size_t token_pos = name.find(' ');
+            if (token_pos != std::string_view::npos) {
+                token = name.substr(token_pos + 1);
+                name = name.substr(0, token_pos);
             }
-            case REQ_NAME: {
-                char hostname[128];
-                gethostname(hostname, sizeof(hostname));
-                send_packet(client_sock, RES_OK, std::string(hostname));
+            if (users.merge(user, name, token, renamed_from) && renamed_from) {
+                cluster.rename_location(renamed_from, users.canonical(user));
+            }
+        } else if (line[0] == '+') {
+            if ((user = users.canonical(user)) == 0) continue;
+            std::lock_guard<std::mutex> lock(offline_mtx);
+            cluster.set_location(user, node);
+            size_t replayed = replay_remote(user, node);
+            if (replayed > 0) log_info("Forwarded ", replayed, " stored message(s) to user ", user, " on node ", node, ".");
+        } else if (line[0] == '-') {
+            if ((user = users.canonical(user)) == 0) continue;
+            std::lock_guard<std::mutex> lock(offline_mtx);
+            cluster.clear_location(user, node);
+        }
+    }
+}
+
+// 处理对端节点发来的包 (不限流、不应答)
+bool handle_peer_packet(RequestContext& ctx, const PacketHeader& header, std::string_view body) {
+    int node = ctx.conn.peer_node;
+    thread_metrics().peer_in.add();
+    switch (header.type) {
+        case PEER_FORWARD: {
+            handle_peer_forward(node, body);
+            break;
+        }
+        case PEER_BROADCAST: {
+            // Body 格式: "SrcID|Message"，只投递给本节点的客户端
+            size_t bar = body.find('|');
+            int src;
+            if (bar == std::string_view::npos || !parse_int(body.substr(0, bar), src)) {
+                log_warn("Malformed PEER_BROADCAST from node ", node, ".");
                 break;
             }
-            case REQ_LIST: {
-                std::string list_str = "ID\tAddress\n";
-                {
-                    std::lock_guard<std::mutex> lock(clients_mtx);
-                    for (const auto& client : online_clients) {
-                        list_str += std::to_string(client.first) + "\t" + client.second + "\n";
-                    }
+            FrameVariants fwd(IND_RECV_MSG);
+            fill_forward_body(fwd, src, body.substr(bar + 1));
+            for (const auto& client : online_clients.snapshot()) {
+                post_mail(*client.second, fwd.get(client.second->wire()), config.overflow);
+            }
+            break;
+        }
+        case PEER_LOCATION: {
+            handle_peer_location(node, body);
+            break;
+        }
+        case REQ_PING: {
+            break;  // 心跳，收到数据时已刷新空闲计时
+        }
+        case REQ_EXIT: {
+            return false;
+        }
+        default:
+            log_warn("Unknown cluster Msg Type: ", header.type, " from node ", node, ".");
+    }
+    return true;
+}
+
+// 到某个节点的出向连接建立 (在该连接的发送线程上)：同步本节点的用户目录与在线用户
+// 持有 offline_mtx，与上线 / 下线的发布保持先后顺序
+void on_link_up(PeerLink& link) {
+    const size_t CHUNK = 60 * 1024;
+    std::lock_guard<std::mutex> lock(offline_mtx);
+    std::string lines;
+    auto flush = [&](bool force) {
+        if (lines.empty() || (!force && lines.size() < CHUNK)) return;
+        if (link.send(PEER_LOCATION, lines)) thread_metrics().peer_out.add();
+        lines.clear();
+    };
+    for (const auto& entry : users.entries()) {
+        lines += '=';
+        append_int(lines, entry.id);
+        lines += ' ';
+        lines += entry.name;
+        if (!entry.token.empty()) {
+            lines += ' ';
+            lines += entry.token;
+        }
+        lines += '\n';
+        flush(false);
+    }
+    for (uint32_t user : users.online_ids()) {
+        lines += '+';
+        append_int(lines, user);
+        lines += '\n';
+        flush(false);
+    }
+    flush(true);
+}
+
+// 处理一个完整的协议包，返回 false 表示客户端请求断开
+bool handle_packet(RequestContext& ctx, const PacketHeader& header, std::string_view body) {
+    int client_sock = cluster.client_key(ctx.conn.fd);
+    // 节点间连接与 PEER_HELLO 不经过限流
+    if (ctx.conn.peer_node) return handle_peer_packet(ctx, header, body);
+    if (header.type == PEER_HELLO) return accept_peer(ctx, body);
+    // 分片消息只在首个分片计入限流；REQ_EXIT 不受限
+    if (header.type != REQ_EXIT && !(header.type == REQ_SEND_MSG && ctx.conn.streaming) && !admit_request(ctx, header.type)) {
+        return true;
+    }
+    switch (header.type) {
+        case REQ_CONNECT: {
+            // Body 格式: "version=2;flags=N[;user=NAME[;token=HEX]]"，应答仍使用旧格式，之后双方切换到协商结果
+            // 带用户名时注册稳定身份，应答末尾附加 ";id=UserID" (首次注册时再附加 ";token=HEX")，随后重放离线期间存下的消息
+            WireFormat wire;
+            int version = 1, flags = 0;
+            if (find_option(body, "version", version) && version >= PROTOCOL_VERSION) wire.version = PROTOCOL_VERSION;
+            if (find_option(body, "flags", flags)) wire.flags = (uint8_t)flags;
+            wire.flags = wire.version >= 2 ? (wire.flags & SUPPORTED_FLAGS) : 0;
+            std::string_view name, token;
+            std::string issued;
+            uint32_t user = 0;
+            std::unique_lock<std::mutex> lock(offline_mtx, std::defer_lock);
+            if (find_option(body, "user", name)) {
+                find_option(body, "token", token);
+                lock.lock();
+                if (const char* error = sign_in(ctx.conn, name, token, user, issued)) {
+                    reply(ctx, RES_ERROR, error);
+                    break;
                 }
-                send_packet(client_sock, RES_LIST, list_str);
+            }
+            std::string result = "version=" + std::to_string(wire.version) + ";flags=" + std::to_string(wire.flags);
+            if (user) result += ";id=" + std::to_string(user);
+            if (!issued.empty()) result += ";token=" + issued;
+            reply(ctx, RES_OK, result);
+            ctx.conn.set_wire(wire);
+            if (user) bring_online(ctx.conn);
+            break;
+        }
+        case REQ_TIME: {
+            time_t now = time(0);
+            char t[32];
+            ctime_r(&now, t); // 格式固定，末尾带换行符
+            reply(ctx, RES_OK, std::string_view(t, strcspn(t, "\n")));
+            break;
+        }
+        case REQ_NAME: {
+            char hostname[128];
+            gethostname(hostname, sizeof(hostname));
+            hostname[sizeof(hostname) - 1] = '\0';
+            reply(ctx, RES_OK, hostname);
+            break;
+        }
+        case REQ_LIST: {
+            handle_list(ctx, body);
+            break;
+        }
+        case REQ_SEND_MSG: {
+            forward_message(ctx, body);
+            break;
+        }
+        case REQ_BROADCAST: {
+            // Body 格式: "Message"，转发包只序列化一次，所有接收者共享；集群中同时发给各节点，
+            // 由它们投递给各自的客户端 (应答中的计数只含本节点)
+            FrameVariants fwd(IND_RECV_MSG);
+            fill_forward_body(fwd, client_id(ctx.conn), body);
+            size_t total = 0, delivered = 0;
+            for (const auto& client : online_clients.snapshot()) {
+                if (client.first == client_sock) continue;
+                ++total;
+                if (post_mail(*client.second, fwd.get(client.second->wire()), config.overflow) == MAIL_OK) ++delivered;
+            }
+            PooledBuffer result;
+            *result = "Broadcast to ";
+            append_int(*result, delivered);
+            *result += '/';
+            append_int(*result, total);
+            *result += " client(s)";
+            if (cluster.enabled()) {
+                PooledBuffer relay;
+                append_int(*relay, client_id(ctx.conn));
+                *relay += '|';
+                relay->append(body.data(), body.size());
+                size_t nodes = cluster.send_all(PEER_BROADCAST, *relay);
+                thread_metrics().peer_out.add(nodes);
+                *result += ", ";
+                append_int(*result, nodes);
+                *result += " node(s)";
+            }
+            *result += '.';
+            reply(ctx, RES_OK, *result);
+            break;
+        }
+        case REQ_MULTICAST: {
+            // Body 格式: "ID1,ID2,...:Message"，ID 可以是 fd 或用户 ID (只投递给在线的用户，不写入消息日志)
+            // 在其他节点上的目标逐个转发，交给节点间连接即计为已投递
+            size_t delim = body.find(':');
+            if (delim == std::string_view::npos) {
+                reply(ctx, RES_ERROR, "Format error (ID1,ID2,...:Msg).");
                 break;
             }
-            case REQ_SEND_MSG: {
-                // Body 格式: "TargetID:Message"
-                size_t delim = body.find(':');
-                if (delim != std::string::npos) {
-                    try {
-                        int target_id = std::stoi(body.substr(0, delim));
-                        std::string msg_content = body.substr(delim + 1);
-                        bool sent = false;
-                        
-                        // 查找目标并转发
-                        {
-                            std::lock_guard<std::mutex> lock(clients_mtx);
-                            if (online_clients.count(target_id)) {
-                                std::string fwd = std::to_string(client_sock) + "|" + msg_content;
-                                send_packet(target_id, IND_RECV_MSG, fwd);
-                                sent = true;
-                            }
-                        }
-                        
-                        // 回复发送者结果
-                        send_packet(client_sock, sent ? RES_OK : RES_ERROR, sent ? "Sent." : "User not found.");
-                    } catch (...) {
-                        send_packet(client_sock, RES_ERROR, "Invalid ID format.");
-                    }
+            thread_local std::vector<int> targets; // 线程本地复用
+            targets.clear();
+            bool valid = true;
+            size_t pos = 0;
+            while (valid && pos < delim) {
+                size_t comma = std::min(body.find(',', pos), delim);
+                int target_id;
+                valid = parse_int(body.substr(pos, comma - pos), target_id);
+                if (valid) targets.push_back(target_id);
+                pos = comma + 1;
+            }
+            if (!valid) {
+                reply(ctx, RES_ERROR, "Invalid ID format.");
+                break;
+            }
+            std::sort(targets.begin(), targets.end());
+            targets.erase(std::unique(targets.begin(), targets.end()), targets.end());
+
+            FrameVariants fwd(IND_RECV_MSG);
+            fill_forward_body(fwd, client_id(ctx.conn), body.substr(delim + 1));
+            size_t delivered = 0;
+            for (int target_id : targets) {
+                std::shared_ptr<Connection> target;
+                int node = 0;
+                if (target_id >= (int)USER_ID_BASE) {
+                    uint32_t user = users.canonical(target_id);
+                    if (!(target = users.online(user)) && (node = cluster.location(user)) != 0) target_id = (int)user;
+                } else if (cluster.enabled() && cluster.node_of(target_id) != cluster.self()) {
+                    node = cluster.is_peer(cluster.node_of(target_id)) ? cluster.node_of(target_id) : 0;
                 } else {
-                    send_packet(client_sock, RES_ERROR, "Format error (ID:Msg).");
+                    target = online_clients.find(target_id);
+                }
+                if (node) {
+                    if (forward_remote(node, target_id, client_id(ctx.conn), 0, body.substr(delim + 1))) ++delivered;
+                } else if (!target) {
+                    thread_metrics().forward[FORWARD_NOT_FOUND].add();
+                } else if (post_mail(*target, fwd.get(target->wire()), config.overflow) == MAIL_OK) {
+                    ++delivered;
                 }
-                break;
             }
-            case REQ_EXIT: {
-                is_running = false; // 退出循环
+            PooledBuffer result;
+            *result = "Sent to ";
+            append_int(*result, delivered);
+            *result += '/';
+            append_int(*result, targets.size());
+            *result += " client(s).";
+            reply(ctx, delivered == targets.size() ? RES_OK : RES_ERROR, *result);
+            break;
+        }
+        case REQ_BATCH: {
+            handle_batch(ctx, body);
+            break;
+        }
+        case REQ_PING: {
+            reply(ctx, RES_PONG, body);  // 收到数据时已刷新空闲计时
+            break;
+        }
+        case REQ_EXIT: {
+            return false; // 退出循环
+        }
+        default:
+            log_warn("Unknown Msg Type: ", header.type);
+    }
+    return true;
+}
+
+// 连接上允许的最大包长：节点间的包在客户端消息之外带有目标与发送者 ID
+uint32_t frame_limit(const Connection& conn) {
+    return conn.peer_node ? config.max_frame + PEER_FRAME_SLACK : config.max_frame;
+}
+
+// 处理解码出的一个包 (包括校验和错误的包)，返回 false 表示客户端请求断开
+// 处理耗时按请求类型记入当前线程的直方图 (REQ_BATCH 计整批)
+bool handle_frame(Connection& conn, const Frame& frame, DecodeStatus status) {
+    count_stat(ALLOC_REQUESTS);
+    ThreadMetrics& metrics = thread_metrics();
+    metrics.frames_in.add();
+    metrics.bytes_in.add(frame.size());
+    RequestContext ctx(conn, frame.request_id, frame.flags);
+    if (status == DECODE_BAD_CHECKSUM) {
+        bool forwarding = conn.streaming && !conn.stream_failed;
+        if (corrupt_fragment(conn, frame.header.type, frame.flags)) reply(ctx, RES_ERROR, "Checksum mismatch.");
+        if (forwarding) abort_stream(conn);
+        return true;
+    }
+    uint64_t start = monotonic_ns();
+    bool keep = handle_packet(ctx, frame.header, std::string_view(frame.body, frame.header.length));
+    record_handle_time(frame.header.type, monotonic_ns() - start);
+    return keep;
+}
+
+// === 超时 ===
+// 空闲超时从最近一次收到数据算起；读超时从读缓冲开始残留不完整的请求算起，防止慢速发送占住连接。
+// 事件循环模式由时间轮驱动，线程模式直接用作 poll 的超时。
+
+// 处理完读到的数据后更新连接的计时
+void track_input(Connection& conn, bool got_data) {
+    uint64_t now = monotonic_ms();
+    if (got_data) conn.last_read_ms = now;
+    bool partial = conn.rbuf.size() > 0 || (conn.http && conn.http->in_body());
+    if (!partial) {
+        conn.partial_since_ms = 0;
+    } else if (conn.partial_since_ms == 0) {
+        conn.partial_since_ms = now;
+    }
+}
+
+// 连接的下一个超时时刻 (单调时钟毫秒)，0 表示没有
+uint64_t connection_deadline(Connection& conn) {
+    uint64_t deadline = 0;
+    if (config.idle_timeout > 0) deadline = conn.last_read_ms + config.idle_timeout * 1000ull;
+    if (config.read_timeout > 0 && conn.partial_since_ms != 0) {
+        uint64_t read_deadline = conn.partial_since_ms + config.read_timeout * 1000ull;
+        if (deadline == 0 || read_deadline < deadline) deadline = read_deadline;
+    }
+    return deadline;
+}
+
+// 连接超时：按原因计数并记录日志，由调用方关闭
+void log_timeout(Connection& conn) {
+    bool read = config.read_timeout > 0 && conn.partial_since_ms != 0 &&
+                monotonic_ms() >= conn.partial_since_ms + config.read_timeout * 1000ull;
+    ThreadMetrics& metrics = thread_metrics();
+    (read ? metrics.read_timeouts : metrics.idle_timeouts).add();
+    log_info("Client ", conn.addr, read ? " read timeout (incomplete request), closing." : " idle timeout, closing.");
+}
+
+// 客户端处理线程 (线程模式)
+void client_handler(std::shared_ptr<Connection> conn) {
+    int client_sock = conn->fd;
+
+    // 其他连接转发消息时通过管道唤醒本线程
+    std::shared_ptr<Waker> waker = std::make_shared<Waker>();
+    conn->notify_mail = [waker]() { waker->notify(); };
+    register_client(conn);
+
+    bool is_running = true; // 控制循环的标志
+
+    RecvBuffer& in = conn->rbuf;
+
+    // 服务器关闭时排空期间照常处理请求，之后由 kick_connection 唤醒 (读到 EOF) 退出
+    while (is_running) {
+        // === 协议嗅探与边界识别 ===
+        Frame frame;
+        DecodeStatus status = DECODE_HTTP;  // 已切换为 HTTP 的连接不再按协议包解析
+        if (!conn->http) {
+            // 1. 依次处理缓冲区中所有完整的包，应答攒到最后用一次 writev 发出
+            cork(*conn);
+            status = drain_frames(in, frame, frame_limit(*conn), [&](const Frame& f, DecodeStatus s) {
+                return is_running = handle_frame(*conn, f, s);  // === 业务逻辑 ===
+            });
+            if (!uncork(*conn)) break;
+            if (!is_running) break;
+        }
+
+        // 2. 检查是否为 HTTP (Lab8 兼容)：连接切换为 HTTP 后逐个应答请求，要求关闭时发完即退出循环
+        if (status == DECODE_HTTP) {
+            if (!conn->http) switch_to_http(*conn);
+            if (!process_http(*conn) || conn->close_after_flush) break;
+        }
+
+        // 3. 检查是否为 Lab7 协议
+        if (status == DECODE_BAD_MAGIC) {
+            log_error("Unknown protocol magic. Closing.");
+            break;
+        }
+
+        // 4. 包过大：无法跳过尚未到达的 Body，应答后断开
+        if (status == DECODE_TOO_LARGE) {
+            log_error("Frame of ", frame.header.length, " bytes exceeds limit. Closing.");
+            send_packet(*conn, RES_ERROR, "Frame too large.", frame.request_id);
+            break;
+        }
+
+        // 5. 数据不足一个包 (包括半个头部)：等待新数据或邮箱中的转发消息，最多等到超时时刻
+        //    HTTP 连接同时等待排空开始，空闲的持久连接此时关闭
+        track_input(*conn, false);
+        int timeout = -1;
+        uint64_t deadline = connection_deadline(*conn);
+        if (deadline != 0) {
+            uint64_t now = monotonic_ms();
+            if (deadline <= now) {
+                log_timeout(*conn);
                 break;
             }
-            default:
-                std::cout << "[Warn] Unknown Msg Type: " << header.type << std::endl;
+            timeout = (int)std::min<uint64_t>(deadline - now, INT_MAX);
+        }
+        struct pollfd fds[3];
+        fds[0].fd = client_sock;
+        fds[0].events = POLLIN;
+        fds[1].fd = waker->fd();
+        fds[1].events = POLLIN;
+        fds[2].fd = drain_pipe.fd();
+        fds[2].events = POLLIN;
+        fds[2].revents = 0;
+        if (poll(fds, conn->http ? 3 : 2, timeout) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (fds[2].revents & POLLIN) break;
+        if (fds[1].revents & POLLIN) {
+            waker->drain();
+            if (!deliver_mail(*conn)) break;
+        }
+        if (fds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+            // 一次取走所有已到达的数据
+            if (in.read_from(client_sock) <= 0) break; // 断开
+            conn->last_read_ms = monotonic_ms();
         }
     }
 
     // 清理工作
-    close(client_sock);
+    close_client(conn);
+    active_handlers.fetch_sub(1);
+}
+
+#ifdef __linux__
+// === Reactor 模式 ===
+// 边沿触发下一次可读事件最多先读入这么多数据再解析
+const size_t READ_WINDOW = 64 * 1024;
+
+// 解析读缓冲中所有完整的包，返回 false 表示需要关闭连接
+bool process_input(Connection& conn) {
+    if (conn.http) return process_http(conn);
+    RecvBuffer& in = conn.rbuf;
+    Frame frame;
+    DecodeStatus status;
+    bool keep = true;
+
+    // 本次读到的所有包处理完后，应答合并为一次 writev
+    cork(conn);
+    status = drain_frames(in, frame, frame_limit(conn), [&](const Frame& f, DecodeStatus s) {
+        return keep = handle_frame(conn, f, s);
+    });
+    if (!uncork(conn) || !keep) return false;
+
+    // 检查是否为 HTTP (Lab8 兼容)：连接切换为 HTTP，此后的输入都由 process_http 处理
+    if (status == DECODE_HTTP) {
+        switch_to_http(conn);
+        return process_http(conn);
+    }
+
+    if (status == DECODE_BAD_MAGIC) {
+        log_error("Unknown protocol magic. Closing.");
+        return false;
+    }
+
+    // 包过大：应答写完后关闭连接
+    if (status == DECODE_TOO_LARGE) {
+        log_error("Frame of ", frame.header.length, " bytes exceeds limit. Closing.");
+        in.clear();
+        std::lock_guard<std::mutex> lock(conn.out_mtx);
+        conn.out.push_frame(RES_ERROR, "Frame too large.", conn.wire(), frame.request_id);
+        conn.close_after_flush = true;
+        return flush_locked(conn);
+    }
+    return true; // DECODE_NEED_MORE
+}
+
+// 解析已读入的数据；应答后即将关闭的连接 (HTTP、包过大) 直接丢弃后续输入
+bool drain_input(Connection& conn) {
+    bool closing;
     {
-        std::lock_guard<std::mutex> lock(clients_mtx);
-        online_clients.erase(client_sock);
+        std::lock_guard<std::mutex> lock(conn.out_mtx);
+        closing = conn.close_after_flush;
+    }
+    if (closing) {
+        conn.rbuf.clear();
+        return true;
     }
-    std::cout << "[Info] Client " << client_addr << " disconnected." << std::endl;
+    return process_input(conn);
 }
 
-int main() {
-    struct sockaddr_in address;
-    int opt = 1;
+// 可读事件：边沿触发，必须一直读到 EAGAIN
+void on_reactor_readable(EventLoop& loop, const std::shared_ptr<Connection>& conn) {
+    bool keep = true;
+    bool eof = false;
+    bool got_data = false;
 
-    // 注册信号处理函数（检测退出指令）
-    signal(SIGINT, signal_handler);   // Ctrl+C
-    signal(SIGTERM, signal_handler);  // kill 命令
+    while (keep) {
+        ssize_t n = conn->rbuf.read_from(conn->fd);
+        if (n > 0) {
+            got_data = true;
+            // 读缓冲超过窗口时先解析，不等读到 EAGAIN：每个连接的读缓冲不超过 窗口 + 一个包
+            if (conn->rbuf.size() >= READ_WINDOW) keep = drain_input(*conn);
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        eof = true; // n == 0: 对端关闭；其他错误同样关闭 (已到达的数据仍然处理)
+        break;
+    }
+    if (keep) keep = drain_input(*conn) && !eof;
+    if (keep) track_input(*conn, got_data);
 
-    // 创建 Socket
-    if ((server_fd = socket(AF_INET, SOCK_STREAM, 0)) == 0) {
-        perror("socket failed");
+    if (keep) {
+        std::lock_guard<std::mutex> lock(conn->out_mtx);
+        if (conn->close_after_flush && conn->out.empty()) keep = false;
+    }
+    if (!keep) {
+        loop.remove(*conn);
+        close_client(conn);
+    }
+}
+
+// 可写事件：继续发送写缓冲中剩余的数据，再从邮箱补充
+void on_reactor_writable(EventLoop& loop, const std::shared_ptr<Connection>& conn) {
+    bool keep;
+    {
+        std::lock_guard<std::mutex> lock(conn->out_mtx);
+        if (conn->closed) return;
+        keep = flush_locked(*conn);
+        if (conn->close_after_flush && conn->out.empty()) keep = false;
+    }
+    if (keep) keep = deliver_mail(*conn);
+    if (!keep) {
+        loop.remove(*conn);
+        close_client(conn);
+    }
+}
+
+// 邮箱事件：其他连接转发来的消息
+void on_reactor_mail(EventLoop& loop, const std::shared_ptr<Connection>& conn) {
+    if (!deliver_mail(*conn)) {
+        loop.remove(*conn);
+        close_client(conn);
+    }
+}
+
+// 超时事件：事件循环的时间轮判定连接超时
+void on_reactor_timeout(EventLoop& loop, const std::shared_ptr<Connection>& conn) {
+    log_timeout(*conn);
+    loop.remove(*conn);
+    close_client(conn);
+}
+#endif
+
+// 解析 --rate-limit TYPE=RATE[/BURST]：TYPE 为 metric_type_name 中的名称，RATE 为每秒请求数 (0 表示不限)，
+// BURST 默认为 RATE 的 2 倍；"off" 关闭所有限流。数值必须是非负整数 (parse_int)，否则整条规则无效
+bool parse_rate_limit(const std::string& spec) {
+    if (spec == "off") {
+        for (RateRule& rule : config.rate_limits) rule = RateRule();
+        return true;
+    }
+    size_t eq = spec.find('=');
+    if (eq == std::string::npos) return false;
+    std::string name = spec.substr(0, eq);
+    for (int t = 0; t < METRIC_MSG_TYPES; ++t) {
+        if (name != metric_type_name(t)) continue;
+        std::string_view value(spec);
+        value.remove_prefix(eq + 1);
+        size_t slash = value.find('/');
+        uint32_t rate, burst;
+        if (!parse_int(value.substr(0, slash), rate) || rate > 1000000000U) return false;
+        if (slash == std::string_view::npos) {
+            burst = std::min(rate * 2ULL, 1000000000ULL);
+        } else if (!parse_int(value.substr(slash + 1), burst)) {
+            return false;
+        }
+        config.rate_limits[t].rate = rate;
+        config.rate_limits[t].burst = std::max(1U, std::min(burst, 1000000000U));
+        return true;
+    }
+    return false;
+}
+
+// 解析命令行参数
+void parse_args(int argc, char* argv[]) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--mode" && i + 1 < argc) {
+            std::string mode = argv[++i];
+            if (mode == "epoll") {
+                config.mode = MODE_EPOLL;
+            } else if (mode == "uring") {
+                config.mode = MODE_URING;
+            } else if (mode == "thread") {
+                config.mode = MODE_THREAD;
+            } else {
+                log_warn("Unknown mode '", mode, "', using thread mode.");
+            }
+        } else if (arg == "--loops" && i + 1 < argc) {
+            config.loops = std::max(0, atoi(argv[++i]));
+        } else if (arg == "--mailbox" && i + 1 < argc) {
+            config.mailbox_capacity = std::max(1, atoi(argv[++i]));
+        } else if (arg == "--port" && i + 1 < argc) {
+            config.port = atoi(argv[++i]);
+        } else if (arg == "--backlog" && i + 1 < argc) {
+            config.backlog = std::max(1, atoi(argv[++i]));
+        } else if (arg == "--acceptors" && i + 1 < argc) {
+            config.acceptors = std::max(1, atoi(argv[++i]));
+        } else if (arg == "--no-nodelay") {
+            config.nodelay = false;
+        } else if (arg == "--sndbuf" && i + 1 < argc) {
+            config.sndbuf = std::max(0, atoi(argv[++i]));
+        } else if (arg == "--rcvbuf" && i + 1 < argc) {
+            config.rcvbuf = std::max(0, atoi(argv[++i]));
+        } else if (arg == "--defer-accept" && i + 1 < argc) {
+            config.defer_accept = std::max(0, atoi(argv[++i]));
+        } else if (arg == "--max-frame" && i + 1 < argc) {
+            uint32_t max_frame;
+            if (!parse_int(std::string_view(argv[++i]), max_frame)) {
+                log_error("Invalid frame size limit '", argv[i], "', expected a byte count.");
+                exit(EXIT_FAILURE);
+            }
+            config.max_frame = std::max(1024U, max_frame);
+        } else if (arg == "--assets" && i + 1 < argc) {
+            config.assets_root = argv[++i];
+        } else if (arg == "--drain-timeout" && i + 1 < argc) {
+            config.drain_timeout = std::max(0, atoi(argv[++i]));
+        } else if (arg == "--idle-timeout" && i + 1 < argc) {
+            config.idle_timeout = std::max(0, atoi(argv[++i]));
+        } else if (arg == "--read-timeout" && i + 1 < argc) {
+            config.read_timeout = std::max(0, atoi(argv[++i]));
+        } else if (arg == "--max-conns" && i + 1 < argc) {
+            config.max_conns = std::max(0, atoi(argv[++i]));
+        } else if (arg == "--rate-limit" && i + 1 < argc) {
+            std::string spec = argv[++i];
+            if (!parse_rate_limit(spec)) {
+                log_error("Invalid rate limit '", spec, "', expected TYPE=RATE[/BURST] or off.");
+                exit(EXIT_FAILURE);
+            }
+        } else if (arg == "--node" && i + 1 < argc) {
+            config.node = atoi(argv[++i]);
+            if (config.node < 1 || config.node > MAX_NODE) {
+                log_error("Node ID must be in 1..", MAX_NODE, ".");
+                exit(EXIT_FAILURE);
+            }
+        } else if (arg == "--peer" && i + 1 < argc) {
+            PeerAddress peer;
+            char host[256];
+            if (sscanf(argv[++i], "%d=%255[^:]:%d", &peer.node, host, &peer.port) != 3 || peer.node < 1 ||
+                peer.node > MAX_NODE || peer.port <= 0 || peer.port > 65535) {
+                log_error("Invalid peer '", argv[i], "', expected ID=HOST:PORT.");
+                exit(EXIT_FAILURE);
+            }
+            peer.host = host;
+            config.peers.push_back(peer);
+        } else if (arg == "--cluster-secret-file" && i + 1 < argc) {
+            config.cluster_secret_file = argv[++i];
+        } else if (arg == "--store" && i + 1 < argc) {
+            config.store_dir = argv[++i];
+        } else if (arg == "--store-segment" && i + 1 < argc) {
+            config.store_segment = (size_t)std::max(1, atoi(argv[++i])) * 1024 * 1024;
+        } else if (arg == "--file-cache" && i + 1 < argc) {
+            file_cache.set_capacity((size_t)std::max(0, atoi(argv[++i])) * 1024 * 1024);
+        } else if (arg == "--log-rate" && i + 1 < argc) {
+            server_log().set_rate((uint32_t)std::max(0, atoi(argv[++i])));
+        } else if (arg == "--overflow" && i + 1 < argc) {
+            std::string policy = argv[++i];
+            if (policy == "reject") {
+                config.overflow = OVERFLOW_REJECT;
+            } else if (policy == "drop") {
+                config.overflow = OVERFLOW_DROP;
+            } else if (policy == "disconnect") {
+                config.overflow = OVERFLOW_DISCONNECT;
+            } else {
+                log_warn("Unknown overflow policy '", policy, "', using reject.");
+            }
+        } else {
+            std::cerr << "Usage: " << argv[0]
+                      << " [--mode thread|epoll|uring] [--loops N] [--mailbox N] [--overflow reject|drop|disconnect]"
+                      << " [--max-frame BYTES] [--assets DIR] [--file-cache MB] [--log-rate LINES]\n"
+                      << "       [--port N] [--backlog N] [--acceptors N] [--no-nodelay]"
+                      << " [--sndbuf BYTES] [--rcvbuf BYTES] [--defer-accept SECONDS]"
+                      << " [--drain-timeout SECONDS]\n"
+                      << "       [--idle-timeout SECONDS] [--read-timeout SECONDS] [--max-conns N]"
+                      << " [--rate-limit TYPE=RATE[/BURST]|off]\n"
+                      << "       [--store DIR] [--store-segment MB] [--node ID] [--peer ID=HOST:PORT]... [--cluster-secret-file PATH]" << std::endl;
+            exit(EXIT_FAILURE);
+        }
+    }
+#if defined(__linux__) && !defined(HAVE_IO_URING)
+    if (config.mode == MODE_URING) {
+        log_warn("Built without io_uring support, using epoll mode.");
+        config.mode = MODE_EPOLL;
+    }
+#endif
+#ifndef __linux__
+    if (config.mode == MODE_EPOLL || config.mode == MODE_URING) {
+        log_warn("epoll / io_uring modes are only available on Linux, using thread mode.");
+        config.mode = MODE_THREAD;
+    }
+#endif
+    if (config.loops == 0) {
+        config.loops = std::max(1u, std::thread::hardware_concurrency());
+    }
+    if (config.assets_root.empty()) {
+        // 在仓库根目录或 lab7_src 下启动都能找到 assets
+        struct stat st;
+        for (const char* dir : {"assets", "../assets"}) {
+            if (stat(dir, &st) == 0 && S_ISDIR(st.st_mode)) {
+                config.assets_root = dir;
+                break;
+            }
+        }
+    }
+    while (config.assets_root.size() > 1 && config.assets_root.back() == '/') config.assets_root.pop_back();
+    if (!config.peers.empty() && config.node == 0) {
+        log_error("--peer requires --node.");
         exit(EXIT_FAILURE);
     }
+    for (const PeerAddress& peer : config.peers) {
+        if (peer.node == config.node) {
+            log_error("Peer ", peer.node, " has the same ID as this node.");
+            exit(EXIT_FAILURE);
+        }
+    }
+    // 节点间连接须带共享密钥：读取密钥文件的第一行 (去掉行尾的换行)
+    if (!config.peers.empty()) {
+        if (config.cluster_secret_file.empty()) {
+            log_error("--peer requires --cluster-secret-file.");
+            exit(EXIT_FAILURE);
+        }
+        FILE* f = fopen(config.cluster_secret_file.c_str(), "r");
+        char line[256] = "";
+        bool ok = f && fgets(line, sizeof(line), f);
+        if (f) fclose(f);
+        config.cluster_secret = std::string(line, strcspn(line, "\r\n"));
+        if (!ok || !Cluster::valid_secret(config.cluster_secret)) {
+            log_error("Cannot read a cluster secret (one line of printable characters without ';' or spaces) from ",
+                      config.cluster_secret_file, ".");
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+// 创建一个监听 socket；reuseport 为 true 时多个 socket 绑定同一端口，由内核在它们之间分配新连接
+int open_listener(bool reuseport) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("socket failed");
+        return -1;
+    }
 
     // 端口复用
-    if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt))) {
-        perror("setsockopt");
-        exit(EXIT_FAILURE);
+    int opt = 1;
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
+        perror("setsockopt SO_REUSEADDR");
+        close(fd);
+        return -1;
+    }
+#ifdef SO_REUSEPORT
+    if (reuseport && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0) {
+        perror("setsockopt SO_REUSEPORT");
+        close(fd);
+        return -1;
     }
+#endif
 
+    // 缓冲区大小在 listen 之前设置，accept 得到的连接继承该值 (窗口缩放因子在握手时确定)
+    if (config.sndbuf > 0) setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &config.sndbuf, sizeof(config.sndbuf));
+    if (config.rcvbuf > 0) setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &config.rcvbuf, sizeof(config.rcvbuf));
+#ifdef TCP_DEFER_ACCEPT
+    // 客户端发来第一个数据包后才唤醒 accept
+    if (config.defer_accept > 0) {
+        setsockopt(fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, &config.defer_accept, sizeof(config.defer_accept));
+    }
+#endif
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
     address.sin_family = AF_INET;
     address.sin_addr.s_addr = INADDR_ANY;
-    address.sin_port = htons(SERVER_PORT);
+    address.sin_port = htons(config.port);
 
     // 绑定
-    if (bind(server_fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
         perror("bind failed");
-        exit(EXIT_FAILURE);
+        close(fd);
+        return -1;
     }
 
     // 监听
-    if (listen(server_fd, 20) < 0) {
+    if (listen(fd, config.backlog) < 0) {
         perror("listen");
-        exit(EXIT_FAILURE);
+        close(fd);
+        return -1;
     }
+    return fd;
+}
 
-    std::cout << "Lab7 Server (Protocol Aware) listening on " << SERVER_PORT << "..." << std::endl;
-    std::cout << "[Info] Press Ctrl+C to shutdown server." << std::endl;
+// "IP:Port" 形式的地址 (inet_ntoa 使用静态缓冲区，多个接收线程时改用 inet_ntop)
+std::string peer_address(const sockaddr_in& addr) {
+    char ip[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &addr.sin_addr, ip, sizeof(ip));
+    return std::string(ip) + ":" + std::to_string(ntohs(addr.sin_port));
+}
 
-    // 保存客户端处理线程
-    std::vector<std::thread> client_threads;
+#ifdef HAVE_IO_URING
+// io_uring 模式：事件循环的 multishot accept 得到新连接 (socket 为阻塞的，读写都由 ring 异步完成)
+std::shared_ptr<Connection> on_uring_accept(UringLoop* loop, int client_sock) {
+    struct sockaddr_in client_addr;
+    socklen_t addrlen = sizeof(client_addr);
+    if (getpeername(client_sock, (struct sockaddr *)&client_addr, &addrlen) < 0) {
+        close(client_sock);
+        return nullptr;
+    }
+    if (!admit_connection(client_sock)) return nullptr;
+    if (config.nodelay) set_nodelay(client_sock);
+
+    std::shared_ptr<Connection> conn = std::make_shared<Connection>(client_sock, peer_address(client_addr), true, config.mailbox_capacity);
+    conn->async_send = true;
+    Connection* raw = conn.get();
+    conn->notify_mail = [loop, raw]() { loop->post(raw); };
+    register_client(conn);
+    return conn;
+}
 
+// 创建 io_uring 事件循环；内核不支持所需特性时返回 false
+bool create_uring_loops() {
+    for (int i = 0; i < config.loops; ++i) {
+        uring_loops.emplace_back(new UringLoop());
+        UringLoop* loop = uring_loops.back().get();
+        if (!loop->init()) {
+            uring_loops.clear();
+            return false;
+        }
+        loop->on_accept = [loop](int fd) { return on_uring_accept(loop, fd); };
+        loop->on_input = [](Connection& conn) {
+            if (!drain_input(conn)) return false;
+            track_input(conn, true);
+            return true;
+        };
+        loop->on_mail = [](Connection& conn) { return deliver_mail(conn); };
+        loop->on_close = [](const std::shared_ptr<Connection>& conn) { close_client(conn); };
+        if (config.idle_timeout > 0 || config.read_timeout > 0) {
+            loop->deadline_of = connection_deadline;
+            loop->on_timeout = [](const std::shared_ptr<Connection>& conn) { log_timeout(*conn); };
+        }
+    }
+    return true;
+}
+#endif
+
+// 接收线程：从一个监听 socket 接收连接，交给事件循环或新建的处理线程
+void accept_loop(int listen_fd) {
     while (server_running) {
         struct sockaddr_in client_addr;
         socklen_t addrlen = sizeof(client_addr);
-        int client_sock = accept(server_fd, (struct sockaddr *)&client_addr, &addrlen);
-        
+#ifdef __linux__
+        // accept4 一步设置非阻塞与 close-on-exec，省去两次 fcntl
+        int flags = SOCK_CLOEXEC | (config.mode == MODE_EPOLL ? SOCK_NONBLOCK : 0);
+        int client_sock = accept4(listen_fd, (struct sockaddr *)&client_addr, &addrlen, flags);
+#else
+        int client_sock = accept(listen_fd, (struct sockaddr *)&client_addr, &addrlen);
+#endif
+
         if (client_sock < 0) {
-            if (server_running) {
+            if (server_running && errno != EINTR) {
                 perror("accept failed");
             }
             continue;
         }
 
-        std::string ip_port = std::string(inet_ntoa(client_addr.sin_addr)) + ":" + std::to_string(ntohs(client_addr.sin_port));
-        
-        // 启动新线程处理客户端
-        std::thread(client_handler, client_sock, ip_port).detach();
+        if (!admit_connection(client_sock)) continue;
+        std::string ip_port = peer_address(client_addr);
+        if (config.nodelay) set_nodelay(client_sock);
+
+#ifdef __linux__
+        if (config.mode == MODE_EPOLL) {
+            // 轮询分配给事件循环
+            std::shared_ptr<Connection> conn = std::make_shared<Connection>(client_sock, ip_port, true, config.mailbox_capacity);
+            EventLoop* loop = event_loops[next_loop.fetch_add(1, std::memory_order_relaxed) % event_loops.size()].get();
+            Connection* raw = conn.get();
+            conn->notify_mail = [loop, raw]() { loop->post(raw); };
+            register_client(conn);
+            if (!loop->add(conn)) close_client(conn);
+            continue;
+        }
+#endif
+        // 启动新线程处理客户端 (关闭时按 active_handlers 等待其退出)
+        active_handlers.fetch_add(1);
+        std::thread(client_handler, std::make_shared<Connection>(client_sock, ip_port, false, config.mailbox_capacity)).detach();
     }
+}
 
-    // 服务器关闭：关闭所有客户端连接
-    std::cout << "[Info] Closing all client connections..." << std::endl;
-    {
-        std::lock_guard<std::mutex> lock(clients_mtx);
-        for (const auto& client : online_clients) {
-            close(client.first);
+// === 关闭流程 ===
+// 信号到达后：停止接收新连接 -> 通知客户端 (IND_SHUTDOWN) 并排空发送队列 -> 停止事件循环、关闭连接
+
+// 等待信号管道可读；timeout_ms 毫秒内没有信号返回 false (-1 表示一直等待)
+bool wait_signal(int timeout_ms) {
+    struct pollfd pfd;
+    pfd.fd = signal_pipe.fd();
+    pfd.events = POLLIN;
+    int ret;
+    while ((ret = poll(&pfd, 1, timeout_ms)) < 0 && errno == EINTR) {}
+    if (ret <= 0) return false;
+    signal_pipe.drain();
+    return true;
+}
+
+// 排空：通知所有在线客户端服务器即将关闭，等待各连接已入队的转发消息与应答全部写出，最多 drain_timeout 秒
+// 期间连接照常处理请求 (转发仍然有效)；再收到一个信号时立即结束
+void drain_connections() {
+    server_draining = true;
+    drain_pipe.notify();
+    size_t notified = 0;
+    for (const auto& client : online_clients.snapshot()) {
+        send_shutdown_notice(*client.second);
+        ++notified;
+    }
+    log_info("Notified ", notified, " client(s), draining for up to ", config.drain_timeout, " s...");
+
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::seconds(config.drain_timeout);
+    size_t pending = 0;
+    while (true) {
+        pending = 0;
+        for (const auto& client : online_clients.snapshot()) {
+            if (!output_drained(*client.second)) ++pending;
+        }
+        if (pending == 0 || std::chrono::steady_clock::now() >= deadline) break;
+        if (wait_signal(10)) {
+            log_warn("Received another signal, skipping drain.");
+            break;
         }
-        online_clients.clear();
     }
+    if (pending > 0) {
+        log_warn("Drain incomplete: ", pending, " connection(s) still had pending output.");
+    } else {
+        log_info("All output queues flushed.");
+    }
+}
+
+int main(int argc, char* argv[]) {
+    parse_args(argc, argv);
+
+    // 注册信号处理函数（检测退出指令，只写自管道，由主线程执行关闭流程）
+    signal(SIGINT, signal_handler);   // Ctrl+C
+    signal(SIGTERM, signal_handler);  // kill 命令
+    signal(SIGPIPE, SIG_IGN);         // 对端已关闭时 send 返回错误，而不是终止进程
+
+    // 静态文件缓存的 inotify 监视线程
+    file_cache.start();
 
-    std::cout << "[Info] Server shutdown complete." << std::endl;
+    // 集群：本节点的用户 ID 从自己的分区分配 (须在恢复用户目录之前)
+    if (config.node) {
+        cluster.set_self(config.node);
+        cluster.set_secret(config.cluster_secret);
+        users.set_node(config.node);
+        for (const PeerAddress& peer : config.peers) {
+            std::string error;
+            if (!cluster.add_peer(peer.node, peer.host, peer.port, error)) {
+                log_error("Peer ", peer.node, ": ", error, ".");
+                exit(EXIT_FAILURE);
+            }
+        }
+        // 客户端 ID 中 fd 只占 NODE_SHIFT 位：把描述符上限降到 2^NODE_SHIFT，内核不会分配更大的 fd
+        struct rlimit limit;
+        if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur > (rlim_t)NODE_FD_MASK + 1) {
+            limit.rlim_cur = (rlim_t)NODE_FD_MASK + 1;
+            if (setrlimit(RLIMIT_NOFILE, &limit) == 0) log_info("Cluster mode: descriptor limit lowered to ", limit.rlim_cur, ".");
+        }
+    }
+
+    // 离线消息存储：恢复用户目录与消息日志中未投递的消息
+    if (!config.store_dir.empty()) {
+        std::string error;
+        if ((mkdir(config.store_dir.c_str(), 0755) < 0 && errno != EEXIST) ||
+            !users.open(config.store_dir + "/users", error) ||
+            !message_log.open(config.store_dir + "/messages", config.store_segment, error)) {
+            log_error("Cannot open store ", config.store_dir, ": ", error.empty() ? strerror(errno) : error);
+            exit(EXIT_FAILURE);
+        }
+        log_info("Message store at ", config.store_dir, ": ", message_log.pending(), " pending message(s) in ",
+                 message_log.segments(), " segment(s).");
+    }
+
+#ifdef HAVE_IO_URING
+    // io_uring 模式：由事件循环自己接收连接，内核不支持时退回 epoll
+    if (config.mode == MODE_URING && !create_uring_loops()) {
+        log_warn("io_uring setup failed (", strerror(errno), "), falling back to epoll mode.");
+        config.mode = MODE_EPOLL;
+    }
+#endif
+
+    // 创建监听 socket：多个接收线程时每个线程一个 SO_REUSEPORT socket，内核按连接哈希分配，
+    // 各线程的 accept 互不争抢同一个队列；不支持 SO_REUSEPORT 的平台上所有线程共用一个 socket
+    // (io_uring 模式下每个事件循环一个)
+#ifdef SO_REUSEPORT
+    int listener_count = config.mode == MODE_URING ? config.loops : config.acceptors;
+#else
+    int listener_count = 1;
+#endif
+    for (int i = 0; i < listener_count; ++i) {
+        int fd = open_listener(listener_count > 1);
+        if (fd < 0) exit(EXIT_FAILURE);
+        listen_fds.push_back(fd);
+    }
+
+    server_log().log(LOG_INFO, "Lab7 Server (Protocol Aware) listening on ", config.port, "...");
+    if (config.mode != MODE_URING) {
+        log_info(config.acceptors, " acceptor thread(s), backlog ", config.backlog, ".");
+    }
+    log_info("Press Ctrl+C to shutdown server. Metrics at http://<host>:", config.port, "/metrics");
+
+#ifdef __linux__
+    // Reactor 模式：启动固定数量的事件循环线程
+    std::vector<std::thread> loop_threads;
+    if (config.mode == MODE_EPOLL) {
+        for (int i = 0; i < config.loops; ++i) {
+            event_loops.emplace_back(new EventLoop());
+            EventLoop* loop = event_loops.back().get();
+            loop->on_readable = [loop](const std::shared_ptr<Connection>& conn) { on_reactor_readable(*loop, conn); };
+            loop->on_writable = [loop](const std::shared_ptr<Connection>& conn) { on_reactor_writable(*loop, conn); };
+            loop->on_mail = [loop](const std::shared_ptr<Connection>& conn) { on_reactor_mail(*loop, conn); };
+            if (config.idle_timeout > 0 || config.read_timeout > 0) {
+                loop->deadline_of = connection_deadline;
+                loop->on_timeout = [loop](const std::shared_ptr<Connection>& conn) { on_reactor_timeout(*loop, conn); };
+            }
+            loop_threads.emplace_back(&EventLoop::run, loop);
+        }
+        log_info("Running in epoll mode with ", config.loops, " event loop(s).");
+    }
+#endif
+#ifdef HAVE_IO_URING
+    // io_uring 模式：事件循环自己在监听 socket 上接收连接
+    for (size_t i = 0; i < uring_loops.size(); ++i) {
+        loop_threads.emplace_back(&UringLoop::run, uring_loops[i].get(), listen_fds[i % listen_fds.size()]);
+    }
+    if (config.mode == MODE_URING) {
+        log_info("Running in io_uring mode with ", config.loops, " event loop(s), backlog ", config.backlog, ".");
+    }
+#endif
+
+    // 启动接收线程
+    std::vector<std::thread> acceptor_threads;
+    if (config.mode != MODE_URING) {
+        for (int i = 0; i < config.acceptors; ++i) {
+            acceptor_threads.emplace_back(accept_loop, listen_fds[i % listen_fds.size()]);
+        }
+    }
+
+    // 连接其他节点 (监听已就绪，对端的连接可以同时到达)
+    if (cluster.enabled()) {
+        cluster.start(on_link_up);
+        log_info("Cluster node ", cluster.self(), " with ", config.peers.size(), " peer(s).");
+    }
+
+    // 主线程等待退出信号
+    while (!wait_signal(-1)) {}
+    log_info("Received signal ", (int)last_signal, ", shutting down server...");
+
+    // 1. 停止接收：shutdown 监听 socket，使阻塞在 accept() 中的所有接收线程返回错误 (close 推迟到线程退出后，避免 fd 被复用)
+    server_running = false;
+    for (int fd : listen_fds) shutdown(fd, SHUT_RDWR);
+    for (auto& t : acceptor_threads) t.join();
+
+    // 2. 通知客户端，排空发送队列；之后断开到其他节点的连接 (对端把本节点的用户视为离线)
+    drain_connections();
+    cluster.stop();
+
+#ifdef __linux__
+#ifdef HAVE_IO_URING
+    for (auto& loop : uring_loops) loop->stop();
+#endif
+    for (auto& loop : event_loops) loop->stop();
+    for (auto& t : loop_threads) t.join();
+#endif
+    for (int fd : listen_fds) close(fd);
+
+    // 3. 关闭所有客户端连接
+    log_info("Closing all client connections...");
+    // 线程模式的处理线程可能正阻塞在读写上，先 shutdown 唤醒；事件循环已退出，直接关闭 (包括已切换为 HTTP 的连接)
+    for (const auto& client : online_clients.snapshot()) {
+        kick_connection(*client.second);
+        if (client.second->nonblocking) close_client(client.second);
+    }
+    for (const auto& peer : cluster.inbound()) {
+        kick_connection(*peer);
+        if (peer->nonblocking) close_client(peer);
+    }
+#ifdef __linux__
+    for (auto& loop : event_loops) {
+        for (const auto& conn : loop->connections()) close_client(conn);
+    }
+#ifdef HAVE_IO_URING
+    for (auto& loop : uring_loops) {
+        for (const auto& conn : loop->connections()) close_client(conn);
+    }
+#endif
+#endif
+
+    // 4. 线程模式：等待处理线程退出，最多 1 秒
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+    while (active_handlers > 0 && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    if (active_handlers > 0) log_warn(active_handlers.load(), " handler thread(s) still running at exit.");
+
+    file_cache.stop();
+    message_log.close();  // 同步最后一组记录
+    print_alloc_stats();
+    log_info("Server shutdown complete.");
+    server_log().stop();
+
+    // 5. 仍有处理线程未退出时不能运行全局对象的析构函数 (线程可能还在使用它们)：
+    //    日志已写出、离线消息已落盘，直接结束进程
+    if (active_handlers > 0) _exit(EXIT_SUCCESS);
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,98 @@
+// 在线客户端表单元测试 (Google Test)：分页快照在加入 / 移除后与按 ID 排序的全表一致
+// 用法：make test (或 ./tests/client_registry_test)
+#include <gtest/gtest.h>
+#include <map>
+#include <random>
+#include <string>
+#include "../client_registry.h"
+
+namespace {
+
+// 不打开 socket：fd 为 -1 的连接只用于表项
+std::shared_ptr<Connection> make_conn(const std::string& addr) { return std::make_shared<Connection>(-1, addr, false); }
+
+std::string expected_rows(const std::map<int, std::string>& model, size_t begin, size_t end) {
+    std::string text;
+    size_t index = 0;
+    for (const auto& entry : model) {
+        if (index >= begin && index < end) text += std::to_string(entry.first) + "\t" + entry.second + "\n";
+        ++index;
+    }
+    return text;
+}
+
+void expect_matches(const ListSnapshot& snap, const std::map<int, std::string>& model) {
+    ASSERT_EQ(snap.row_count(), model.size());
+    std::string all;
+    snap.append_rows(all, 0, snap.row_count());
+    ASSERT_EQ(all, expected_rows(model, 0, model.size()));
+    EXPECT_EQ(snap.bytes, all.size());
+    // 跨页的切片
+    for (size_t begin : {(size_t)0, (size_t)1, (size_t)63, (size_t)64, (size_t)130, model.size()}) {
+        for (size_t count : {(size_t)1, (size_t)50, (size_t)200}) {
+            std::string part;
+            snap.append_rows(part, begin, begin + count);
+            EXPECT_EQ(part, expected_rows(model, begin, begin + count)) << begin << "+" << count;
+        }
+    }
+}
+
+}  // namespace
+
+TEST(ClientRegistry, PagedListMatchesSortedTable) {
+    ClientRegistry registry;
+    std::map<int, std::string> model;
+    std::map<int, std::shared_ptr<Connection>> conns;
+    std::mt19937 rng(7);
+    uint64_t version = registry.list_snapshot()->version;
+
+    for (int step = 0; step < 3000; ++step) {
+        int id = (int)(rng() % 1000);
+        if (conns.count(id) && rng() % 3 == 0) {
+            ASSERT_TRUE(registry.remove(id, conns[id].get()));
+            conns.erase(id);
+            model.erase(id);
+        } else {
+            std::string addr = "10.0.0." + std::to_string(step % 256) + ":" + std::to_string(step);
+            conns[id] = make_conn(addr);
+            registry.add(id, conns[id]);  // 同一 ID 再次加入时替换旧行
+            model[id] = addr;
+        }
+        std::shared_ptr<const ListSnapshot> snap = registry.list_snapshot();
+        ASSERT_EQ(snap->version, ++version);
+        if (step % 100 == 0) expect_matches(*snap, model);
+    }
+    expect_matches(*registry.list_snapshot(), model);
+
+    // 已发布的快照不受之后的修改影响；未修改的页在新旧快照之间共享
+    std::shared_ptr<const ListSnapshot> before = registry.list_snapshot();
+    std::map<int, std::string> old_model = model;
+    int last = model.rbegin()->first;
+    ASSERT_TRUE(registry.remove(last, conns[last].get()));
+    model.erase(last);
+    std::shared_ptr<const ListSnapshot> after = registry.list_snapshot();
+    expect_matches(*before, old_model);
+    expect_matches(*after, model);
+    ASSERT_GT(before->pages.size(), 2u);
+    EXPECT_EQ(before->pages.front(), after->pages.front());
+
+    for (const auto& entry : conns) registry.remove(entry.first, entry.second.get());
+    EXPECT_EQ(registry.list_snapshot()->row_count(), 0u);
+    EXPECT_TRUE(registry.list_snapshot()->pages.empty());
+}
+
+// 移除不在表中的 ID 或已被新连接复用的 ID 不改变列表
+TEST(ClientRegistry, RemoveOnlyExpectedConnection) {
+    ClientRegistry registry;
+    auto old_conn = make_conn("a");
+    auto new_conn = make_conn("b");
+    registry.add(5, old_conn);
+    registry.add(5, new_conn);
+    uint64_t version = registry.list_snapshot()->version;
+    EXPECT_FALSE(registry.remove(5, old_conn.get()));
+    EXPECT_FALSE(registry.remove(6, new_conn.get()));
+    EXPECT_EQ(registry.list_snapshot()->version, version);
+    std::string text;
+    registry.list_snapshot()->append_rows(text, 0, 10);
+    EXPECT_EQ(text, "5\tb\n");
+}
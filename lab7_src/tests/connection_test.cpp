@@ -0,0 +1,45 @@
+// 连接状态单元测试 (Google Test)：分片消息中出现校验和错误的包
+// 用法：make test (或 ./tests/connection_test)
+#include <gtest/gtest.h>
+#include "../connection.h"
+
+// 不属于分片消息的包：照常报告，状态不变
+TEST(CorruptFragment, OrdinaryFrame) {
+    Connection conn(-1, "test", false);
+    EXPECT_TRUE(corrupt_fragment(conn, REQ_TIME, 0));
+    EXPECT_TRUE(corrupt_fragment(conn, REQ_SEND_MSG, 0));
+    EXPECT_FALSE(conn.streaming);
+    EXPECT_FALSE(conn.stream_failed);
+}
+
+// 首个分片损坏：报告一次，其余分片 (由 forward_message 按 stream_failed) 丢弃
+TEST(CorruptFragment, FirstFragment) {
+    Connection conn(-1, "test", false);
+    EXPECT_TRUE(corrupt_fragment(conn, REQ_SEND_MSG, FLAG_CONTINUATION));
+    EXPECT_TRUE(conn.streaming);
+    EXPECT_TRUE(conn.stream_failed);
+}
+
+// 中间的分片损坏 (类型字段本身也可能损坏)：整条消息失败，之后再有损坏的分片不重复报告
+TEST(CorruptFragment, MiddleFragments) {
+    Connection conn(-1, "test", false);
+    conn.streaming = true;
+    EXPECT_TRUE(corrupt_fragment(conn, 0x7F, FLAG_CONTINUATION));
+    EXPECT_TRUE(conn.streaming);
+    EXPECT_TRUE(conn.stream_failed);
+    EXPECT_FALSE(corrupt_fragment(conn, REQ_SEND_MSG, FLAG_CONTINUATION));
+    EXPECT_FALSE(corrupt_fragment(conn, REQ_SEND_MSG, 0));  // 最后一个分片：消息结束
+    EXPECT_FALSE(conn.streaming);
+    EXPECT_FALSE(conn.stream_failed);
+    // 下一条消息重新报告
+    EXPECT_TRUE(corrupt_fragment(conn, REQ_SEND_MSG, 0));
+}
+
+// 最后一个分片损坏：报告后消息结束，下一个包按新消息处理
+TEST(CorruptFragment, LastFragment) {
+    Connection conn(-1, "test", false);
+    conn.streaming = true;
+    EXPECT_TRUE(corrupt_fragment(conn, REQ_SEND_MSG, 0));
+    EXPECT_FALSE(conn.streaming);
+    EXPECT_FALSE(conn.stream_failed);
+}
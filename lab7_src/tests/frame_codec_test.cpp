@@ -0,0 +1,192 @@
+// 帧编解码单元测试 (Google Test)：v1 / v2 往返、逐字节截断、校验和、长度上限、HTTP 嗅探、
+// 接收缓冲的复用与 drain_frames 的停止语义，以及 HttpParser 的分段输入
+// 用法：make test (或 ./tests/frame_codec_test --gtest_filter=...)
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+#include "../frame_codec.h"
+#include "../http_codec.h"
+
+namespace {
+
+const WireFormat V2_ALL(PROTOCOL_VERSION, FLAG_REQUEST_ID | FLAG_CONTINUATION | FLAG_CHECKSUM);
+
+std::string encode(uint32_t type, std::string_view body, const WireFormat& wire = WireFormat(),
+                   uint32_t request_id = 0, uint8_t extra_flags = 0) {
+    std::string out;
+    append_frame(out, type, body, wire, request_id, extra_flags);
+    return out;
+}
+
+// 把 data 按 chunk 字节一段追加进接收缓冲，每段之后取出所有完整的包
+std::vector<std::string> decode_chunked(const std::string& data, size_t chunk, DecodeStatus& last) {
+    RecvBuffer in(16);
+    std::vector<std::string> bodies;
+    Frame frame;
+    last = DECODE_NEED_MORE;
+    for (size_t pos = 0; pos < data.size() && last == DECODE_NEED_MORE; pos += chunk) {
+        in.append(data.data() + pos, std::min(chunk, data.size() - pos));
+        last = drain_frames(in, frame, UINT32_MAX, [&](const Frame& f, DecodeStatus) {
+            bodies.emplace_back(f.body, f.header.length);
+            return true;
+        });
+    }
+    return bodies;
+}
+
+}  // namespace
+
+TEST(FrameCodec, V1RoundTrip) {
+    std::string data = encode(REQ_SEND_MSG, "12:hello");
+    ASSERT_EQ(data.size(), HEADER_SIZE + 8);
+    Frame frame;
+    ASSERT_EQ(decode_frame(data.data(), data.size(), frame), DECODE_FRAME);
+    EXPECT_EQ(frame.version, 1);
+    EXPECT_EQ(frame.header.magic, MAGIC_LAB7);
+    EXPECT_EQ(frame.header.type, (uint32_t)REQ_SEND_MSG);
+    EXPECT_EQ(std::string(frame.body, frame.header.length), "12:hello");
+    EXPECT_EQ(frame.size(), data.size());
+}
+
+TEST(FrameCodec, V2RoundTripKeepsNegotiatedFlags) {
+    std::string data = encode(IND_RECV_MSG, "7|part", V2_ALL, 42, FLAG_CONTINUATION);
+    Frame frame;
+    ASSERT_EQ(decode_frame(data.data(), data.size(), frame), DECODE_FRAME);
+    EXPECT_EQ(frame.version, PROTOCOL_VERSION);
+    EXPECT_EQ(frame.request_id, 42u);
+    EXPECT_EQ(frame.flags, FLAG_REQUEST_ID | FLAG_CONTINUATION | FLAG_CHECKSUM);
+    EXPECT_EQ(std::string(frame.body, frame.header.length), "7|part");
+
+    // 对端没有协商的标志不会出现在包头中
+    data = encode(IND_RECV_MSG, "x", WireFormat(PROTOCOL_VERSION, FLAG_REQUEST_ID), 42, FLAG_CONTINUATION);
+    ASSERT_EQ(decode_frame(data.data(), data.size(), frame), DECODE_FRAME);
+    EXPECT_EQ(frame.flags, FLAG_REQUEST_ID);
+}
+
+TEST(FrameCodec, EveryTruncationNeedsMore) {
+    for (const std::string& data : {encode(REQ_TIME, "abc"), encode(REQ_TIME, "abc", V2_ALL, 1)}) {
+        Frame frame;
+        for (size_t len = 0; len < data.size(); ++len) {
+            EXPECT_EQ(decode_frame(data.data(), len, frame), DECODE_NEED_MORE) << "len=" << len;
+        }
+        EXPECT_EQ(decode_frame(data.data(), data.size(), frame), DECODE_FRAME);
+    }
+}
+
+TEST(FrameCodec, ChecksumMismatchStillDelimitsFrame) {
+    std::string data = encode(REQ_SEND_MSG, "1:payload", V2_ALL, 9);
+    data.back() ^= 0x20;
+    Frame frame;
+    ASSERT_EQ(decode_frame(data.data(), data.size(), frame), DECODE_BAD_CHECKSUM);
+    EXPECT_EQ(frame.size(), data.size());
+    EXPECT_EQ(frame.request_id, 9u);
+}
+
+TEST(FrameCodec, RejectsOversizedBodyFromHeaderAlone) {
+    std::string data = encode(REQ_SEND_MSG, std::string(1000, 'x'));
+    Frame frame;
+    EXPECT_EQ(decode_frame(data.data(), HEADER_SIZE, frame, 999), DECODE_TOO_LARGE);
+    EXPECT_EQ(frame.header.length, 1000u);
+    EXPECT_EQ(decode_frame(data.data(), data.size(), frame, 1000), DECODE_FRAME);
+}
+
+TEST(FrameCodec, RejectsBadMagicAndVersion) {
+    Frame frame;
+    std::string junk(HEADER_SIZE, '\x01');
+    EXPECT_EQ(decode_frame(junk.data(), junk.size(), frame), DECODE_BAD_MAGIC);
+
+    std::string data = encode(REQ_TIME, "", V2_ALL);
+    data[12] = PROTOCOL_VERSION + 1;  // PacketHeaderV2::version
+    EXPECT_EQ(decode_frame(data.data(), data.size(), frame), DECODE_BAD_MAGIC);
+}
+
+TEST(FrameCodec, SniffsHttpMethods) {
+    Frame frame;
+    for (const char* req : {"GET / HTTP/1.1\r\n", "POST /login", "HEAD /", "OPTIONS *"}) {
+        EXPECT_EQ(decode_frame(req, strlen(req), frame), DECODE_HTTP) << req;
+    }
+    // 不足 4 字节时无法判断，按不完整的包等待
+    EXPECT_EQ(decode_frame("GET", 3, frame), DECODE_NEED_MORE);
+    EXPECT_EQ(decode_frame("GETX / HTTP/1.1", 15, frame), DECODE_BAD_MAGIC);
+}
+
+TEST(FrameCodec, ChunkedArrivalMatchesWholeBuffer) {
+    std::string stream;
+    std::vector<std::string> expected;
+    for (int i = 0; i < 50; ++i) {
+        expected.push_back(std::string(i * 37, (char)('a' + i % 26)));
+        stream += encode(REQ_SEND_MSG, expected.back(), i % 2 ? V2_ALL : WireFormat(), i);
+    }
+    for (size_t chunk : {1, 3, 12, 24, 100, 4096, 1 << 20}) {
+        DecodeStatus last;
+        EXPECT_EQ(decode_chunked(stream, chunk, last), expected) << "chunk=" << chunk;
+        EXPECT_EQ(last, DECODE_NEED_MORE);
+    }
+}
+
+TEST(FrameCodec, DrainFramesStopsWhenHandlerRefuses) {
+    RecvBuffer in;
+    std::string stream = encode(REQ_TIME, "") + encode(REQ_EXIT, "") + encode(REQ_TIME, "");
+    in.append(stream.data(), stream.size());
+    Frame frame;
+    std::vector<uint32_t> types;
+    DecodeStatus status = drain_frames(in, frame, UINT32_MAX, [&](const Frame& f, DecodeStatus) {
+        types.push_back(f.header.type);
+        return f.header.type != REQ_EXIT;
+    });
+    EXPECT_EQ(status, DECODE_FRAME);
+    EXPECT_EQ(types, (std::vector<uint32_t>{REQ_TIME, REQ_EXIT}));
+    EXPECT_EQ(in.size(), HEADER_SIZE);  // 停止之后的包留在缓冲中
+}
+
+TEST(FrameCodec, DrainFramesReportsTerminalError) {
+    RecvBuffer in;
+    std::string stream = encode(REQ_TIME, "") + encode(REQ_SEND_MSG, std::string(100, 'x'));
+    in.append(stream.data(), stream.size());
+    Frame frame;
+    int handled = 0;
+    EXPECT_EQ(drain_frames(in, frame, 50, [&](const Frame&, DecodeStatus) { return ++handled > 0; }), DECODE_TOO_LARGE);
+    EXPECT_EQ(handled, 1);
+    EXPECT_EQ(frame.header.length, 100u);
+}
+
+TEST(RecvBuffer, CompactsBeforeGrowing) {
+    RecvBuffer in(64);
+    std::string a(40, 'a'), b(40, 'b');
+    in.append(a.data(), a.size());
+    in.consume(30);
+    in.append(b.data(), b.size());  // 未解析的 10 字节搬到头部后放得下
+    EXPECT_EQ(std::string(in.data(), in.size()), std::string(10, 'a') + b);
+    in.consume(in.size());
+    EXPECT_TRUE(in.empty());
+}
+
+TEST(HttpParser, SplitRequestsAndPipelining) {
+    std::string pipeline = "GET /a HTTP/1.1\r\nHost: x\r\n\r\n"
+                           "POST /b HTTP/1.1\r\nContent-Length: 5\r\n\r\nhello"
+                           "POST /c HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n3\r\nabc\r\n2\r\nde\r\n0\r\n\r\n";
+    for (size_t chunk : {(size_t)1, (size_t)7, pipeline.size()}) {
+        RecvBuffer in;
+        HttpParser parser(1024);
+        std::vector<std::string> got;
+        for (size_t pos = 0; pos < pipeline.size(); pos += chunk) {
+            in.append(pipeline.data() + pos, std::min(chunk, pipeline.size() - pos));
+            HttpParseStatus status;
+            while ((status = parser.parse(in)) == HTTP_REQUEST) {
+                got.push_back(parser.request().method + " " + parser.request().target + " " + parser.request().body);
+                parser.reset();
+            }
+            ASSERT_EQ(status, HTTP_NEED_MORE) << "chunk=" << chunk;
+        }
+        EXPECT_EQ(got, (std::vector<std::string>{"GET /a ", "POST /b hello", "POST /c abcde"})) << "chunk=" << chunk;
+    }
+}
+
+TEST(HttpParser, RejectsOversizedBody) {
+    RecvBuffer in;
+    std::string req = "POST / HTTP/1.1\r\nContent-Length: 2000\r\n\r\n";
+    in.append(req.data(), req.size());
+    HttpParser parser(1024);
+    EXPECT_EQ(parser.parse(in), HTTP_ERROR);
+    EXPECT_EQ(parser.error_status(), 413);
+}
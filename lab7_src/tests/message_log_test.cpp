@@ -0,0 +1,108 @@
+// 离线消息日志单元测试 (Google Test)：按批取出、写回与重新打开后的恢复
+// 用法：make test (或 ./tests/message_log_test)
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include "../message_log.h"
+#include "../cluster.h"
+
+namespace {
+
+const uint32_t USER = 0x01000001;
+
+// 每个测试一个临时目录，结束时删除
+class MessageLogTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        char path[] = "/tmp/message_log_test.XXXXXX";
+        ASSERT_NE(mkdtemp(path), nullptr);
+        dir_ = path;
+        std::string error;
+        ASSERT_TRUE(log_.open(dir_, 64 * 1024, error)) << error;
+    }
+
+    void TearDown() override {
+        log_.close();
+        std::filesystem::remove_all(dir_);
+    }
+
+    std::vector<std::string> take_bodies() {
+        std::vector<MessageLog::Message> batch;
+        std::vector<std::string> bodies;
+        log_.take_all(USER, batch, 16, [&](std::vector<MessageLog::Message>& got) {
+            for (const MessageLog::Message& msg : got) bodies.push_back(msg.body);
+        });
+        return bodies;
+    }
+
+    std::string dir_;
+    MessageLog log_;
+};
+
+}  // namespace
+
+TEST_F(MessageLogTest, TakeAllReturnsMessagesInOrder) {
+    std::vector<std::string> expected;
+    for (int i = 0; i < 100; ++i) {
+        expected.push_back("message " + std::to_string(i));
+        ASSERT_NE(log_.append(USER, 7, 0, expected.back()), 0u);
+    }
+    EXPECT_EQ(take_bodies(), expected);
+    EXPECT_EQ(log_.pending(), 0u);
+    EXPECT_TRUE(take_bodies().empty());
+}
+
+// 用户在其他节点上线、但到该节点的连接未建立：每条转发都失败，消息写回日志。
+// 这一轮必须结束 (写回的消息不再被取出)，写回后顺序不变，下次上线时仍能取出
+TEST_F(MessageLogTest, RequeueToDownPeerLinkTerminates) {
+    Cluster cluster;
+    cluster.set_self(1);
+    std::string error;
+    ASSERT_TRUE(cluster.add_peer(2, "127.0.0.1", 1, error)) << error;  // 未 start：连接始终未建立
+    std::vector<std::string> expected;
+    for (int i = 0; i < 100; ++i) {
+        expected.push_back("stored " + std::to_string(i));
+        ASSERT_NE(log_.append(USER, 7, 0, expected.back()), 0u);
+    }
+
+    std::vector<MessageLog::Message> batch;
+    size_t batches = 0, forwarded = 0;
+    size_t taken = log_.take_all(USER, batch, 16, [&](std::vector<MessageLog::Message>& got) {
+        if (++batches > 100) return;  // 保护：循环不结束时停止写回，让测试失败而不是挂住
+        for (const MessageLog::Message& msg : got) {
+            if (cluster.send(2, PEER_FORWARD, msg.body)) {
+                ++forwarded;
+            } else {
+                log_.append(USER, msg.src, msg.flags, msg.body);
+            }
+        }
+    });
+    EXPECT_EQ(taken, expected.size());
+    EXPECT_EQ(batches, (expected.size() + 15) / 16);
+    EXPECT_EQ(forwarded, 0u);
+    EXPECT_EQ(log_.pending(), expected.size());
+    EXPECT_EQ(take_bodies(), expected);
+}
+
+TEST_F(MessageLogTest, RecoversPendingMessagesAfterReopen) {
+    for (int i = 0; i < 10; ++i) ASSERT_NE(log_.append(USER, 7, 0, "m" + std::to_string(i)), 0u);
+    std::vector<MessageLog::Message> batch;
+    ASSERT_EQ(log_.take_pending(USER, batch, 4), 4u);
+    batch.clear();
+    log_.close();
+
+    // 与服务器重启相同：新的实例扫描分段，DELIVERED 之前的消息不再待投递
+    MessageLog reopened;
+    std::string error;
+    ASSERT_TRUE(reopened.open(dir_, 64 * 1024, error)) << error;
+    EXPECT_EQ(reopened.pending(), 6u);
+    std::vector<std::string> bodies;
+    reopened.take_all(USER, batch, 16, [&](std::vector<MessageLog::Message>& got) {
+        for (const MessageLog::Message& msg : got) bodies.push_back(msg.body);
+    });
+    ASSERT_EQ(bodies.size(), 6u);
+    EXPECT_EQ(bodies.front(), "m4");
+    EXPECT_EQ(bodies.back(), "m9");
+}
@@ -0,0 +1,92 @@
+// 令牌桶限流单元测试 (Google Test)：突发量、稳定速率、retry_ms 与时钟回退
+// 用法：make test (或 ./tests/rate_limit_test)
+#include <gtest/gtest.h>
+#include "../rate_limit.h"
+
+namespace {
+
+const uint64_t MS = 1000000;
+const uint64_t START = 1000 * 1000 * MS;  // 单调时钟不从 0 开始
+
+RateRule rule(uint32_t rate, uint32_t burst) {
+    RateRule r;
+    r.rate = rate;
+    r.burst = burst;
+    return r;
+}
+
+// 在 now_ns 时刻连续取令牌直到被拒绝，返回通过的个数
+int drain(TokenBucket& bucket, const RateRule& r, uint64_t now_ns, uint64_t& retry_ms) {
+    int taken = 0;
+    while (bucket.take(r, now_ns, retry_ms)) {
+        if (++taken > 1000000) break;
+    }
+    return taken;
+}
+
+}  // namespace
+
+TEST(TokenBucket, UnlimitedWhenRateIsZero) {
+    TokenBucket bucket;
+    uint64_t retry_ms = 12345;
+    for (int i = 0; i < 1000; ++i) ASSERT_TRUE(bucket.take(rule(0, 0), START, retry_ms));
+    EXPECT_EQ(retry_ms, 12345u);
+}
+
+// 新桶是满的：同一时刻最多通过 burst 个请求；burst 为 0 或 1 时都只通过一个
+TEST(TokenBucket, BurstOnFirstUse) {
+    uint64_t retry_ms = 0;
+    for (uint32_t burst : {0u, 1u, 5u, 100u}) {
+        TokenBucket bucket;
+        EXPECT_EQ(drain(bucket, rule(10, burst), START, retry_ms), (int)(burst > 1 ? burst : 1)) << "burst " << burst;
+    }
+}
+
+// 桶空后按速率放行：每个间隔一个；空闲再久也只攒回 burst 个
+TEST(TokenBucket, SteadyRateAndRefill) {
+    TokenBucket bucket;
+    RateRule r = rule(10, 3);  // 间隔 100 ms
+    uint64_t retry_ms = 0;
+    ASSERT_EQ(drain(bucket, r, START, retry_ms), 3);
+    uint64_t now = START;
+    for (int i = 0; i < 20; ++i) {
+        now += 100 * MS;
+        EXPECT_EQ(drain(bucket, r, now, retry_ms), 1) << "interval " << i;
+    }
+    EXPECT_FALSE(bucket.take(r, now + 99 * MS, retry_ms));
+    EXPECT_TRUE(bucket.take(r, now + 100 * MS, retry_ms));
+
+    now += 3600 * 1000 * MS;
+    EXPECT_EQ(drain(bucket, r, now, retry_ms), 3);
+}
+
+// retry_ms 是攒够一个令牌还需的时间，向上取整到毫秒；按它等待后请求一定通过
+TEST(TokenBucket, RetryAfter) {
+    TokenBucket bucket;
+    RateRule r = rule(3, 2);  // 间隔 333.333 ms，取整为 333333333 ns
+    uint64_t retry_ms = 0;
+    ASSERT_EQ(drain(bucket, r, START, retry_ms), 2);
+    EXPECT_EQ(retry_ms, 334u);
+
+    uint64_t now = START + 100 * MS;
+    EXPECT_FALSE(bucket.take(r, now, retry_ms));
+    EXPECT_EQ(retry_ms, 234u);
+    EXPECT_FALSE(bucket.take(r, now + (retry_ms - 1) * MS, retry_ms));
+    EXPECT_EQ(retry_ms, 1u);
+    EXPECT_TRUE(bucket.take(r, now + 234 * MS, retry_ms));
+}
+
+// 时钟回退 (调用方传入比上次更早的时刻)：不多放行，retry_ms 按回退后的时刻计算而不是溢出成巨大的值
+TEST(TokenBucket, ClockGoingBackwards) {
+    TokenBucket bucket;
+    RateRule r = rule(10, 3);
+    uint64_t retry_ms = 0;
+    ASSERT_EQ(drain(bucket, r, START, retry_ms), 3);
+
+    EXPECT_FALSE(bucket.take(r, START - 1000 * MS, retry_ms));
+    EXPECT_EQ(retry_ms, 1100u);
+    // 回到原来的时钟后行为不受影响
+    EXPECT_FALSE(bucket.take(r, START + 99 * MS, retry_ms));
+    EXPECT_EQ(retry_ms, 1u);
+    EXPECT_EQ(drain(bucket, r, START + 100 * MS, retry_ms), 1);
+}
@@ -0,0 +1,137 @@
+// 分层时间轮单元测试 (Google Test)：到期时刻、层间搬移 (cascade)、槽位回绕、取消与重新设置
+// 用法：make test (或 ./tests/timer_wheel_test)
+#include <gtest/gtest.h>
+#include <map>
+#include <vector>
+#include "../timer_wheel.h"
+
+namespace {
+
+// 刻度 1 ms，时间由测试给出：构造后先推进到 base，之后所有时刻都相对 base
+class TimerWheelTest : public ::testing::Test {
+protected:
+    TimerWheelTest() : wheel_(1), base_(monotonic_ms() + 1000) { wheel_.advance(base_, [](TimerNode&) {}); }
+
+    // 逐个刻度推进到 base + until，记录每个节点到期时的相对时刻
+    void run_until(uint64_t until) {
+        for (; now_ < until; ++now_) {
+            wheel_.advance(base_ + now_ + 1, [this](TimerNode& node) { fired_[&node].push_back(now_ + 1); });
+        }
+    }
+
+    void schedule(TimerNode& node, uint64_t at) { wheel_.schedule(node, base_ + at); }
+
+    TimerWheel wheel_;
+    uint64_t base_;
+    uint64_t now_ = 0;
+    std::map<TimerNode*, std::vector<uint64_t>> fired_;
+};
+
+}  // namespace
+
+TEST_F(TimerWheelTest, ExpiresExactlyAtDeadline) {
+    TimerNode a, b;
+    schedule(a, 1);
+    schedule(b, 63);
+    EXPECT_EQ(wheel_.size(), 2u);
+    run_until(62);
+    EXPECT_EQ(fired_[&a], std::vector<uint64_t>{1});
+    EXPECT_TRUE(fired_[&b].empty());
+    run_until(100);
+    EXPECT_EQ(fired_[&b], std::vector<uint64_t>{63});
+    EXPECT_TRUE(wheel_.empty());
+    EXPECT_FALSE(a.linked());
+}
+
+// 每层的边界两侧：第 1 层 (64..4095)、第 2 层 (4096..262143)、第 3 层；节点逐层搬下来后仍按时到期
+TEST_F(TimerWheelTest, CascadesAcrossLevels) {
+    const uint64_t deadlines[] = {64, 65, 127, 128, 4095, 4096, 4097, 262143, 262144, 300001};
+    std::vector<TimerNode> nodes(sizeof(deadlines) / sizeof(deadlines[0]));
+    for (size_t i = 0; i < nodes.size(); ++i) schedule(nodes[i], deadlines[i]);
+    run_until(300001);
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        EXPECT_EQ(fired_[&nodes[i]], std::vector<uint64_t>{deadlines[i]}) << "deadline " << deadlines[i];
+    }
+    EXPECT_TRUE(wheel_.empty());
+}
+
+// 当前刻度不在槽位 0 时，到期槽位的下标回绕到本轮已经走过的位置
+TEST_F(TimerWheelTest, WrapsPastSixtyFourSlots) {
+    run_until(70);
+    for (uint64_t offset : {1, 10, 63, 64, 100, 200}) {
+        TimerNode node;
+        schedule(node, now_ + offset);
+        uint64_t expected = now_ + offset;
+        run_until(expected);
+        EXPECT_EQ(fired_[&node], std::vector<uint64_t>{expected}) << "offset " << offset;
+        fired_.erase(&node);
+    }
+}
+
+TEST_F(TimerWheelTest, CancelAndRearm) {
+    TimerNode a, b, c;
+    schedule(a, 10);
+    schedule(b, 5000);
+    schedule(c, 20);
+    wheel_.cancel(a);
+    wheel_.cancel(a);  // 重复取消无害
+    EXPECT_FALSE(a.linked());
+    EXPECT_EQ(wheel_.size(), 2u);
+
+    schedule(b, 30);   // 提前：从第 2 层移到第 0 层
+    schedule(c, 4200); // 推迟：从第 0 层移到第 2 层
+    EXPECT_EQ(wheel_.size(), 2u);
+    run_until(5000);
+    EXPECT_TRUE(fired_[&a].empty());
+    EXPECT_EQ(fired_[&b], std::vector<uint64_t>{30});
+    EXPECT_EQ(fired_[&c], std::vector<uint64_t>{4200});
+}
+
+// 回调中可以重新设置自己 (周期性检查)，也可以取消同一槽位中尚未回调的节点
+TEST_F(TimerWheelTest, CallbackMayRescheduleAndCancel) {
+    TimerNode periodic, doomed;
+    schedule(periodic, 50);
+    schedule(doomed, 50);
+    int runs = 0;
+    for (; now_ < 400; ++now_) {
+        wheel_.advance(base_ + now_ + 1, [&](TimerNode& node) {
+            fired_[&node].push_back(now_ + 1);
+            if (&node == &periodic) {
+                wheel_.cancel(doomed);
+                if (++runs < 3) wheel_.schedule(periodic, base_ + now_ + 1 + 100);
+            }
+        });
+    }
+    EXPECT_EQ(fired_[&periodic], (std::vector<uint64_t>{50, 150, 250}));
+    EXPECT_TRUE(fired_[&doomed].empty());
+    EXPECT_TRUE(wheel_.empty());
+}
+
+TEST_F(TimerWheelTest, ClampsPastAndFarDeadlines) {
+    TimerNode past, far;
+    wheel_.schedule(past, base_ - 500);  // 已过的时刻：下一个刻度到期
+    EXPECT_EQ(wheel_.expires_ms(past), base_ + 1);
+    wheel_.schedule(far, base_ + ((uint64_t)1 << 40));
+    uint64_t max_delta = ((uint64_t)1 << (TimerWheel::LEVELS * TimerWheel::SLOT_BITS)) - 1;
+    EXPECT_EQ(wheel_.expires_ms(far), base_ + max_delta);
+    run_until(1);
+    EXPECT_EQ(fired_[&past], std::vector<uint64_t>{1});
+    EXPECT_TRUE(far.linked());
+}
+
+TEST_F(TimerWheelTest, NextTimeoutAndIdleJump) {
+    EXPECT_EQ(wheel_.next_timeout_ms(base_), -1);
+    TimerNode node;
+    schedule(node, 1000);
+    EXPECT_EQ(wheel_.next_timeout_ms(base_), 1);
+    wheel_.cancel(node);
+
+    // 空闲时一次跳过很多刻度，之后的定时器相对新的时刻计算
+    wheel_.advance(base_ + 1000000, [](TimerNode&) { FAIL() << "no timers armed"; });
+    wheel_.schedule(node, base_ + 1000000 + 70);
+    bool fired = false;
+    wheel_.advance(base_ + 1000000 + 69, [&](TimerNode&) { fired = true; });
+    EXPECT_FALSE(fired);
+    wheel_.advance(base_ + 1000000 + 70, [&](TimerNode&) { fired = true; });
+    EXPECT_TRUE(fired);
+}
@@ -0,0 +1,95 @@
+// io_uring 事件循环单元测试 (Google Test，ASan 下运行)：连接在 on_input 中被关闭时的生命周期
+// 内核不支持 io_uring 或编译时未检测到 <linux/io_uring.h> 时跳过
+// 用法：make test (或 ./tests/uring_loop_test)
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "../uring_loop.h"
+
+#if defined(__linux__) && defined(HAVE_IO_URING)
+
+namespace {
+
+// 127.0.0.1 上的临时端口
+int listen_loopback(sockaddr_in& addr) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    if (fd < 0 || bind(fd, (sockaddr*)&addr, len) < 0 || listen(fd, 16) < 0 || getsockname(fd, (sockaddr*)&addr, &len) < 0) {
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// 客户端发出一段数据后，on_input 要求关闭连接：事件循环应当只关闭一次，且之后不再访问连接状态
+void close_from_input(bool multishot) {
+    sockaddr_in addr;
+    int listen_fd = listen_loopback(addr);
+    ASSERT_GE(listen_fd, 0);
+
+    UringLoop loop;
+    if (!loop.init()) {
+        close(listen_fd);
+        GTEST_SKIP() << "io_uring not supported by this kernel";
+    }
+    loop.multishot_recv = multishot;
+    std::atomic<int> inputs(0), closes(0);
+    loop.on_accept = [](int fd) {
+        auto conn = std::make_shared<Connection>(fd, "test", true);
+        conn->async_send = true;
+        return conn;
+    };
+    loop.on_input = [&inputs](Connection&) {
+        ++inputs;
+        return false;
+    };
+    loop.on_close = [&closes](const std::shared_ptr<Connection>& conn) {
+        std::lock_guard<std::mutex> lock(conn->fd_mtx);
+        conn->closed = true;
+        close(conn->fd);
+        ++closes;
+    };
+    std::thread runner(&UringLoop::run, &loop, listen_fd);
+
+    int client = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    ASSERT_EQ(connect(client, (sockaddr*)&addr, sizeof(addr)), 0);
+    ASSERT_EQ(write(client, "hello", 5), 5);
+    char buf[64];
+    EXPECT_EQ(read(client, buf, sizeof(buf)), 0);  // 服务端 shutdown 后读到 EOF
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (closes == 0 && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    loop.stop();
+    runner.join();
+    close(client);
+    close(listen_fd);
+
+    EXPECT_EQ(inputs, 1);
+    EXPECT_EQ(closes, 1);
+    EXPECT_TRUE(loop.connections().empty());
+}
+
+}  // namespace
+
+// 单次 recv：完成事件不带 IORING_CQE_F_MORE，on_input 返回 false 时在途请求数已为 0，连接状态当场释放
+TEST(UringLoop, CloseFromInputOnSingleShotRecv) { close_from_input(false); }
+
+// multishot recv：关闭要等 recv 的最后一个完成事件
+TEST(UringLoop, CloseFromInputOnMultishotRecv) { close_from_input(true); }
+
+#else
+
+TEST(UringLoop, NotBuilt) { GTEST_SKIP() << "built without HAVE_IO_URING"; }
+
+#endif
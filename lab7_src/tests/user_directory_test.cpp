@@ -0,0 +1,171 @@
+// 用户目录单元测试 (Google Test)：并发注册与落盘、重新打开后的恢复、登录令牌
+// 用法：make test (或 ./tests/user_directory_test)
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdlib>
+#include "../user_directory.h"
+
+namespace {
+
+class UserDirectoryTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        char path[] = "/tmp/user_directory_test.XXXXXX";
+        ASSERT_NE(mkdtemp(path), nullptr);
+        dir_ = path;
+        path_ = dir_ + "/users";
+    }
+
+    void TearDown() override { std::filesystem::remove_all(dir_); }
+
+    // 注册或登录，返回 ID (失败时为 0)；新发放的令牌写入 issued
+    static uint32_t sign_in(UserDirectory& users, const std::string& name, const std::string& token, std::string* issued = nullptr) {
+        uint32_t id = 0;
+        UserEntry entry;
+        if (users.register_name(name, token, id, entry) != REGISTER_OK) return 0;
+        if (issued) *issued = entry.token;
+        return id;
+    }
+
+    size_t file_lines() {
+        std::ifstream in(path_);
+        std::string line;
+        size_t count = 0;
+        while (std::getline(in, line)) ++count;
+        return count;
+    }
+
+    std::string dir_;
+    std::string path_;
+};
+
+}  // namespace
+
+// 多个线程同时注册同一组名字：每个名字只分配一个 ID、只写一行，不同名字的 ID 互不相同
+TEST_F(UserDirectoryTest, ConcurrentRegistrationWritesOnce) {
+    UserDirectory users;
+    std::string error;
+    ASSERT_TRUE(users.open(path_, error)) << error;
+
+    const int THREADS = 8, NAMES = 20;
+    std::vector<std::vector<uint32_t>> got(THREADS, std::vector<uint32_t>(NAMES));
+    std::vector<std::vector<std::string>> issued(THREADS, std::vector<std::string>(NAMES));
+    std::vector<std::thread> threads;
+    for (int t = 0; t < THREADS; ++t) {
+        threads.emplace_back([&, t] {
+            // 没拿到令牌的线程登录失败 (返回 0)，之后带上发放的令牌重试
+            for (int i = 0; i < NAMES; ++i) got[t][i] = sign_in(users, "user" + std::to_string(i), "", &issued[t][i]);
+        });
+    }
+    for (auto& thread : threads) thread.join();
+    for (int i = 0; i < NAMES; ++i) {
+        std::string token;
+        int winners = 0;
+        for (int t = 0; t < THREADS; ++t) {
+            if (issued[t][i].empty()) continue;
+            ++winners;
+            token = issued[t][i];
+        }
+        ASSERT_EQ(winners, 1) << "name " << i;
+        for (int t = 0; t < THREADS; ++t) {
+            if (got[t][i] == 0) got[t][i] = sign_in(users, "user" + std::to_string(i), token);
+        }
+    }
+
+    std::set<uint32_t> distinct;
+    for (int i = 0; i < NAMES; ++i) {
+        ASSERT_GE(got[0][i], USER_ID_BASE);
+        for (int t = 1; t < THREADS; ++t) EXPECT_EQ(got[t][i], got[0][i]) << "name " << i;
+        EXPECT_EQ(users.lookup("user" + std::to_string(i)), got[0][i]);
+        distinct.insert(got[0][i]);
+    }
+    EXPECT_EQ(distinct.size(), (size_t)NAMES);
+    EXPECT_EQ(file_lines(), (size_t)NAMES);
+
+    UserDirectory reopened;
+    ASSERT_TRUE(reopened.open(path_, error)) << error;
+    for (int i = 0; i < NAMES; ++i) EXPECT_EQ(reopened.lookup("user" + std::to_string(i)), got[0][i]);
+}
+
+// 其他节点合并来的同名用户：保留较小的 ID，较大的作为别名，二者都写入文件
+TEST_F(UserDirectoryTest, MergeKeepsSmallerId) {
+    UserDirectory users;
+    users.set_node(2);
+    std::string error;
+    ASSERT_TRUE(users.open(path_, error)) << error;
+    std::string my_token;
+    uint32_t mine = sign_in(users, "alice", "", &my_token);
+    uint32_t theirs = USER_ID_BASE + (1u << PARTITION_SHIFT);  // 节点 1 的分区
+    std::string their_token(USER_TOKEN_SIZE, 'a');
+    uint32_t renamed_from = 0;
+    EXPECT_TRUE(users.merge(theirs, "alice", their_token, renamed_from));
+    EXPECT_EQ(renamed_from, mine);
+    EXPECT_EQ(users.lookup("alice"), theirs);
+    EXPECT_EQ(users.canonical(mine), theirs);
+    EXPECT_FALSE(users.merge(theirs, "alice", their_token, renamed_from));
+    EXPECT_EQ(file_lines(), 2u);
+    // 两个节点发放的令牌都可以登录
+    EXPECT_EQ(sign_in(users, "alice", my_token), theirs);
+    EXPECT_EQ(sign_in(users, "alice", their_token), theirs);
+    EXPECT_EQ(sign_in(users, "alice", std::string(USER_TOKEN_SIZE, 'b')), 0u);
+}
+
+// 首次注册发放令牌，之后登录须带上同一个令牌；重新打开后令牌仍然有效
+TEST_F(UserDirectoryTest, TokenRequiredAfterRegistration) {
+    std::string error, token;
+    {
+        UserDirectory users;
+        ASSERT_TRUE(users.open(path_, error)) << error;
+        uint32_t id = sign_in(users, "bob", "", &token);
+        ASSERT_NE(id, 0u);
+        EXPECT_TRUE(UserDirectory::valid_token(token));
+        std::string again;
+        EXPECT_EQ(sign_in(users, "bob", token, &again), id);
+        EXPECT_TRUE(again.empty());
+        uint32_t ignored;
+        UserEntry entry;
+        EXPECT_EQ(users.register_name("bob", "", ignored, entry), REGISTER_BAD_TOKEN);
+        std::string wrong = token;
+        wrong[0] = wrong[0] == '0' ? '1' : '0';
+        EXPECT_EQ(users.register_name("bob", wrong, ignored, entry), REGISTER_BAD_TOKEN);
+    }
+    EXPECT_EQ(std::filesystem::status(path_).permissions() & std::filesystem::perms::all,
+              std::filesystem::perms::owner_read | std::filesystem::perms::owner_write);
+    UserDirectory reopened;
+    ASSERT_TRUE(reopened.open(path_, error)) << error;
+    EXPECT_NE(sign_in(reopened, "bob", token), 0u);
+    EXPECT_EQ(sign_in(reopened, "bob", ""), 0u);
+}
+
+// 旧文件中没有令牌的记录：下一次登录时补发，之后同样须带令牌；其他节点发来的令牌补给已知的 ID
+TEST_F(UserDirectoryTest, LegacyRecordClaimsToken) {
+    {
+        std::ofstream out(path_);
+        out << USER_ID_BASE << " carol\n" << USER_ID_BASE + 1 << " dave\n";
+    }
+    UserDirectory users;
+    std::string error, token;
+    ASSERT_TRUE(users.open(path_, error)) << error;
+    EXPECT_EQ(sign_in(users, "carol", "", &token), USER_ID_BASE);
+    ASSERT_FALSE(token.empty());
+    EXPECT_EQ(sign_in(users, "carol", ""), 0u);
+    EXPECT_EQ(sign_in(users, "carol", token), USER_ID_BASE);
+
+    uint32_t renamed_from = 0;
+    std::string remote(USER_TOKEN_SIZE, 'c');
+    EXPECT_FALSE(users.merge(USER_ID_BASE + 1, "dave", remote, renamed_from));
+    EXPECT_EQ(users.token(USER_ID_BASE + 1), remote);
+    EXPECT_EQ(sign_in(users, "dave", remote), USER_ID_BASE + 1);
+    EXPECT_EQ(file_lines(), 4u);
+
+    UserDirectory reopened;
+    ASSERT_TRUE(reopened.open(path_, error)) << error;
+    EXPECT_EQ(sign_in(reopened, "carol", token), USER_ID_BASE);
+    EXPECT_EQ(sign_in(reopened, "dave", remote), USER_ID_BASE + 1);
+    EXPECT_EQ(sign_in(reopened, "dave", ""), 0u);
+}
@@ -0,0 +1,159 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <chrono>
+#include <cstdint>
+
+// === 分层时间轮 ===
+// 每个事件循环一个，只由事件循环线程访问。定时器节点嵌在连接对象中 (侵入式双向链表)，
+// 加入、移动、取消都是 O(1)，不分配内存；推进时间时只处理当前刻度的槽位。
+// 4 层，每层 64 个槽位：第 0 层每槽一个刻度，第 k 层每槽 64^k 个刻度；
+// 高层槽位轮到时把其中的节点按剩余时间重新放入低层 (cascade)，每个节点最多被搬动 3 次。
+// 刻度为 100 ms 时可以表示约 19 天内的超时，更远的到期时间按最大值处理。
+
+inline uint64_t monotonic_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct TimerNode {
+    TimerNode* prev = nullptr;  // 未加入时间轮时为 nullptr
+    TimerNode* next = nullptr;
+    uint64_t expires = 0;       // 到期刻度
+    void* owner = nullptr;      // 所属对象 (由使用者设置)
+
+    bool linked() const { return prev != nullptr; }
+};
+
+class TimerWheel {
+public:
+    static const int LEVELS = 4;
+    static const int SLOT_BITS = 6;
+    static const int SLOTS = 1 << SLOT_BITS;
+    static const uint64_t SLOT_MASK = SLOTS - 1;
+
+    explicit TimerWheel(uint64_t tick_ms = 100) : tick_ms_(tick_ms), current_(monotonic_ms() / tick_ms), count_(0) {
+        for (int level = 0; level < LEVELS; ++level) {
+            for (int slot = 0; slot < SLOTS; ++slot) {
+                TimerNode& head = slots_[level][slot];
+                head.prev = head.next = &head;
+            }
+        }
+    }
+
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+    bool empty() const { return count_ == 0; }
+    size_t size() const { return count_; }
+
+    // 设置 (或修改) 节点的到期时刻 (单调时钟毫秒)，向上取整到刻度
+    void schedule(TimerNode& node, uint64_t expire_ms) {
+        if (node.linked()) {
+            unlink(node);  // 修改到期时刻：节点数不变
+        } else {
+            ++count_;
+        }
+        uint64_t expires = (expire_ms + tick_ms_ - 1) / tick_ms_;
+        node.expires = expires > current_ ? expires : current_ + 1;
+        place(node);
+    }
+
+    void cancel(TimerNode& node) {
+        if (!node.linked()) return;
+        unlink(node);
+        --count_;
+    }
+
+    // 节点的到期时刻 (毫秒)
+    uint64_t expires_ms(const TimerNode& node) const { return node.expires * tick_ms_; }
+
+    // 距下一个刻度的毫秒数 (事件循环的等待超时)；没有定时器时返回 -1
+    int next_timeout_ms(uint64_t now_ms) const {
+        if (count_ == 0) return -1;
+        uint64_t next = (current_ + 1) * tick_ms_;
+        return next > now_ms ? (int)(next - now_ms) : 0;
+    }
+
+    // 推进到 now_ms，对每个到期的节点调用 on_expire(TimerNode&)；回调中可以重新 schedule 或 cancel 任意节点
+    template <typename Callback>
+    void advance(uint64_t now_ms, Callback on_expire) {
+        uint64_t target = now_ms / tick_ms_;
+        if (count_ == 0) {
+            if (target > current_) current_ = target;
+            return;
+        }
+        while (current_ < target) {
+            ++current_;
+            // 1. 低层转完一圈时，把上一层当前槽位的节点搬下来
+            for (int level = 1; level < LEVELS; ++level) {
+                if (((current_ >> ((level - 1) * SLOT_BITS)) & SLOT_MASK) != 0) break;
+                cascade(level, (current_ >> (level * SLOT_BITS)) & SLOT_MASK);
+            }
+            // 2. 第 0 层当前槽位中的节点全部到期；先整体摘下，回调中修改其他节点不影响遍历
+            TimerNode& head = slots_[0][current_ & SLOT_MASK];
+            if (head.next == &head) continue;
+            TimerNode expired;
+            splice(head, expired);
+            while (expired.next != &expired) {
+                TimerNode& node = *expired.next;
+                unlink(node);
+                --count_;
+                on_expire(node);
+            }
+            if (count_ == 0) {
+                current_ = target;
+                break;
+            }
+        }
+    }
+
+private:
+    // 按剩余刻度数选择层与槽位
+    void place(TimerNode& node) {
+        uint64_t delta = node.expires - current_;
+        int level = 0;
+        while (level < LEVELS - 1 && delta >= ((uint64_t)1 << ((level + 1) * SLOT_BITS))) ++level;
+        uint64_t expires = node.expires;
+        uint64_t max_delta = ((uint64_t)1 << (LEVELS * SLOT_BITS)) - 1;
+        if (delta > max_delta) expires = node.expires = current_ + max_delta;
+        TimerNode& head = slots_[level][(expires >> (level * SLOT_BITS)) & SLOT_MASK];
+        node.next = &head;
+        node.prev = head.prev;
+        head.prev->next = &node;
+        head.prev = &node;
+    }
+
+    static void unlink(TimerNode& node) {
+        node.prev->next = node.next;
+        node.next->prev = node.prev;
+        node.prev = node.next = nullptr;
+    }
+
+    // 把 from 链表整体移到空链表 to (to 的头节点在栈上)
+    static void splice(TimerNode& from, TimerNode& to) {
+        to.next = from.next;
+        to.prev = from.prev;
+        to.next->prev = &to;
+        to.prev->next = &to;
+        from.prev = from.next = &from;
+    }
+
+    void cascade(int level, uint64_t slot) {
+        TimerNode& head = slots_[level][slot];
+        if (head.next == &head) return;
+        TimerNode moving;
+        splice(head, moving);
+        while (moving.next != &moving) {
+            TimerNode& node = *moving.next;
+            unlink(node);
+            place(node);
+        }
+    }
+
+    uint64_t tick_ms_;
+    uint64_t current_;  // 已处理到的刻度
+    size_t count_;
+    TimerNode slots_[LEVELS][SLOTS];  // 各槽位链表的头节点 (哨兵)
+};
+
+#endif // TIMER_WHEEL_H
@@ -0,0 +1,545 @@
+#ifndef URING_LOOP_H
+#define URING_LOOP_H
+
+// === io_uring 事件循环 (Linux 6.0+，编译时检测到 <linux/io_uring.h> 才启用) ===
+// 职责与 EventLoop 相同，但 I/O 以提交队列 / 完成队列的方式进行，稳态下每批事件只需一次 io_uring_enter：
+//   - 监听 socket 上常驻一个 multishot accept，持续产生新连接
+//   - 每个连接常驻一个 multishot recv，缓冲取自事先交给内核的缓冲组 (provided buffers)，
+//     数据到达即完成，不需要再逐次发起 recv
+//   - 发送：发送队列中的包搬进连接的暂存区后提交 IORING_OP_SEND；每个连接同时只有一个发送在途，保证顺序
+//   - 其他线程投递邮箱时写 eventfd，eventfd 上常驻一个 read 请求
+//   - 连接的超时由时间轮管理，时间轮非空时挂一个 IORING_OP_TIMEOUT，到下一个刻度时完成
+// 直接使用内核接口 (io_uring_setup / io_uring_enter + mmap)，不依赖 liburing。
+// 内核不支持所需特性时 init() 返回 false，由调用方退回 epoll。
+
+#if defined(__linux__) && defined(HAVE_IO_URING)
+
+#include "connection.h"
+#include <map>
+#include <algorithm>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <string>
+#include <memory>
+#include <functional>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/eventfd.h>
+#include <linux/io_uring.h>  // 经 <linux/fs.h> 定义了 BLOCK_SIZE 宏，须在 buffer_pool.h 之后包含
+
+// 提交队列 / 完成队列的最小封装
+class IoUring {
+public:
+    IoUring() : fd_(-1), sq_ring_(MAP_FAILED), cq_ring_(MAP_FAILED), sqes_(MAP_FAILED),
+                sq_ring_size_(0), cq_ring_size_(0), sqes_size_(0), sq_tail_local_(0) {}
+
+    ~IoUring() {
+        if (sqes_ != MAP_FAILED) munmap(sqes_, sqes_size_);
+        if (cq_ring_ != MAP_FAILED && cq_ring_ != sq_ring_) munmap(cq_ring_, cq_ring_size_);
+        if (sq_ring_ != MAP_FAILED) munmap(sq_ring_, sq_ring_size_);
+        if (fd_ >= 0) close(fd_);
+    }
+
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    int fd() const { return fd_; }
+
+    bool init(unsigned entries) {
+        io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        // 完成通知推迟到下次 io_uring_enter 时处理，减少中断
+        // (ring 在主线程创建、在事件循环线程提交，不能用 IORING_SETUP_SINGLE_ISSUER)
+        params.flags = IORING_SETUP_COOP_TASKRUN;
+        fd_ = (int)syscall(__NR_io_uring_setup, entries, &params);
+        if (fd_ < 0) return false;
+
+        sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (single_mmap) sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+
+        sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+        if (sq_ring_ == MAP_FAILED) return false;
+        cq_ring_ = single_mmap ? sq_ring_
+                               : mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_,
+                                      IORING_OFF_CQ_RING);
+        if (cq_ring_ == MAP_FAILED) return false;
+        sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+        sqes_ = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+        if (sqes_ == MAP_FAILED) return false;
+
+        char* sq = static_cast<char*>(sq_ring_);
+        sq_head_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sq_mask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sq_entries_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_entries);
+        sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        sq_tail_local_ = *sq_tail_;
+
+        char* cq = static_cast<char*>(cq_ring_);
+        cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cq_mask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        return true;
+    }
+
+    // 取一个空的提交项；提交队列已满时先提交一次
+    io_uring_sqe* get_sqe() {
+        if (sq_tail_local_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) >= sq_entries_) {
+            submit(0);
+            if (sq_tail_local_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) >= sq_entries_) return nullptr;
+        }
+        unsigned index = sq_tail_local_ & sq_mask_;
+        io_uring_sqe* sqe = static_cast<io_uring_sqe*>(sqes_) + index;
+        memset(sqe, 0, sizeof(*sqe));
+        sq_array_[index] = index;
+        ++sq_tail_local_;
+        return sqe;
+    }
+
+    // 提交所有新的提交项，并等待至少 wait_nr 个完成事件
+    int submit(unsigned wait_nr) {
+        __atomic_store_n(sq_tail_, sq_tail_local_, __ATOMIC_RELEASE);
+        unsigned to_submit = sq_tail_local_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+        unsigned flags = wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0;
+        return (int)syscall(__NR_io_uring_enter, fd_, to_submit, wait_nr, flags, nullptr, 0);
+    }
+
+    // 依次处理当前所有的完成事件
+    template <typename Handler>
+    void for_each_cqe(Handler handler) {
+        unsigned head = *cq_head_;
+        unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+        for (; head != tail; ++head) {
+            handler(cqes_[head & cq_mask_]);
+        }
+        __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+    }
+
+private:
+    int fd_;
+    void* sq_ring_;
+    void* cq_ring_;
+    void* sqes_;
+    size_t sq_ring_size_, cq_ring_size_, sqes_size_;
+
+    unsigned* sq_head_;
+    unsigned* sq_tail_;
+    unsigned* sq_array_;
+    unsigned sq_mask_, sq_entries_;
+    unsigned sq_tail_local_;  // 已填写但尚未发布给内核的队尾
+
+    unsigned* cq_head_;
+    unsigned* cq_tail_;
+    unsigned cq_mask_;
+    io_uring_cqe* cqes_;
+};
+
+// 交给内核的接收缓冲组 (provided buffers)：multishot recv 每次完成时由内核从组中挑一个缓冲填入数据，
+// 用户态把数据拷进连接的读缓冲后立即归还。
+// 使用 IORING_OP_PROVIDE_BUFFERS 而非 IORING_REGISTER_PBUF_RING：后者在部分内核上注册成功
+// 但 recv 始终取不到缓冲 (-ENOBUFS)，前者自 5.7 起行为一致；归还的请求随下一次 io_uring_enter 一并提交
+class ProvidedBuffers {
+public:
+    static constexpr unsigned COUNT = 256;          // 缓冲个数
+    static constexpr unsigned BUF_SIZE = 8 * 1024;  // 每个缓冲的大小
+    static constexpr uint16_t GROUP_ID = 0;
+    static constexpr uint64_t USER_DATA = 5;        // 归还请求的 user_data (只有失败时才产生完成事件)
+
+    ProvidedBuffers() : ring_(nullptr), buffers_(nullptr) {}
+    ~ProvidedBuffers() { free(buffers_); }
+
+    ProvidedBuffers(const ProvidedBuffers&) = delete;
+    ProvidedBuffers& operator=(const ProvidedBuffers&) = delete;
+
+    // 一次交出全部缓冲并等待结果
+    bool init(IoUring& ring) {
+        ring_ = &ring;
+        buffers_ = static_cast<char*>(malloc((size_t)COUNT * BUF_SIZE));
+        if (!buffers_) return false;
+        io_uring_sqe* sqe = ring.get_sqe();
+        if (!sqe) return false;
+        sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+        sqe->fd = COUNT;
+        sqe->addr = reinterpret_cast<uint64_t>(buffers_);
+        sqe->len = BUF_SIZE;
+        sqe->off = 0;
+        sqe->buf_group = GROUP_ID;
+        sqe->user_data = USER_DATA;
+        if (ring.submit(1) < 0) return false;
+        int res = -EAGAIN;
+        ring.for_each_cqe([&res](const io_uring_cqe& cqe) { res = cqe.res; });
+        if (res < 0) errno = -res;
+        return res >= 0;
+    }
+
+    const char* data(uint16_t bid) const { return buffers_ + (size_t)bid * BUF_SIZE; }
+
+    // 把缓冲还给内核
+    bool recycle(uint16_t bid) {
+        io_uring_sqe* sqe = ring_->get_sqe();
+        if (!sqe) return false;
+        sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+        sqe->fd = 1;
+        sqe->addr = reinterpret_cast<uint64_t>(buffers_ + (size_t)bid * BUF_SIZE);
+        sqe->len = BUF_SIZE;
+        sqe->off = bid;
+        sqe->buf_group = GROUP_ID;
+        sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+        sqe->user_data = USER_DATA;
+        return true;
+    }
+
+private:
+    IoUring* ring_;
+    char* buffers_;
+};
+
+class UringLoop {
+public:
+    typedef std::function<std::shared_ptr<Connection>(int)> AcceptCallback;
+    typedef std::function<bool(Connection&)> ConnCallback;
+    typedef std::function<void(const std::shared_ptr<Connection>&)> CloseCallback;
+
+    AcceptCallback on_accept;  // 新连接：创建并注册 Connection，返回 nullptr 表示已拒绝
+    ConnCallback on_input;     // 读缓冲中有新数据，返回 false 表示关闭连接
+    ConnCallback on_mail;      // 邮箱中有新消息，返回 false 表示关闭连接
+    CloseCallback on_close;    // 连接上已没有在途请求，可以安全关闭
+    CloseCallback on_timeout;  // 连接已过 deadline_of 给出的时刻 (之后由事件循环关闭)
+
+    // 连接的下一个超时时刻 (单调时钟毫秒)，0 表示不需要定时器；为空时不管理超时
+    std::function<uint64_t(Connection&)> deadline_of;
+
+    // 每次从发送队列搬进暂存区的最大字节数
+    static constexpr size_t SEND_CHUNK = 64 * 1024;
+
+    // 为 false 时 recv 不用 multishot，每个完成事件之后重新提交 (测试用：内核结束 multishot 时的
+    // 最后一个完成事件同样不带 IORING_CQE_F_MORE，走的是同一条路径)；须在 run() 之前设置
+    bool multishot_recv;
+
+    UringLoop() : multishot_recv(true), listen_fd_(-1), wakeup_fd_(-1), wakeup_value_(0), timer_armed_(false), running_(true) {}
+
+    ~UringLoop() {
+        for (auto& item : conns_) delete item.second;
+        if (wakeup_fd_ >= 0) close(wakeup_fd_);
+    }
+
+    UringLoop(const UringLoop&) = delete;
+    UringLoop& operator=(const UringLoop&) = delete;
+
+    // 创建 ring 并注册接收缓冲；内核不支持时返回 false
+    bool init() {
+        wakeup_fd_ = eventfd(0, EFD_CLOEXEC);
+        return wakeup_fd_ >= 0 && ring_.init(4096) && buffers_.init(ring_);
+    }
+
+    // 通知事件循环处理该连接的邮箱 (任意线程调用)
+    void post(Connection* conn) {
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            posted_.push_back(conn);
+        }
+        uint64_t one = 1;
+        ssize_t ret = write(wakeup_fd_, &one, sizeof(one));
+        (void)ret;
+    }
+
+    // 事件循环主体：在 listen_fd 上接收连接，直到 stop() 被调用
+    // 监听 socket 被 shutdown (开始排空) 后不再接收新连接，已有的连接继续服务
+    void run(int listen_fd) {
+        listen_fd_ = listen_fd;
+        arm_accept();
+        arm_wakeup();
+        while (running_) {
+            int ret = ring_.submit(1);
+            if (ret < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+                perror("io_uring_enter");
+                break;
+            }
+            ring_.for_each_cqe([this](const io_uring_cqe& cqe) { handle(cqe); });
+            if (!timer_armed_ && !timers_.empty()) arm_timer();
+        }
+    }
+
+    // 通知事件循环退出 (线程安全)
+    void stop() {
+        running_ = false;
+        uint64_t one = 1;
+        ssize_t ret = write(wakeup_fd_, &one, sizeof(one));
+        (void)ret;
+    }
+
+    // 当前持有的连接 (事件循环线程退出后调用，用于关闭时统一清理)
+    std::vector<std::shared_ptr<Connection>> connections() const {
+        std::vector<std::shared_ptr<Connection>> result;
+        for (const auto& item : conns_) result.push_back(item.second->conn);
+        return result;
+    }
+
+private:
+    // user_data 的低 3 位为请求类型，其余位为连接状态的地址 (循环级请求为 0)
+    enum OpTag : uint64_t { OP_ACCEPT = 1, OP_WAKEUP = 2, OP_RECV = 3, OP_SEND = 4, OP_PROVIDE = ProvidedBuffers::USER_DATA,
+                          OP_TIMER = 6 };
+    static constexpr uint64_t TAG_MASK = 7;
+
+    // 连接在循环中的状态 (仅事件循环线程访问)
+    struct UringConn {
+        std::shared_ptr<Connection> conn;
+        std::string staging;       // 在途发送的数据
+        size_t staging_off = 0;    // 暂存区中已发出的字节数
+        bool sending = false;
+        bool closing = false;
+        int pending = 0;           // 在途请求数 (multishot recv 计一次)
+    };
+
+    static uint64_t tag(UringConn* state, OpTag op) { return reinterpret_cast<uint64_t>(state) | op; }
+
+    void arm_accept() {
+        io_uring_sqe* sqe = ring_.get_sqe();
+        if (!sqe) return;
+        sqe->opcode = IORING_OP_ACCEPT;
+        sqe->fd = listen_fd_;
+        sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+        sqe->accept_flags = SOCK_CLOEXEC;
+        sqe->user_data = OP_ACCEPT;
+    }
+
+    void arm_wakeup() {
+        io_uring_sqe* sqe = ring_.get_sqe();
+        if (!sqe) return;
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = wakeup_fd_;
+        sqe->addr = reinterpret_cast<uint64_t>(&wakeup_value_);
+        sqe->len = sizeof(wakeup_value_);
+        sqe->user_data = OP_WAKEUP;
+    }
+
+    // 等到时间轮的下一个刻度 (count 为 0：纯超时，以 -ETIME 完成)
+    void arm_timer() {
+        io_uring_sqe* sqe = ring_.get_sqe();
+        if (!sqe) return;
+        int wait_ms = std::max(0, timers_.next_timeout_ms(monotonic_ms()));
+        timer_ts_.tv_sec = wait_ms / 1000;
+        timer_ts_.tv_nsec = (long long)(wait_ms % 1000) * 1000000;
+        sqe->opcode = IORING_OP_TIMEOUT;
+        sqe->fd = -1;
+        sqe->addr = reinterpret_cast<uint64_t>(&timer_ts_);
+        sqe->len = 1;
+        sqe->user_data = OP_TIMER;
+        timer_armed_ = true;
+    }
+
+    // 超时时刻提前或尚未加入时间轮时设置定时器；推迟的情况到期时再重新计算 (与 EventLoop 相同)
+    void refresh_timer(UringConn* state) {
+        if (!deadline_of || state->closing) return;
+        Connection& conn = *state->conn;
+        uint64_t deadline = deadline_of(conn);
+        if (deadline && (!conn.timer.linked() || deadline < timers_.expires_ms(conn.timer))) timers_.schedule(conn.timer, deadline);
+    }
+
+    void expire_timers() {
+        uint64_t now = monotonic_ms();
+        timers_.advance(now, [this, now](TimerNode& node) {
+            auto it = conns_.find(static_cast<Connection*>(node.owner));
+            if (it == conns_.end() || it->second->closing) return;
+            UringConn* state = it->second;
+            uint64_t deadline = deadline_of(*state->conn);
+            if (deadline == 0) return;
+            if (deadline > now) {
+                timers_.schedule(node, deadline);
+            } else {
+                if (on_timeout) on_timeout(state->conn);
+                begin_close(state);
+            }
+        });
+    }
+
+    // 以下几个函数返回 true 表示连接状态已释放 (经 begin_close)，调用方不能再访问 state
+    bool arm_recv(UringConn* state) {
+        io_uring_sqe* sqe = ring_.get_sqe();
+        if (!sqe) return begin_close(state);
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = state->conn->fd;
+        sqe->ioprio = multishot_recv ? IORING_RECV_MULTISHOT : 0;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = ProvidedBuffers::GROUP_ID;
+        sqe->user_data = tag(state, OP_RECV);
+        ++state->pending;
+        return false;
+    }
+
+    // 暂存区发完后从发送队列补充，提交下一个发送
+    bool try_send(UringConn* state) {
+        if (state->closing || state->sending) return false;
+        Connection& conn = *state->conn;
+        if (state->staging_off >= state->staging.size()) {
+            state->staging.clear();
+            state->staging_off = 0;
+            bool close_now;
+            {
+                std::lock_guard<std::mutex> lock(conn.out_mtx);
+                // 文件 (HTTP 静态资源) 经 pread 拷入暂存区，读取失败时发完已读到的部分后关闭
+                bool ok = conn.out.take(state->staging, SEND_CHUNK);
+                conn.staged = state->staging.size();
+                close_now = state->staging.empty() && (conn.close_after_flush || !ok);
+                if (!ok) conn.close_after_flush = true;
+            }
+            if (close_now) return begin_close(state);  // HTTP 应答等已全部发出
+            if (state->staging.empty()) return false;
+        }
+        io_uring_sqe* sqe = ring_.get_sqe();
+        if (!sqe) return begin_close(state);
+        sqe->opcode = IORING_OP_SEND;
+        sqe->fd = conn.fd;
+        sqe->addr = reinterpret_cast<uint64_t>(state->staging.data() + state->staging_off);
+        sqe->len = (uint32_t)(state->staging.size() - state->staging_off);
+        sqe->msg_flags = MSG_NOSIGNAL;
+        sqe->user_data = tag(state, OP_SEND);
+        state->sending = true;
+        ++state->pending;
+        return false;
+    }
+
+    // 开始关闭：shutdown 让在途的 recv / send 尽快完成，全部完成后才真正关闭 (此时释放 state 并返回 true)
+    bool begin_close(UringConn* state) {
+        if (!state->closing) {
+            state->closing = true;
+            timers_.cancel(state->conn->timer);
+            kick_connection(*state->conn);
+        }
+        if (state->pending == 0) {
+            conns_.erase(state->conn.get());
+            if (on_close) on_close(state->conn);
+            delete state;
+            return true;
+        }
+        return false;
+    }
+
+    void handle(const io_uring_cqe& cqe) {
+        uint64_t op = cqe.user_data & TAG_MASK;
+        UringConn* state = reinterpret_cast<UringConn*>(cqe.user_data & ~TAG_MASK);
+        bool more = (cqe.flags & IORING_CQE_F_MORE) != 0;
+
+        switch (op) {
+            case OP_ACCEPT:
+                if (cqe.res == -EINVAL) break;  // 监听 socket 已被 shutdown (服务器关闭)：不再接收
+                if (cqe.res >= 0) {
+                    accepted(cqe.res);
+                } else if (cqe.res != -EINTR && cqe.res != -ECONNABORTED) {
+                    errno = -cqe.res;
+                    perror("accept failed");
+                }
+                if (!more && running_) arm_accept();
+                break;
+            case OP_PROVIDE:
+                errno = -cqe.res;
+                perror("provide buffers failed");
+                break;
+            case OP_WAKEUP:
+                run_posted();
+                if (running_) arm_wakeup();
+                break;
+            case OP_TIMER:
+                timer_armed_ = false;
+                expire_timers();
+                break;
+            case OP_RECV:
+                if (!more) --state->pending;
+                if (cqe.res > 0 && (cqe.flags & IORING_CQE_F_BUFFER)) {
+                    uint16_t bid = (uint16_t)(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+                    state->conn->rbuf.append(buffers_.data(bid), cqe.res);
+                    if (!buffers_.recycle(bid)) perror("provide buffers failed");
+                    if (!state->closing && on_input && !on_input(*state->conn)) {
+                        if (begin_close(state)) break;  // 最后一个在途请求：state 已释放
+                    } else if (try_send(state)) {
+                        break;
+                    }
+                    refresh_timer(state);
+                    if (!more && !state->closing && arm_recv(state)) break;
+                } else if (cqe.res == -ENOBUFS && !state->closing) {
+                    if (!more && arm_recv(state)) break;  // 接收缓冲暂时用尽，重新挂上
+                } else {
+                    begin_close(state);  // 对端关闭 (0) 或出错
+                    break;
+                }
+                if (state->closing && state->pending == 0) begin_close(state);
+                break;
+            case OP_SEND:
+                --state->pending;
+                state->sending = false;
+                if (cqe.res < 0) {
+                    begin_close(state);
+                    break;
+                }
+                state->staging_off += cqe.res;
+                if (state->closing) {
+                    if (state->pending == 0) begin_close(state);
+                } else if (on_mail && !on_mail(*state->conn)) {
+                    begin_close(state);  // 发送队列腾出空间后继续从邮箱取消息
+                } else {
+                    try_send(state);
+                }
+                break;
+        }
+    }
+
+    void accepted(int fd) {
+        std::shared_ptr<Connection> conn = on_accept ? on_accept(fd) : nullptr;
+        if (!conn) return;
+        UringConn* state = new UringConn();
+        state->conn = conn;
+        conns_[conn.get()] = state;
+        if (arm_recv(state) || try_send(state)) return;  // try_send：欢迎消息
+        refresh_timer(state);
+    }
+
+    // 处理其他线程投递过来的连接 (已移除的连接直接跳过)
+    void run_posted() {
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            draining_.swap(posted_);
+        }
+        for (Connection* ptr : draining_) {
+            auto it = conns_.find(ptr);
+            if (it == conns_.end() || it->second->closing) continue;
+            UringConn* state = it->second;
+            if (on_mail && !on_mail(*state->conn)) {
+                begin_close(state);
+            } else {
+                try_send(state);
+            }
+        }
+        draining_.clear();
+    }
+
+    // buffers_ 必须在 ring_ 之前声明：析构时先关闭 ring (取消在途的 recv)，再释放内核可能写入的缓冲
+    ProvidedBuffers buffers_;
+    IoUring ring_;
+    int listen_fd_;
+    int wakeup_fd_;
+    uint64_t wakeup_value_;
+    TimerWheel timers_;             // 连接的超时 (仅事件循环线程访问)
+    __kernel_timespec timer_ts_;    // 在途 IORING_OP_TIMEOUT 的等待时间
+    bool timer_armed_;
+    std::atomic<bool> running_;
+
+    std::map<Connection*, UringConn*> conns_;  // 仅事件循环线程访问
+    std::mutex mtx_;
+    std::vector<Connection*> posted_;          // 待处理邮箱的连接 (mtx_ 保护)
+    std::vector<Connection*> draining_;
+};
+
+#endif // __linux__ && HAVE_IO_URING
+
+#endif // URING_LOOP_H
@@ -0,0 +1,352 @@
+#ifndef USER_DIRECTORY_H
+#define USER_DIRECTORY_H
+
+#include <string>
+#include <string_view>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <map>
+#include <unordered_set>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <random>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include "connection.h"
+#include "buffer_pool.h"  // same_secret
+
+// === 用户目录：稳定的客户端身份 ===
+// 客户端在 REQ_CONNECT 中带上 "user=NAME" 注册，同一个名字总是得到同一个用户 ID，
+// 重新连接后 ID 不变，离线时发给它的消息可以存入消息日志。
+//   - 首次注册时生成随机令牌交给客户端，之后用这个名字登录须带上同一个令牌 ("token=HEX")；
+//     没有令牌的旧记录在下一次登录时补发
+//   - 用户 ID 从 USER_ID_BASE 开始分配，与 socket fd 形式的临时 ID 不重叠，REQ_SEND_MSG 按数值区分二者
+//   - 指定了存储目录时，名字、ID 与令牌追加写入 DIR/users ("ID NAME TOKEN" 每行一条，注册时 fdatasync，
+//     文件权限 0600)，重启后恢复；否则只保存在内存中。写文件不持有表的锁，等待落盘的注册不阻塞在线查询
+//   - 同一时刻一个用户只能绑定一个连接
+//   - 集群中每个节点从自己的分区 (USER_ID_BASE + 节点编号 << PARTITION_SHIFT) 分配 ID，注册通过节点间连接
+//     广播，其他节点用 merge 合并；同一个名字在两个节点上同时首次注册时保留较小的 ID，
+//     较大的 ID 作为别名保留 (仍可寻址，之前为它存下的离线消息在上线时一并重放)
+
+const uint32_t USER_ID_BASE = 1u << 30;
+const int PARTITION_SHIFT = 22;  // 每个节点最多分配 2^22 个用户 ID
+const size_t MAX_USER_NAME = 32;
+const size_t USER_TOKEN_SIZE = 32;  // 16 个随机字节的十六进制
+
+enum RegisterResult {
+    REGISTER_OK,
+    REGISTER_BAD_TOKEN,  // 名字已注册，令牌不符
+    REGISTER_FAILED,     // 分区的 ID 用尽或写文件失败
+};
+
+// 目录中的一条记录 (用于同步给新连接的节点)；token 为空表示旧记录没有令牌
+struct UserEntry {
+    uint32_t id;
+    std::string name;
+    std::string token;
+};
+
+class UserDirectory {
+public:
+    typedef std::shared_ptr<Connection> ConnPtr;
+
+    UserDirectory() : partition_(USER_ID_BASE), next_id_(USER_ID_BASE), fd_(-1) {}
+
+    ~UserDirectory() {
+        if (fd_ >= 0) close(fd_);
+    }
+
+    UserDirectory(const UserDirectory&) = delete;
+    UserDirectory& operator=(const UserDirectory&) = delete;
+
+    // 名字由字母、数字与 "_.-" 组成，长度 1..MAX_USER_NAME
+    static bool valid_name(std::string_view name) {
+        if (name.empty() || name.size() > MAX_USER_NAME) return false;
+        for (char c : name) {
+            if (!isalnum((unsigned char)c) && c != '_' && c != '.' && c != '-') return false;
+        }
+        return true;
+    }
+
+    // 集群中本节点的编号：之后新注册的用户从该节点的分区分配 ID (在 open 之前调用)
+    void set_node(int node) {
+        std::lock_guard<std::mutex> lock(mtx_);
+        partition_ = USER_ID_BASE + ((uint32_t)node << PARTITION_SHIFT);
+        next_id_ = std::max(next_id_, partition_);
+    }
+
+    // 从 path 恢复已注册的用户 (包括从其他节点合并来的)，之后的注册追加到该文件；失败时填写 error
+    bool open(const std::string& path, std::string& error) {
+        std::lock_guard<std::mutex> lock(mtx_);
+        if (FILE* f = fopen(path.c_str(), "r")) {
+            // 同一个 ID 出现多次时 (旧记录补发了令牌) 以后一行为准
+            char line[128];
+            while (fgets(line, sizeof(line), f)) {
+                unsigned long id;
+                char name[MAX_USER_NAME + 1], token[USER_TOKEN_SIZE + 1] = "";
+                if (sscanf(line, "%lu %32s %32s", &id, name, token) < 2) continue;
+                if (id < USER_ID_BASE || id > INT32_MAX || !valid_name(name)) continue;
+                merge_locked((uint32_t)id, name, valid_token(token) ? token : "");
+            }
+            fclose(f);
+        }
+        // 文件中保存着令牌：只允许服务器自己的用户读写
+        fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+        if (fd_ < 0 || fchmod(fd_, 0600) < 0) {
+            error = "open " + path + ": " + strerror(errno);
+            return false;
+        }
+        return true;
+    }
+
+    // 令牌为 USER_TOKEN_SIZE 个小写十六进制字符
+    static bool valid_token(std::string_view token) {
+        if (token.size() != USER_TOKEN_SIZE) return false;
+        for (char c : token) {
+            if (!isdigit((unsigned char)c) && (c < 'a' || c > 'f')) return false;
+        }
+        return true;
+    }
+
+    // 查找或注册名字对应的用户 ID 并核对令牌 (名字须已通过 valid_name)，保留的 ID 写入 id。
+    // 新名字 (或没有令牌的旧记录) 生成令牌，新写入的记录填入 issued (其 ID 在与其他节点同时注册时
+    // 可能只是别名)；否则 token 须与该名字任一 ID 的令牌相同，issued 不变
+    RegisterResult register_name(std::string_view name, std::string_view token, uint32_t& id, UserEntry& issued) {
+        std::string key(name);
+        std::unique_lock<std::mutex> lock(mtx_);
+        // 1. 同一个名字正由其他线程注册时等待其结果
+        registered_.wait(lock, [&] { return registering_.count(key) == 0; });
+        auto it = ids_.find(key);
+        if (it != ids_.end()) {
+            id = it->second;
+            int match = token_matches(id, token);
+            if (match >= 0) return match ? REGISTER_OK : REGISTER_BAD_TOKEN;
+        } else {
+            id = next_id_;
+            if (id >= partition_ + (1u << PARTITION_SHIFT)) return REGISTER_FAILED;
+            ++next_id_;
+        }
+        registering_.insert(key);
+
+        // 2. 在锁外生成令牌、写文件并落盘
+        lock.unlock();
+        std::string fresh = new_token();
+        bool persisted = persist(id, key, fresh);
+        lock.lock();
+
+        // 3. 登记 (期间其他节点注册了同一个名字时按 merge 的规则保留较小的 ID，两个令牌都有效)
+        registering_.erase(key);
+        registered_.notify_all();
+        if (!persisted) return REGISTER_FAILED;
+        merge_locked(id, key, fresh);
+        issued = UserEntry{id, key, fresh};
+        id = ids_[key];
+        return REGISTER_OK;
+    }
+
+    // 合并其他节点注册的用户；返回 false 表示已知 (无需处理，已知但本地没有令牌时只补上令牌)。
+    // 名字已对应另一个 ID 时保留较小者，renamed_from 为被取代的 ID (否则为 0)
+    bool merge(uint32_t id, std::string_view name, std::string_view token, uint32_t& renamed_from) {
+        std::string key(name);
+        std::string value = valid_token(token) ? std::string(token) : std::string();
+        bool added;
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            added = merge_new(id, key, value, renamed_from);
+            if (!added && (value.empty() || !fill_token(id, key, value))) return false;
+        }
+        persist(id, key, value);
+        return added;
+    }
+
+
+    // ID 当前对应的 ID (别名换成保留的 ID)，未知时返回 0
+    uint32_t canonical(uint32_t id) {
+        std::lock_guard<std::mutex> lock(mtx_);
+        auto it = names_.find(id);
+        return it == names_.end() ? 0 : ids_[it->second];
+    }
+
+    // 同一名字被取代的 ID
+    std::vector<uint32_t> aliases(uint32_t id) {
+        std::lock_guard<std::mutex> lock(mtx_);
+        auto it = retired_.find(id);
+        return it == retired_.end() ? std::vector<uint32_t>() : it->second;
+    }
+
+    // 所有记录 (包括别名)，用于同步给新连接的节点
+    std::vector<UserEntry> entries() {
+        std::lock_guard<std::mutex> lock(mtx_);
+        std::vector<UserEntry> result;
+        result.reserve(names_.size());
+        for (const auto& item : names_) {
+            auto token = tokens_.find(item.first);
+            result.push_back(UserEntry{item.first, item.second, token == tokens_.end() ? std::string() : token->second});
+        }
+        return result;
+    }
+
+    // ID 的令牌 (发布新注册的用户时随名字一起发给其他节点)，没有时返回空串
+    std::string token(uint32_t id) {
+        std::lock_guard<std::mutex> lock(mtx_);
+        auto it = tokens_.find(id);
+        return it == tokens_.end() ? std::string() : it->second;
+    }
+
+    // 名字对应的用户 ID，未注册时返回 0
+    uint32_t lookup(std::string_view name) {
+        std::lock_guard<std::mutex> lock(mtx_);
+        auto it = ids_.find(std::string(name));
+        return it == ids_.end() ? 0 : it->second;
+    }
+
+    bool known(uint32_t id) {
+        std::lock_guard<std::mutex> lock(mtx_);
+        return names_.count(id) > 0;
+    }
+
+    // 把用户绑定到连接；该用户已在另一个连接上在线时返回 false
+    bool bind(uint32_t id, const ConnPtr& conn) {
+        std::lock_guard<std::mutex> lock(mtx_);
+        auto it = online_.find(id);
+        if (it != online_.end() && it->second != conn) return false;
+        online_[id] = conn;
+        return true;
+    }
+
+    // 解除绑定 (仅当仍绑定在 expected 上，避免误删之后的新连接)；返回是否解除
+    bool unbind(uint32_t id, const Connection* expected) {
+        std::lock_guard<std::mutex> lock(mtx_);
+        auto it = online_.find(id);
+        if (it == online_.end() || it->second.get() != expected) return false;
+        online_.erase(it);
+        return true;
+    }
+
+    // 绑定在本节点连接上的用户
+    std::vector<uint32_t> online_ids() {
+        std::vector<uint32_t> result;
+        std::lock_guard<std::mutex> lock(mtx_);
+        for (const auto& item : online_) result.push_back(item.first);
+        return result;
+    }
+
+    // 用户当前绑定的连接，离线时返回 nullptr
+    ConnPtr online(uint32_t id) {
+        std::lock_guard<std::mutex> lock(mtx_);
+        auto it = online_.find(id);
+        return it == online_.end() ? nullptr : it->second;
+    }
+
+private:
+    static std::string new_token() {
+        static const char HEX[] = "0123456789abcdef";
+        std::random_device random;
+        std::string token;
+        for (size_t i = 0; i < USER_TOKEN_SIZE / 8; ++i) {
+            uint32_t bits = random();
+            for (int j = 0; j < 8; ++j, bits >>= 4) token += HEX[bits & 15];
+        }
+        return token;
+    }
+
+    // 名字 (保留的 ID 及其别名) 的令牌与 token 是否相同：1 相同，0 不同，-1 都没有令牌 (持有 mtx_)
+    int token_matches(uint32_t id, std::string_view token) {
+        std::vector<uint32_t> ids(1, id);
+        auto retired = retired_.find(id);
+        if (retired != retired_.end()) ids.insert(ids.end(), retired->second.begin(), retired->second.end());
+        bool any = false;
+        for (uint32_t each : ids) {
+            auto it = tokens_.find(each);
+            if (it == tokens_.end()) continue;
+            any = true;
+            if (same_secret(it->second, token)) return 1;
+        }
+        return any ? 0 : -1;
+    }
+
+    // 已知的 ID 补上其他节点发来的令牌 (本地没有时)；返回是否补上 (持有 mtx_)
+    bool fill_token(uint32_t id, const std::string& key, const std::string& token) {
+        auto it = names_.find(id);
+        if (it == names_.end() || it->second != key || tokens_.count(id)) return false;
+        tokens_[id] = token;
+        return true;
+    }
+
+    // merge 的内存部分 (持有 mtx_)
+    bool merge_new(uint32_t id, const std::string& key, const std::string& token, uint32_t& renamed_from) {
+        renamed_from = 0;
+        if (id < USER_ID_BASE || names_.count(id) || !valid_name(key)) return false;
+        auto it = ids_.find(key);
+        uint32_t previous = it == ids_.end() ? 0 : it->second;
+        merge_locked(id, key, token);
+        if (previous && previous != ids_[key]) {
+            renamed_from = previous;
+            // 已绑定在旧 ID 上的本地连接改为按新 ID 寻址
+            auto bound = online_.find(previous);
+            if (bound != online_.end()) {
+                online_[ids_[key]] = bound->second;
+                online_.erase(bound);
+            }
+        }
+        return true;
+    }
+
+    // 追加一行并落盘 (file_mtx_ 串行化写文件，不持有 mtx_)
+    bool persist(uint32_t id, const std::string& name, const std::string& token) {
+        if (fd_ < 0) return true;
+        std::lock_guard<std::mutex> lock(file_mtx_);
+        std::string line = std::to_string(id) + " " + name;
+        if (!token.empty()) line += " " + token;
+        line += "\n";
+        if (write(fd_, line.data(), line.size()) != (ssize_t)line.size() || fdatasync(fd_) < 0) {
+            perror("users");
+            return false;
+        }
+        return true;
+    }
+
+    // 登记 "ID 名字 令牌"：名字已对应另一个 ID 时保留较小者；本分区内的 ID 推进分配位置
+    void merge_locked(uint32_t id, const std::string& name, const std::string& token) {
+        names_[id] = name;
+        if (!token.empty()) tokens_[id] = token;
+        auto it = ids_.find(name);
+        if (it == ids_.end()) {
+            ids_[name] = id;
+        } else if (id < it->second) {
+            std::vector<uint32_t>& retired = retired_[id];
+            retired.push_back(it->second);
+            auto old = retired_.find(it->second);
+            if (old != retired_.end()) {
+                retired.insert(retired.end(), old->second.begin(), old->second.end());
+                retired_.erase(old);
+            }
+            it->second = id;
+        } else if (id != it->second) {
+            retired_[it->second].push_back(id);
+        }
+        if (id >= partition_ && id < partition_ + (1u << PARTITION_SHIFT)) next_id_ = std::max(next_id_, id + 1);
+    }
+
+    std::mutex mtx_;       // 保护以下各表
+    std::mutex file_mtx_;  // 保护 fd_ 上的写入
+    std::condition_variable registered_;
+    std::unordered_set<std::string> registering_;     // 正在写文件的新名字
+    std::unordered_map<std::string, uint32_t> ids_;   // 名字 -> 保留的 ID
+    std::map<uint32_t, std::string> names_;           // ID (包括别名) -> 名字
+    std::unordered_map<uint32_t, std::vector<uint32_t>> retired_;  // 保留的 ID -> 被它取代的 ID
+    std::unordered_map<uint32_t, std::string> tokens_;  // ID (包括别名) -> 令牌
+    std::unordered_map<uint32_t, ConnPtr> online_;    // 按保留的 ID
+    uint32_t partition_;  // 本节点分配 ID 的起点
+    uint32_t next_id_;
+    int fd_;  // DIR/users，-1 表示只保存在内存中
+};
+
+#endif // USER_DIRECTORY_H